@@ -5,6 +5,7 @@
 
 #include <fstream>
 #include <cstdint>
+#include <charconv>
 
 #include <cctype> // for std::toupper
 
@@ -60,6 +61,12 @@ RenderSettings init_render_settings(const std::string& baseName,
     s.ffmpeg_output = g_base_output_filepath + "/" + baseName + ".mp4";
     s.ffmpeg_extra_args = "-c:v libx264 -preset veryfast -crf 18";
 
+    // Long render: one-minute video segments and a checkpoint, so a crash
+    // resumes at the last finished minute when rerun (the unique name stays
+    // the same until the final video exists).
+    s.ffmpeg_segment_frames = 60 * 60;
+    s.checkpoint_path = s.ffmpeg_output + ".checkpoint";
+
     return s;
 }
 
@@ -1915,13 +1922,65 @@ int main()
     std::cout << "example_tunnel_world_sections_text\n";
     std::cout << "This code is in file: " << __FILE__ << "\n";
 
-    const std::string uniqueName = WIRE_UNIQUE_NAME(g_base_output_filepath);
+    // Farm render: WIRE_SHARD="<index>/<count>" renders one shard on each
+    // node, WIRE_SHARD="merge/<count>" joins them. Every node needs the same
+    // video name and the same universe (seeded Random).
+    const char* shardEnv = std::getenv("WIRE_SHARD");
+    int shardIndex = -1, shardCount = 0;
+    bool merge = false;
+    if (shardEnv)
+    {
+        // Whole string must be a number.
+        auto parseInt = [](const std::string& text, int& value)
+        {
+            const char* end = text.data() + text.size();
+            const auto [ptr, ec] = std::from_chars(text.data(), end, value);
+            return ec == std::errc() && ptr == end;
+        };
+
+        const std::string spec = shardEnv;
+        const std::size_t slash = spec.find('/');
+        bool valid = slash != std::string::npos &&
+            parseInt(spec.substr(slash + 1), shardCount) && shardCount > 0;
+        if (valid)
+        {
+            merge = spec.compare(0, slash, "merge") == 0;
+            if (merge) shardIndex = 0;
+            else valid = parseInt(spec.substr(0, slash), shardIndex) &&
+                shardIndex >= 0 && shardIndex < shardCount;
+        }
+        if (!valid)
+        {
+            std::cerr << "WIRE_SHARD=\"" << spec << "\": expected \"<index>/<count>\" "
+                << "with 0 <= index < count, or \"merge/<count>\".\n";
+            return 1;
+        }
+    }
+    const bool sharded = shardCount > 0;
+
+    const std::string uniqueName = sharded
+        ? std::string("tunnel_world_farm")
+        : WIRE_UNIQUE_NAME(g_base_output_filepath);
     std::cout << "Video name: " << uniqueName << "\n";
     std::cout << "Output path: " << g_base_output_filepath
         << "/" << uniqueName << ".mp4\n";
 
     RenderSettings settings = init_render_settings(uniqueName, 240 * 100);
 
+    if (merge)
+    {
+        return mergeShards(settings, shardCount) ? 0 : 1;
+    }
+    if (sharded)
+    {
+        settings = shardSettings(settings, shardIndex, shardCount);
+        settings.checkpoint_path = shardVideoPath(settings) + ".checkpoint";
+        std::cout << "Shard " << shardIndex << "/" << shardCount << ": frames "
+            << settings.frame_begin << " .. " << settings.frame_end - 1
+            << " -> " << shardVideoPath(settings) << "\n";
+    }
+
+    Random::set_seed(settings.seed);
     Universe universe{};
 
     // <<< NEW: export static tunnel + text geometry for Blender debug
@@ -1935,6 +1994,9 @@ int main()
         &universe
     );
 
-    VLC::play(g_base_output_filepath + "/" + uniqueName + ".mp4");
+    if (!sharded)
+    {
+        VLC::play(g_base_output_filepath + "/" + uniqueName + ".mp4");
+    }
     return 0;
 }
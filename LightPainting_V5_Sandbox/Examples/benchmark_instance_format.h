@@ -0,0 +1,145 @@
+#pragma once
+
+#include "WireUtil.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+
+using namespace WireEngine;
+
+// -----------------------------------------------------------------------------
+// Benchmark: InstanceFormat::Float32 (60 B/segment, vertex attributes)
+//        vs  InstanceFormat::PackedQuantized (24 B/segment, vertex pulling)
+//
+// Renders the same random-walk ribbon at 1M, 4M and 16M segments with both
+// layouts and prints average upload / draw time per frame (FrameStats).
+// To run it, point main.cpp at this file.
+// -----------------------------------------------------------------------------
+
+struct BenchScene
+{
+    std::vector<LineParams> segments;
+
+    // Spatially coherent like real scenes (a long random-walk polyline),
+    // so per-chunk quantization sees realistic extents.
+    void build(std::size_t count)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> step(-0.6f, 0.6f);
+        std::uniform_real_distribution<float> u01(0.0f, 1.0f);
+
+        segments.resize(count);
+        Vec3 p(0.0f);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            LineParams& line = segments[i];
+            line.start_x = p.x; line.start_y = p.y; line.start_z = p.z;
+
+            p += Vec3(step(rng), step(rng), step(rng));
+            p = glm::clamp(p, Vec3(-120.0f), Vec3(120.0f));
+
+            line.end_x = p.x; line.end_y = p.y; line.end_z = p.z;
+
+            line.start_r = u01(rng); line.start_g = 0.4f; line.start_b = 1.0f;
+            line.end_r = 1.0f;       line.end_g = u01(rng); line.end_b = 0.3f;
+
+            line.thickness = 0.05f;
+            line.jitter = 0.3f;
+            line.intensity = 2.0f;
+        }
+    }
+};
+
+struct BenchResult
+{
+    double upload_ms = 0.0;
+    double draw_ms = 0.0;
+    double upload_mb = 0.0;
+    int    frames = 0;
+};
+
+BenchResult run_instance_format_bench(const BenchScene& scene, InstanceFormat format)
+{
+    const int segmentCount = static_cast<int>(scene.segments.size());
+
+    RenderSettings settings;
+    settings.width = 1280;
+    settings.height = 720;
+    settings.frames = 6;
+    settings.accum_passes = 16;
+    settings.max_line_segments_hint = segmentCount;
+    settings.instance_format = format;
+    settings.use_pbo = true;
+    settings.output_mode = OutputMode::FramesPNG;
+    // Frames are only written to time the readback; keep them out of the
+    // real output folder.
+    settings.output_dir = (std::filesystem::temp_directory_path() /
+        "wire_bench_instance_format").string();
+
+    BenchResult result;
+    settings.frame_stats_cb = [&result](const FrameStats& stats)
+        {
+            if (stats.frame == 0) return; // warm-up (shader compile, first touch)
+            result.upload_ms += stats.upload_ms;
+            result.draw_ms += stats.draw_ms;
+            result.upload_mb += double(stats.upload_bytes) / (1024.0 * 1024.0);
+            result.frames++;
+        };
+
+    auto camera = [](int, float, CameraParams& cam)
+        {
+            cam.eye_x = 0.0f; cam.eye_y = 80.0f; cam.eye_z = 260.0f;
+            cam.target_x = 0.0f; cam.target_y = 0.0f; cam.target_z = 0.0f;
+        };
+
+    auto count = [segmentCount](int, float) { return segmentCount; };
+
+    auto fill = [&scene](int, float, int firstIndex, std::span<LineParams> out)
+        {
+            const std::size_t n = std::min(out.size(),
+                scene.segments.size() - static_cast<std::size_t>(firstIndex));
+            std::memcpy(out.data(), scene.segments.data() + firstIndex,
+                n * sizeof(LineParams));
+            return static_cast<int>(n);
+        };
+
+    renderSequenceBatched(settings, camera, count, fill);
+
+    if (result.frames > 0)
+    {
+        result.upload_ms /= result.frames;
+        result.draw_ms /= result.frames;
+        result.upload_mb /= result.frames;
+    }
+    return result;
+}
+
+int main()
+{
+    std::cout << "benchmark_instance_format\n";
+    std::cout << "This code is in file: " << __FILE__ << "\n";
+
+    const int counts[] = { 1 << 20, 4 << 20, 16 << 20 };
+
+    std::printf("%10s  %-16s %12s %12s %12s\n",
+        "segments", "format", "upload MB", "upload ms", "draw ms");
+
+    for (int count : counts)
+    {
+        BenchScene scene;
+        scene.build(static_cast<std::size_t>(count));
+
+        const BenchResult f32 = run_instance_format_bench(scene, InstanceFormat::Float32);
+        const BenchResult packed = run_instance_format_bench(scene, InstanceFormat::PackedQuantized);
+
+        std::printf("%10d  %-16s %12.1f %12.2f %12.2f\n",
+            count, "Float32", f32.upload_mb, f32.upload_ms, f32.draw_ms);
+        std::printf("%10d  %-16s %12.1f %12.2f %12.2f\n",
+            count, "PackedQuantized", packed.upload_mb, packed.upload_ms, packed.draw_ms);
+    }
+
+    return 0;
+}
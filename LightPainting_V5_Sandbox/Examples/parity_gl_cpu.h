@@ -0,0 +1,161 @@
+#pragma once
+
+#include "WireUtil.h"
+
+// WireUtil.h only declares stb_image; this example is its one user.
+#define STB_IMAGE_IMPLEMENTATION
+#include "../External_libs/stb/image/stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+using namespace WireEngine;
+
+// -----------------------------------------------------------------------------
+// Parity check: RenderBackend::OpenGL vs RenderBackend::CPU
+//
+// Renders the same seeded scene (jittered ribbons, bloom on) with both
+// backends and compares the PNG frames channel by channel (8 bit). GL
+// accumulates in half floats and rasterizes with its own coverage rules, so
+// the frames are close but not identical; the check fails if the largest or
+// the mean difference exceeds the tolerance below.
+// To run it, point main.cpp at this file.
+// -----------------------------------------------------------------------------
+
+namespace parity
+{
+    // Largest and mean per-channel difference allowed (0..255). Mesa's
+    // llvmpipe stays at max 20 / mean 0.02: isolated edge pixels where the
+    // coverage rules disagree.
+    constexpr int    kMaxDiff = 32;
+    constexpr double kMeanDiff = 0.25;
+
+    constexpr int kFrames = 3;
+
+    struct Diff
+    {
+        int    max = 0;
+        double mean = 0.0;
+        bool   loaded = false;
+    };
+
+    void render(RenderBackend backend, const std::string& outDir)
+    {
+        RenderSettings settings;
+        settings.width = 640;
+        settings.height = 360;
+        settings.frames = kFrames;
+        settings.accum_passes = 16;
+        settings.energy_per_hit = 1.5e-2f;
+        settings.seed = 7;
+        settings.backend = backend;
+        settings.output_mode = OutputMode::FramesPNG;
+        settings.output_dir = outDir;
+
+        auto camera = [](int frame, float, CameraParams& cam)
+            {
+                cam.eye_x = 40.0f * frame; cam.eye_y = 60.0f; cam.eye_z = 220.0f;
+                cam.target_x = 0.0f; cam.target_y = 0.0f; cam.target_z = 0.0f;
+            };
+
+        auto lines = [](int frame, float, LineEmitContext& ctx)
+            {
+                RngStream rng(ctx.seed, frame, 0);
+                for (int i = 0; i < 3000; ++i)
+                {
+                    LineParams line;
+                    line.start_x = rng.next_signed() * 90.0f;
+                    line.start_y = rng.next_signed() * 60.0f;
+                    line.start_z = rng.next_signed() * 90.0f;
+                    line.end_x = line.start_x + rng.next_signed() * 12.0f;
+                    line.end_y = line.start_y + rng.next_signed() * 12.0f;
+                    line.end_z = line.start_z + rng.next_signed() * 12.0f;
+
+                    line.start_r = rng.next01(); line.start_g = 0.5f; line.start_b = 1.0f;
+                    line.end_r = 1.0f;           line.end_g = rng.next01(); line.end_b = 0.3f;
+
+                    line.thickness = 0.1f + rng.next01() * 0.6f;
+                    line.jitter = rng.next01() * 0.8f;
+                    line.intensity = 1.5f;
+                    ctx.add(line);
+                }
+            };
+
+        renderSequencePush(settings, camera, lines);
+    }
+
+    Diff compare(const std::string& pathA, const std::string& pathB)
+    {
+        Diff diff;
+        int wa = 0, ha = 0, wb = 0, hb = 0, n = 0;
+        unsigned char* a = stbi_load(pathA.c_str(), &wa, &ha, &n, 4);
+        unsigned char* b = stbi_load(pathB.c_str(), &wb, &hb, &n, 4);
+        if (a && b && wa == wb && ha == hb)
+        {
+            const std::size_t pixels = std::size_t(wa) * ha;
+            double sum = 0.0;
+            for (std::size_t i = 0; i < pixels; ++i)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    const int d = std::abs(int(a[i * 4 + c]) - int(b[i * 4 + c]));
+                    diff.max = std::max(diff.max, d);
+                    sum += d;
+                }
+            }
+            diff.mean = sum / double(pixels * 3);
+            diff.loaded = true;
+        }
+        stbi_image_free(a);
+        stbi_image_free(b);
+        return diff;
+    }
+
+    std::string framePath(const std::string& dir, int frame)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "/frame_%04d.png", frame);
+        return dir + name;
+    }
+}
+
+int main()
+{
+    std::cout << "parity_gl_cpu\n";
+    std::cout << "This code is in file: " << __FILE__ << "\n";
+
+    const std::filesystem::path root =
+        std::filesystem::temp_directory_path() / "wire_parity_gl_cpu";
+    const std::string glDir = (root / "gl").string();
+    const std::string cpuDir = (root / "cpu").string();
+
+    parity::render(RenderBackend::OpenGL, glDir);
+    parity::render(RenderBackend::CPU, cpuDir);
+
+    std::printf("tolerance: max <= %d, mean <= %.2f (8-bit channels)\n",
+        parity::kMaxDiff, parity::kMeanDiff);
+    std::printf("%6s %10s %10s  %s\n", "frame", "max", "mean", "result");
+
+    bool pass = true;
+    for (int frame = 0; frame < parity::kFrames; ++frame)
+    {
+        const parity::Diff diff = parity::compare(
+            parity::framePath(glDir, frame), parity::framePath(cpuDir, frame));
+        const bool ok = diff.loaded &&
+            diff.max <= parity::kMaxDiff && diff.mean <= parity::kMeanDiff;
+        pass = pass && ok;
+
+        if (!diff.loaded)
+        {
+            std::printf("%6d %10s %10s  missing frame\n", frame, "-", "-");
+            continue;
+        }
+        std::printf("%6d %10d %10.3f  %s\n",
+            frame, diff.max, diff.mean, ok ? "ok" : "FAIL");
+    }
+
+    std::cout << (pass ? "GL and CPU backends agree.\n" : "GL and CPU backends differ.\n");
+    return pass ? 0 : 1;
+}
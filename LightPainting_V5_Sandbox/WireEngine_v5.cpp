@@ -4,19 +4,66 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+// GLContextProvider::EGLHeadless: EGL headers at build time, libEGL.so.1
+// opened at run time, so there is nothing extra to link.
+#if !defined(WIRE_HAVE_EGL) && defined(__linux__) && defined(__has_include)
+#if __has_include(<EGL/egl.h>)
+#define WIRE_HAVE_EGL 1
+#endif
+#endif
+#if !defined(WIRE_HAVE_EGL)
+#define WIRE_HAVE_EGL 0
+#endif
+#if WIRE_HAVE_EGL
+#define EGL_NO_X11
+#define MESA_EGL_NO_X11_HEADERS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <dlfcn.h>
+#endif
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <vector>
 #include <string>
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <filesystem>
+#include <fstream>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <cmath>
+#include <utility>
+#include <csignal>
+
+// SIMD kernels are picked at compile time (/arch:AVX2 or -mavx2 for AVX2;
+// SSE2 is baseline on x64).
+#if defined(__AVX2__)
+#define WIRE_SIMD_AVX2 1
+#define WIRE_SIMD_SSE  1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIRE_SIMD_AVX2 0
+#define WIRE_SIMD_SSE  1
+#include <emmintrin.h>
+#else
+#define WIRE_SIMD_AVX2 0
+#define WIRE_SIMD_SSE  0
+#endif
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../External_libs/stb/image/stb_image_write.h"
@@ -33,26 +80,28 @@ namespace WireEngine {
         FILE* pipe = nullptr;
     };
 
-    static bool openFFmpegPipe(FFmpegPipe& vp, const RenderSettings& settings) {
-        if (settings.output_mode != OutputMode::FFmpegVideo)
-            return false;
-
+    // ffmpeg_path as the start of a shell command.
+    static std::string ffmpegExecutable(const RenderSettings& settings) {
         std::string exe = settings.ffmpeg_path.empty()
             ? std::string("ffmpeg")
             : settings.ffmpeg_path;
 
-        std::ostringstream cmd;
-
 #if defined(_WIN32)
         if (exe.find(' ') != std::string::npos) {
-            cmd << "\"" << exe << "\"";
+            exe = "\"" + exe + "\"";
         }
-        else {
-            cmd << exe;
-        }
-#else
-        cmd << exe;
 #endif
+        return exe;
+    }
+
+    static bool openFFmpegPipe(FFmpegPipe& vp, const RenderSettings& settings,
+        const std::string& output)
+    {
+        if (settings.output_mode != OutputMode::FFmpegVideo)
+            return false;
+
+        std::ostringstream cmd;
+        cmd << ffmpegExecutable(settings);
 
         cmd << " -y"
             << " -f rawvideo"
@@ -69,7 +118,7 @@ namespace WireEngine {
         }
 
         cmd << "-pix_fmt yuv420p "
-            << "\"" << settings.ffmpeg_output << "\"";
+            << "\"" << output << "\"";
 
         std::string cmdStr = cmd.str();
         std::cout << "[WireEngine] FFmpeg command:\n" << cmdStr << "\n";
@@ -77,6 +126,9 @@ namespace WireEngine {
 #if defined(_WIN32)
         vp.pipe = _popen(cmdStr.c_str(), "wb");
 #else
+        // An ffmpeg that dies mid-stream must show up as a short write
+        // (see ffmpegWriteFrame), not as SIGPIPE ending the whole process.
+        std::signal(SIGPIPE, SIG_IGN);
         vp.pipe = popen(cmdStr.c_str(), "w");
 #endif
 
@@ -90,31 +142,482 @@ namespace WireEngine {
         return true;
     }
 
-    static void closeFFmpegPipe(FFmpegPipe& vp) {
-        if (!vp.enabled || !vp.pipe) return;
+    // False if ffmpeg did not exit cleanly (its output is then unusable).
+    static bool closeFFmpegPipe(FFmpegPipe& vp) {
+        if (!vp.enabled || !vp.pipe) return true;
 #if defined(_WIN32)
-        _pclose(vp.pipe);
+        const int status = _pclose(vp.pipe);
 #else
-        pclose(vp.pipe);
+        const int status = pclose(vp.pipe);
 #endif
         vp.pipe = nullptr;
         vp.enabled = false;
+        if (status != 0) {
+            std::cerr << "[WireEngine] ffmpeg failed (status " << status << ")\n";
+            return false;
+        }
+        return true;
     }
 
-    static void ffmpegWriteFrame(FFmpegPipe& vp,
+    // False if the pipe took only part of the frame; without an open pipe
+    // there is nothing to write.
+    static bool ffmpegWriteFrame(FFmpegPipe& vp,
         const unsigned char* rgbaTopDown,
         int w, int h)
     {
-        if (!vp.enabled || !vp.pipe || !rgbaTopDown) return;
+        if (!vp.enabled || !vp.pipe || !rgbaTopDown) return true;
         const size_t bytes = size_t(w) * h * 4;
         const size_t written = fwrite(rgbaTopDown, 1, bytes, vp.pipe);
         if (written != bytes) {
             std::cerr << "[WireEngine] FFmpeg pipe write short: "
                 << written << " / " << bytes << " bytes\n";
+            return false;
+        }
+        return true;
+    }
+
+    // RenderSettings::frame_begin / frame_end / frame_step, clamped to the
+    // sequence: frames begin, begin + step, ... below end.
+    struct FrameRange {
+        int begin = 0;
+        int end = 0;
+        int step = 1;
+
+        int count() const { return end > begin ? (end - begin + step - 1) / step : 0; }
+        bool whole(int frames) const { return begin == 0 && end == frames && step == 1; }
+    };
+
+    static FrameRange frameRange(const RenderSettings& settings) {
+        FrameRange range;
+        range.end = (settings.frame_end < 0 || settings.frame_end > settings.frames)
+            ? settings.frames : settings.frame_end;
+        range.begin = std::clamp(settings.frame_begin, 0, std::max(range.end, 0));
+        range.step = std::max(settings.frame_step, 1);
+        return range;
+    }
+
+    // Video of 'range' of the sequence: ffmpeg_output for the whole
+    // sequence, else "<stem>.frames_<begin>-<end><ext>" next to it.
+    static std::string rangeVideoPath(const RenderSettings& settings, const FrameRange& range) {
+        if (range.whole(settings.frames)) return settings.ffmpeg_output;
+
+        // Padded to the sequence length, so the pieces sort in frame order.
+        const int digits = std::max(4, (int)std::to_string(std::max(settings.frames, 0)).size());
+        const fs::path out(settings.ffmpeg_output);
+        std::ostringstream name;
+        name << out.stem().string() << ".frames_"
+            << std::setw(digits) << std::setfill('0') << range.begin << "-"
+            << std::setw(digits) << std::setfill('0') << range.end;
+        if (range.step != 1) name << "_step" << range.step;
+        name << out.extension().string();
+        return (out.parent_path() / name.str()).string();
+    }
+
+    // Joins videos with the same encoder settings, each starting with a key
+    // frame, without re-encoding (concat demuxer, stream copy).
+    static bool concatVideos(const RenderSettings& settings,
+        const std::vector<std::string>& inputs, const std::string& output)
+    {
+        const std::string listPath = output + ".parts.txt";
+        {
+            std::ofstream list(listPath);
+            if (!list) {
+                std::cerr << "[WireEngine] Cannot write " << listPath << "\n";
+                return false;
+            }
+            std::error_code ec;
+            for (const std::string& path : inputs) {
+                // Quoted for the concat demuxer: ' becomes '\''.
+                std::string quoted;
+                for (char c : fs::absolute(path, ec).string()) {
+                    if (c == '\'') quoted += "'\\''";
+                    else quoted += c;
+                }
+                list << "file '" << quoted << "'\n";
+            }
+        }
+
+        std::ostringstream cmd;
+        cmd << ffmpegExecutable(settings)
+            << " -y -f concat -safe 0 -i \"" << listPath << "\""
+            << " -c copy \"" << output << "\"";
+        const std::string cmdStr = cmd.str();
+        std::cout << "[WireEngine] Joining " << inputs.size() << " videos:\n" << cmdStr << "\n";
+
+        const int status = std::system(cmdStr.c_str());
+        std::error_code ec;
+        fs::remove(listPath, ec);
+        if (status != 0) {
+            std::cerr << "[WireEngine] ffmpeg concat failed (" << status << ")\n";
+            return false;
+        }
+        return true;
+    }
+
+    // ========================================================================
+    // Output progress: video segments and the checkpoint manifest
+    // ========================================================================
+    // Frames are written in order, so progress is the first frame whose
+    // output is not final yet: the next PNG, or the first frame of the
+    // video segment being encoded (a video is only valid once ffmpeg has
+    // finished it). Without ffmpeg_segment_frames the run is one segment.
+    struct OutputProgress {
+        const RenderSettings* settings = nullptr;
+        bool        video = false;         // OutputMode::FFmpegVideo (no fallback)
+        FFmpegPipe* ffmpeg = nullptr;
+        FrameRange  range;                 // the whole run, resumed or not
+        int         segmentFrames = 0;     // frames per video segment
+        int         segment = -1;          // segment the pipe is open for
+        int         next = 0;              // first frame not yet final
+        std::vector<std::string> segments; // finished segment videos, in order
+        std::string manifest;              // checkpoint_path ("" = none)
+        std::string fingerprint;           // settings the manifest belongs to
+        bool        complete = false;
+        bool        failed = false;        // a segment's ffmpeg failed: the
+                                           // run stops, progress stays put
+    };
+
+    static const char* CHECKPOINT_MAGIC = "wire-checkpoint 1";
+
+    static int segmentOf(const OutputProgress& out, int frame) {
+        return (frame - out.range.begin) / out.range.step / out.segmentFrames;
+    }
+
+    static FrameRange segmentRange(const OutputProgress& out, int segment) {
+        const long long span = (long long)out.segmentFrames * out.range.step;
+        FrameRange r = out.range;
+        r.begin = int(std::min<long long>(out.range.begin + segment * span, out.range.end));
+        r.end = int(std::min<long long>(r.begin + span, out.range.end));
+        return r;
+    }
+
+    static std::string segmentPath(const OutputProgress& out, int segment) {
+        const FrameRange r = segmentRange(out, segment);
+        // A single segment is the run's video itself.
+        if (r.begin == out.range.begin && r.end == out.range.end) {
+            return rangeVideoPath(*out.settings, out.range);
+        }
+        return rangeVideoPath(*out.settings, r);
+    }
+
+    static uint64_t hashBytes(const void* src, size_t bytes) {
+        const unsigned char* p = static_cast<const unsigned char*>(src);
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ bytes;
+        for (; bytes >= 8; bytes -= 8, p += 8) {
+            uint64_t w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        if (bytes > 0) {
+            uint64_t w = 0;
+            std::memcpy(&w, p, bytes);
+            h = (h ^ w) * 0xff51afd7ed558ccdull;
+        }
+        return splitmix64(h);
+    }
+
+    // What a manifest must match to be resumed: the run and its output in
+    // plain text, then a hash of every setting that changes the images
+    // or the encoding (including the static layer and shape geometry).
+    // Settings that only change speed (threads, pipelining, PBO, pacing,
+    // passes per draw, context) are left out. Callbacks cannot be
+    // compared: resuming assumes they are the same too.
+    static std::string checkpointFingerprint(const RenderSettings& settings) {
+        const FrameRange range = frameRange(settings);
+        std::ostringstream oss;
+        oss << settings.width << "x" << settings.height
+            << " frames " << settings.frames << " fps " << settings.fps
+            << " range " << range.begin << "-" << range.end << "/" << range.step
+            << " passes " << settings.accum_passes << " seed " << settings.seed;
+        if (settings.output_mode == OutputMode::FFmpegVideo) {
+            oss << " segment " << settings.ffmpeg_segment_frames
+                << " video " << rangeVideoPath(settings, range);
+        }
+        else {
+            oss << " png " << settings.output_dir;
+        }
+
+        // Exact float bits, one field per line.
+        std::ostringstream look;
+        look << std::hexfloat
+            << int(settings.jitter_mode) << "\n"
+            << settings.adaptive_error << "\n" << settings.adaptive_percentile << "\n"
+            << settings.adaptive_min_passes << "\n" << settings.adaptive_check_passes << "\n"
+            << settings.exposure << "\n" << settings.bloom_threshold << "\n"
+            << settings.bloom_strength << "\n" << settings.bloom_enabled << "\n"
+            << settings.soft_edge << "\n" << settings.energy_per_hit << "\n"
+            << settings.thickness_scale << "\n"
+            << settings.max_line_segments_hint << "\n" << int(settings.instance_format) << "\n"
+            << settings.ffmpeg_extra_args << "\n"
+            << settings.tile_size << "\n" << settings.tile_margin << "\n"
+            << settings.splat_max_pixels << "\n" << int(settings.line_blend_mode) << "\n"
+            << int(settings.backend) << "\n"
+            << settings.frustum_cull << "\n" << settings.contribution_cull_quanta << "\n"
+            << settings.lod_merge_pixels << "\n" << settings.lod_merge_max_angle_deg << "\n"
+            << settings.incremental_upload << "\n" << settings.stream_flush_batches << "\n"
+            << settings.sample_budget << "\n";
+        for (const StaticLayer& layer : settings.static_layers) {
+            look << "layer " << layer.name << " " << layer.segments.size() << " "
+                << hashBytes(layer.segments.data(), layer.segments.size() * sizeof(LineParams))
+                << " " << layer.state.visible << " " << layer.state.intensity << " "
+                << hashBytes(layer.state.transform, sizeof(layer.state.transform)) << "\n";
+        }
+        for (const ShapePrototype& proto : settings.shape_prototypes) {
+            look << "shape " << proto.name << " " << proto.segments.size() << " "
+                << hashBytes(proto.segments.data(), proto.segments.size() * sizeof(LineParams))
+                << "\n";
+        }
+        const std::string lookStr = look.str();
+        oss << " look " << std::hex << std::setw(16) << std::setfill('0')
+            << hashBytes(lookStr.data(), lookStr.size());
+        return oss.str();
+    }
+
+    // Written next to the manifest and renamed over it, so a crash leaves
+    // either the old or the new one.
+    static void saveCheckpoint(const OutputProgress& out) {
+        if (out.manifest.empty()) return;
+
+        const std::string tmp = out.manifest + ".tmp";
+        {
+            std::ofstream f(tmp, std::ios::trunc);
+            f << CHECKPOINT_MAGIC << "\n"
+                << "settings " << out.fingerprint << "\n"
+                << "next " << out.next << "\n";
+            for (const std::string& path : out.segments) {
+                f << "segment " << path << "\n";
+            }
+            if (out.complete) f << "complete\n";
+            if (!f.flush()) {
+                std::cerr << "[WireEngine] Cannot write checkpoint " << tmp << "\n";
+                return;
+            }
+        }
+        std::error_code ec;
+        fs::rename(tmp, out.manifest, ec);
+        if (ec) {
+            std::cerr << "[WireEngine] Cannot update checkpoint " << out.manifest
+                << " (" << ec.message() << ")\n";
+        }
+    }
+
+    static std::string framePngPath(const std::string& dir, int frame) {
+        std::ostringstream oss;
+        oss << dir << "/frame_" << std::setw(4) << std::setfill('0') << frame << ".png";
+        return oss.str();
+    }
+
+    // Progress from the manifest, if it belongs to these settings and its
+    // outputs are still on disk.
+    static void loadCheckpoint(OutputProgress& out) {
+        std::ifstream f(out.manifest);
+        if (!f) return;
+
+        std::string line;
+        if (!std::getline(f, line) || line != CHECKPOINT_MAGIC) {
+            std::cerr << "[WireEngine] " << out.manifest << " is no checkpoint; starting over.\n";
+            return;
+        }
+
+        int next = out.range.begin;
+        bool complete = false;
+        std::vector<std::string> segments;
+        bool matches = false;
+        while (std::getline(f, line)) {
+            if (line.rfind("settings ", 0) == 0) matches = line.substr(9) == out.fingerprint;
+            else if (line.rfind("next ", 0) == 0) next = std::atoi(line.c_str() + 5);
+            else if (line.rfind("segment ", 0) == 0) segments.push_back(line.substr(8));
+            else if (line == "complete") complete = true;
+        }
+        if (!matches) {
+            std::cerr << "[WireEngine] Checkpoint " << out.manifest
+                << " is for other settings; starting over.\n";
+            return;
+        }
+
+        std::error_code ec;
+        if (complete) {
+            const std::string result = out.video
+                ? rangeVideoPath(*out.settings, out.range) : std::string();
+            if (result.empty() || fs::exists(result, ec)) {
+                out.next = out.range.end;
+                out.complete = true;
+                return;
+            }
+            std::cerr << "[WireEngine] " << result << " is gone; starting over.\n";
+            return;
+        }
+
+        if (out.video) {
+            // Keep the leading segments that are still there.
+            int kept = 0;
+            while (kept < (int)segments.size() && segments[kept] == segmentPath(out, kept) &&
+                fs::exists(segments[kept], ec) && fs::file_size(segments[kept], ec) > 0)
+            {
+                ++kept;
+            }
+            segments.resize(kept);
+            next = segmentRange(out, kept).begin;
+        }
+        else {
+            // Redo from the first counted frame that is missing or empty.
+            const int counted = std::min(next, out.range.end);
+            for (int f = out.range.begin; f < counted; f += out.range.step) {
+                const std::string path = framePngPath(out.settings->output_dir, f);
+                if (!fs::exists(path, ec) || fs::file_size(path, ec) == 0) {
+                    next = f;
+                    break;
+                }
+            }
+        }
+        out.segments = std::move(segments);
+        out.next = std::clamp(next, out.range.begin, out.range.end);
+    }
+
+    // Sets up 'out' for settings; false if the checkpoint says the run is
+    // already complete (nothing to render).
+    static bool beginOutput(OutputProgress& out, const RenderSettings& settings) {
+        out.settings = &settings;
+        out.range = frameRange(settings);
+        out.next = out.range.begin;
+        out.manifest = settings.checkpoint_path;
+        out.fingerprint = checkpointFingerprint(settings);
+
+        out.video = settings.output_mode == OutputMode::FFmpegVideo;
+        out.segmentFrames = (out.video && settings.ffmpeg_segment_frames > 0)
+            ? settings.ffmpeg_segment_frames : std::max(out.range.count(), 1);
+
+        if (!out.manifest.empty()) {
+            loadCheckpoint(out);
+        }
+        if (out.complete) {
+            std::cout << "[WireEngine] Checkpoint " << out.manifest
+                << ": sequence already complete.\n";
+            return false;
+        }
+        if (out.next != out.range.begin) {
+            std::cout << "[WireEngine] Checkpoint " << out.manifest << ": resuming at frame "
+                << out.next << " (" << (out.next - out.range.begin) / out.range.step
+                << " of " << out.range.count() << " frames done).\n";
+        }
+        return true;
+    }
+
+    static bool openOutputSegment(OutputProgress& out, int segment) {
+        out.segment = segment;
+        return openFFmpegPipe(*out.ffmpeg, *out.settings, segmentPath(out, segment));
+    }
+
+    // Stops the run on a video failure. 'enabled' stays set, so the frames
+    // still in flight are dropped instead of falling back to PNG.
+    static void failOutput(OutputProgress& out) {
+        std::cerr << "[WireEngine] Video segment " << segmentPath(out, out.segment)
+            << " failed; stopping at frame " << out.next << ".\n";
+        out.failed = true;
+        out.ffmpeg->enabled = true;
+    }
+
+    // Opens the video for the first frame of the run, falling back to PNG.
+    static void openOutput(OutputProgress& out, FFmpegPipe& ffmpeg) {
+        if (!out.video) return;
+
+        out.ffmpeg = &ffmpeg;
+        ffmpeg.enabled = true;
+        if (out.next < out.range.end && !openOutputSegment(out, segmentOf(out, out.next))) {
+            std::cerr << "[WireEngine] FFmpeg mode requested but pipe failed; "
+                << "falling back to PNG frames.\n";
+            out.video = false;
+            out.manifest.clear(); // its progress would be for the video
+        }
+    }
+
+    // Before a frame's first bytes go out.
+    static void beginFrameOutput(OutputProgress* out, int frame) {
+        if (!out || !out->video || out->failed) return;
+        const int segment = segmentOf(*out, frame);
+        if (segment == out->segment && out->ffmpeg->pipe) return;
+
+        // endFrameOutput closes each segment after its last frame, so an
+        // open pipe here means that segment is incomplete.
+        if (out->ffmpeg->pipe) {
+            closeFFmpegPipe(*out->ffmpeg);
+            failOutput(*out);
+            return;
+        }
+        if (!openOutputSegment(*out, segment)) {
+            failOutput(*out);
+        }
+    }
+
+    // Instead of endFrameOutput when a frame's PNG or video bytes did not
+    // all get written: the run stops before that frame.
+    static void failFrameOutput(OutputProgress* out, int frame) {
+        std::cerr << "[WireEngine] Writing frame " << frame << " failed.\n";
+        if (!out || out->failed) return;
+        if (out->video) {
+            closeFFmpegPipe(*out->ffmpeg); // unfinished segment, not recorded
+            failOutput(*out);
+            return;
+        }
+        std::cerr << "[WireEngine] Stopping at frame " << out->next << ".\n";
+        out->failed = true;
+    }
+
+    // After a frame is completely written.
+    static void endFrameOutput(OutputProgress* out, int frame) {
+        if (!out || out->failed) return;
+        if (!out->video) {
+            out->next = frame + out->range.step;
+            saveCheckpoint(*out);
+            return;
+        }
+
+        const FrameRange segment = segmentRange(*out, out->segment);
+        if (frame + out->range.step < segment.end) return;
+
+        // Last frame of the segment: pclose waits until ffmpeg has
+        // finished the file, which is then a complete video if it exited
+        // cleanly. The run stays in video mode (closeFFmpegPipe clears
+        // 'enabled').
+        const bool ok = closeFFmpegPipe(*out->ffmpeg);
+        out->ffmpeg->enabled = true;
+        if (!ok) {
+            failOutput(*out);
+            return;
+        }
+        out->segments.push_back(segmentPath(*out, out->segment));
+        out->next = segment.end;
+        saveCheckpoint(*out);
+    }
+
+    // After the last frame: joins the segments into the run's video.
+    static void finishOutput(OutputProgress& out) {
+        if (out.video && out.ffmpeg && out.ffmpeg->pipe) {
+            closeFFmpegPipe(*out.ffmpeg); // unfinished segment, not recorded
         }
+        if (out.failed) {
+            std::cerr << "[WireEngine] Output incomplete; a rerun continues at frame "
+                << out.next << ".\n";
+            return;
+        }
+        if (out.next < out.range.end) return; // frames missing
+
+        if (out.video) {
+            const std::string result = rangeVideoPath(*out.settings, out.range);
+            if (out.segments.size() != 1 || out.segments[0] != result) {
+                if (!concatVideos(*out.settings, out.segments, result)) return;
+                std::error_code ec;
+                for (const std::string& path : out.segments) fs::remove(path, ec);
+            }
+            out.segments.clear();
+        }
+        out.complete = true;
+        saveCheckpoint(out);
     }
 
     static const int YIELD_EVERY_PASSES = 6;
+    static const int PULL_BATCH_SEGMENTS = 64 * 1024; // renderSequenceBatched chunk
 
     // ========================================================================
     // Utils: GL helpers, FBOs, VAOs, post shaders
@@ -161,6 +664,26 @@ namespace WireEngine {
             return p;
         }
 
+        // Needs a GL 4.3 context (compute shaders).
+        static GLuint createComputeProgram(const char* cs) {
+            GLuint c = compileShader(GL_COMPUTE_SHADER, cs);
+            GLuint p = glCreateProgram();
+            glAttachShader(p, c);
+            glLinkProgram(p);
+            glDeleteShader(c);
+            GLint ok = 0;
+            glGetProgramiv(p, GL_LINK_STATUS, &ok);
+            if (!ok) {
+                GLint len = 0;
+                glGetProgramiv(p, GL_INFO_LOG_LENGTH, &len);
+                std::vector<char> log(len);
+                glGetProgramInfoLog(p, len, nullptr, log.data());
+                std::cerr << "Program link error:\n" << log.data() << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+            return p;
+        }
+
         // ----- FBO wrappers -----
         struct HDRFBO {
             GLuint fbo = 0;
@@ -267,6 +790,23 @@ namespace WireEngine {
             glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
 
+        // Another VAO over an existing pos/uv quad VBO (see makeVAO).
+        static void makeQuadVAO(GLuint& vao, GLuint vbo) {
+            glGenVertexArrays(1, &vao);
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+                4 * sizeof(float), (void*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+                4 * sizeof(float), (void*)(2 * sizeof(float)));
+
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
         // ----- Fullscreen VS -----
         static const char* FSQ_VS = R"GLSL(
 #version 330 core
@@ -345,6 +885,57 @@ void main() {
     color       = pow(color, vec3(1.0/2.2)); // gamma
     FragColor   = vec4(color,1.0);
 }
+)GLSL";
+
+        // ----- Copy FS (drawn with additive blending) -----
+        static const char* ADD_FS = R"GLSL(
+#version 330 core
+in vec2 vUV;
+out vec4 FragColor;
+uniform sampler2D uTex;
+
+void main() {
+    FragColor = vec4(texelFetch(uTex, ivec2(gl_FragCoord.xy), 0).rgb, 0.0);
+}
+)GLSL";
+
+        // ----- Tile noise FS (adaptive accumulation) -----
+        // One fragment per TILE x TILE pixels. uEven / uOdd are the sums of
+        // the even and odd passes; (even - odd) * uScale has the standard
+        // deviation of the whole estimate (even + odd) * uScale, and
+        // E|x| = sigma * sqrt(2/pi) for a normal x. Mean over the tile's
+        // lit pixels of the worst channel, through the tonemap slope;
+        // -1 for tiles without light.
+        static const char* TILE_ERROR_FS = R"GLSL(
+#version 330 core
+out vec4 FragColor;
+uniform sampler2D uEven;
+uniform sampler2D uOdd;
+uniform ivec2 uSize;
+uniform float uScale;
+uniform float uExposure;
+
+const int TILE = 32;
+
+void main() {
+    ivec2 base = ivec2(gl_FragCoord.xy) * TILE;
+    ivec2 end  = min(base + ivec2(TILE), uSize);
+    float sum  = 0.0;
+    int   lit  = 0;
+    for (int y = base.y; y < end.y; ++y) {
+        for (int x = base.x; x < end.x; ++x) {
+            vec3 a = texelFetch(uEven, ivec2(x, y), 0).rgb;
+            vec3 b = texelFetch(uOdd,  ivec2(x, y), 0).rgb;
+            vec3 hdr = (a + b) * uScale;
+            if (max(hdr.r, max(hdr.g, hdr.b)) <= 0.0) continue;
+            vec3 e = abs(a - b) * uScale * 1.2533141 *
+                     uExposure * exp(-hdr * uExposure);
+            sum += max(e.r, max(e.g, e.b));
+            ++lit;
+        }
+    }
+    FragColor = vec4(lit > 0 ? sum / float(lit) : -1.0, 0.0, 0.0, 1.0);
+}
 )GLSL";
 
     } // namespace Utils_
@@ -353,33 +944,31 @@ void main() {
     // Scene shaders (thick ribbon per segment, instanced)
     // ========================================================================
 
-    static const char* SCENE_VS = R"GLSL(
+    // Shared part: uniforms, hash and the ribbon expansion. Each instance
+    // format only adds how the per-segment data is fetched (see below).
+    static const char* SCENE_VS_COMMON = R"GLSL(
 #version 330 core
 
 layout(location=0) in vec2 aPos; // unused, kept for layout stability
 layout(location=1) in vec2 aUV;  // x: along (0 start, 1 end), y: side (0 -> -1, 1 -> +1)
 
-// Per-segment instance data
-layout(location=2) in vec3  aStartPos;
-layout(location=3) in vec3  aEndPos;
-layout(location=4) in vec3  aStartColor;
-layout(location=5) in vec3  aEndColor;
-layout(location=6) in float aThickness;
-layout(location=7) in float aJitter;
-layout(location=8) in float aIntensity;
-
 out vec2  vUV;
 out vec3  vCol;
 out float vDist;
 out float vIntensity;
+out float vProfile;            // JitterMode::Analytic: jitter / half width
 
 uniform mat4  uProj;
 uniform mat4  uView;
+uniform mat4  uModel;          // identity except for retained layers
 uniform float uThicknessScale;
 uniform int   uPassIndex;
 uniform int   uFrameIndex;
 uniform float uTime;
 uniform int   uSegmentOffset;
+uniform int   uPassFold;       // passes per draw, instance = segment * fold + pass
+uniform uint  uSeed;           // RenderSettings::seed, folded to 32 bits
+uniform int   uAnalytic;       // JitterMode::Analytic
 
 // --- small hash helpers ---
 uint hash_u(uint x){
@@ -392,21 +981,27 @@ uint hash_u(uint x){
 }
 float h1(uint x){ return float(hash_u(x)) / float(0xffffffffu); }
 
-void main() {
+void emitRibbon(vec3 aStartPos, vec3 aEndPos,
+                vec3 aStartColor, vec3 aEndColor,
+                float aThickness, float aJitter, float aIntensity)
+{
     vIntensity = aIntensity;
 
-    int segIndex = uSegmentOffset + gl_InstanceID;
+    int fold     = max(uPassFold, 1);
+    int segIndex = uSegmentOffset + gl_InstanceID / fold;
+    int pass     = uPassIndex + gl_InstanceID % fold;
 
     // Stable per-segment / per-pass seed
     uint seed = uint(segIndex);
-    seed ^= uint(uPassIndex)  * 2654435761u;
+    seed ^= uint(pass)        * 2654435761u;
     seed ^= uint(uFrameIndex) * 2246822519u;
+    seed ^= uSeed * 3266489917u;
 
     float along   = clamp(aUV.x, 0.0, 1.0);           // 0..1 along segment
     float sideRaw = aUV.y * 2.0 - 1.0;               // 0->-1, 1->+1
 
-    vec3 start   = aStartPos;
-    vec3 end     = aEndPos;
+    vec3 start   = (uModel * vec4(aStartPos, 1.0)).xyz;
+    vec3 end     = (uModel * vec4(aEndPos, 1.0)).xyz;
     vec3 dir     = end - start;
     float segLen = max(length(dir), 1e-5);
     vec3 lineDir = dir / segLen;
@@ -427,16 +1022,27 @@ void main() {
     // Local "up" axis (for jitter radius)
     vec3 upLocal = normalize(cross(lineDir, side));
 
-    // Radial jitter around the segment
-    float ang   = h1(seed) * 6.2831853;
-    float rad01 = h1(seed ^ 0x9e3779b9u);
-    float jRad  = aJitter * rad01;
-    vec3 jitterOffset = (cos(ang)*side + sin(ang)*upLocal) * jRad;
-
     // Thickness (world units)
     float thickness = aThickness * uThicknessScale;
+    float halfWidth = thickness;
+    vec3 jitterOffset = vec3(0.0);
+
+    if (uAnalytic != 0) {
+        // Widen by the jitter radius; the fragment shader looks up the
+        // expected coverage instead of moving the ribbon.
+        halfWidth = thickness + aJitter;
+        vProfile  = aJitter / max(halfWidth, 1e-6);
+    }
+    else {
+        // Radial jitter around the segment
+        float ang   = h1(seed) * 6.2831853;
+        float rad01 = h1(seed ^ 0x9e3779b9u);
+        float jRad  = aJitter * rad01;
+        jitterOffset = (cos(ang)*side + sin(ang)*upLocal) * jRad;
+        vProfile = 0.0;
+    }
 
-    vec3 offsetAcross = side * (sideRaw * thickness);
+    vec3 offsetAcross = side * (sideRaw * halfWidth);
 
     vec3 world = basePos + jitterOffset + offsetAcross;
 
@@ -448,56 +1054,426 @@ void main() {
 }
 )GLSL";
 
-    static const char* SCENE_FS = R"GLSL(
-#version 330 core
-in vec2  vUV;
-in vec3  vCol;
-in float vDist;
-in float vIntensity;
-out vec4 FragColor;
+    // InstanceFormat::Float32: fixed per-instance vertex attributes.
+    static const char* SCENE_VS_ATTRIB = R"GLSL(
+// Per-segment instance data
+layout(location=2) in vec3  aStartPos;
+layout(location=3) in vec3  aEndPos;
+layout(location=4) in vec3  aStartColor;
+layout(location=5) in vec3  aEndColor;
+layout(location=6) in float aThickness;
+layout(location=7) in float aJitter;
+layout(location=8) in float aIntensity;
 
-uniform float uSoft;          // 0..1 edge softness
-uniform float uEnergyPerHit;  // base contribution per segment
+void main() {
+    emitRibbon(aStartPos, aEndPos, aStartColor, aEndColor,
+               aThickness, aJitter, aIntensity);
+}
+)GLSL";
+
+    // InstanceFormat::PackedQuantized: vertex pulling from buffer textures.
+    //   segment = 3 RG32UI texels:
+    //     w0 = sx | sy << 16,  w1 = sz | ex << 16,  w2 = ey | ez << 16
+    //     w3 = start color RGB9E5, w4 = end color RGB9E5 (intensity folded in)
+    //     w5 = half thickness | half jitter << 16
+    //   chunk (PACKED_CHUNK_SEGMENTS segments) = 2 RGBA32F texels: origin, extent
+    static const char* SCENE_VS_PACKED = R"GLSL(
+uniform usamplerBuffer uPackedSegments;
+uniform samplerBuffer  uPackedChunks;
+uniform int            uInstanceBase;   // first segment of the draw
+
+const int PACKED_CHUNK_SEGMENTS = 64;
+
+float halfToFloat(uint h) {
+    uint e = (h >> 10u) & 31u;
+    uint m = h & 1023u;
+    float v;
+    if (e == 0u)       v = float(m) * exp2(-24.0);
+    else if (e == 31u) v = 65504.0;
+    else               v = (1.0 + float(m) / 1024.0) * exp2(float(int(e) - 15));
+    return ((h & 0x8000u) != 0u) ? -v : v;
+}
+
+vec3 rgb9e5ToRgb(uint v) {
+    float scale = exp2(float(int(v >> 27u) - 15 - 9));
+    return vec3(float(v & 511u), float((v >> 9u) & 511u), float((v >> 18u) & 511u)) * scale;
+}
 
 void main() {
-    // vUV.y in [-1, 1] is across-ribbon coordinate
-    float v = vUV.y;
-    float r = abs(v);
+    int id = uInstanceBase + gl_InstanceID / max(uPassFold, 1);
 
-    // Soft edge falloff across width
-    float inner = mix(0.60, 0.95, uSoft);
-    float outer = 1.00;
-    float edge  = smoothstep(inner, outer, r);
-    float strip = 1.0 - edge;
+    uvec2 t0 = texelFetch(uPackedSegments, id * 3 + 0).xy;
+    uvec2 t1 = texelFetch(uPackedSegments, id * 3 + 1).xy;
+    uvec2 t2 = texelFetch(uPackedSegments, id * 3 + 2).xy;
 
-    // Distance attenuation (keeps far segments dimmer)
-    float atten = 1.0 / (1.0 + 0.0008 * vDist * vDist);
+    int chunk = id / PACKED_CHUNK_SEGMENTS;
+    vec3 origin = texelFetch(uPackedChunks, chunk * 2 + 0).xyz;
+    vec3 extent = texelFetch(uPackedChunks, chunk * 2 + 1).xyz;
 
-    vec3 col = vCol * strip * atten * uEnergyPerHit * max(vIntensity, 1.0);
-    FragColor = vec4(col, 1.0);
+    vec3 q0 = vec3(float(t0.x & 0xffffu), float(t0.x >> 16u), float(t0.y & 0xffffu)) / 65535.0;
+    vec3 q1 = vec3(float(t0.y >> 16u), float(t1.x & 0xffffu), float(t1.x >> 16u)) / 65535.0;
+
+    emitRibbon(origin + q0 * extent, origin + q1 * extent,
+               rgb9e5ToRgb(t1.y), rgb9e5ToRgb(t2.x),
+               halfToFloat(t2.y & 0xffffu), halfToFloat(t2.y >> 16u), 1.0);
 }
 )GLSL";
 
-    // ========================================================================
-    // Readback (PBO + PNG / FFmpeg) from explicit FBO
-    // ========================================================================
-    struct PBOReadback {
-        bool   enabled = false;
-        GLuint pbo[2] = { 0, 0 };
-        int    curr = 0;
-        int    prev = 1;
-        bool   first = true;
-        size_t bytes = 0;
-    };
+    // Instanced shape prototypes: one draw per prototype, instance id =
+    // shape * uProtoCount + prototype segment.
+    //   prototype segment = 4 RGBA32F texels: (start, thickness),
+    //     (end, jitter), (start color, intensity), (end color, -)
+    //   shape = ShapeInstance, 5 RGBA32F texels: (origin, thickness),
+    //     (axis_x, jitter), (axis_y, intensity), (axis_z, -), (color, -)
+    static const char* SCENE_VS_SHAPES = R"GLSL(
+uniform samplerBuffer uPrototypes;
+uniform samplerBuffer uShapes;
+uniform int uProtoFirst;  // first prototype segment of this prototype
+uniform int uProtoCount;  // segments per shape
+uniform int uShapeFirst;  // first ShapeInstance of this draw
 
-    static void initPBO(PBOReadback& rb, bool enabled, int w, int h) {
-        rb.enabled = enabled;
-        rb.first = true;
-        rb.curr = 0;
-        rb.prev = 1;
-        rb.bytes = 0;
+void main() {
+    int shape = uShapeFirst + gl_InstanceID / uProtoCount;
+    int seg   = uProtoFirst + gl_InstanceID % uProtoCount;
 
-        if (!enabled) {
+    vec4 s0 = texelFetch(uShapes, shape * 5 + 0);
+    vec4 s1 = texelFetch(uShapes, shape * 5 + 1);
+    vec4 s2 = texelFetch(uShapes, shape * 5 + 2);
+    vec4 s3 = texelFetch(uShapes, shape * 5 + 3);
+    vec4 s4 = texelFetch(uShapes, shape * 5 + 4);
+
+    vec4 p0 = texelFetch(uPrototypes, seg * 4 + 0);
+    vec4 p1 = texelFetch(uPrototypes, seg * 4 + 1);
+    vec4 p2 = texelFetch(uPrototypes, seg * 4 + 2);
+    vec4 p3 = texelFetch(uPrototypes, seg * 4 + 3);
+
+    mat3 basis = mat3(s1.xyz, s2.xyz, s3.xyz);
+
+    emitRibbon(s0.xyz + basis * p0.xyz, s0.xyz + basis * p1.xyz,
+               p2.rgb * s4.rgb, p3.rgb * s4.rgb,
+               p0.w * s0.w, p1.w * s1.w, p2.w * s2.w);
+}
+)GLSL";
+
+    // Parametric primitives: endpoints generated from gl_InstanceID.
+    // uPrim is PrimitiveGPU (9 vec4), one draw per primitive:
+    //   0 center, type   1 axis_x, U   2 axis_y, V   3 axis_z, turns
+    //   4 major, minor, wave_amp_u, wave_amp_v
+    //   5 wave_freq_u, wave_freq_v, wave_phase, stripe_amp
+    //   6 color0, stripe_freq   7 color1, stripe_phase
+    //   8 thickness, jitter, intensity, -
+    static const char* SCENE_VS_PRIMITIVES = R"GLSL(
+uniform vec4 uPrim[9];
+
+const float TAU = 6.2831853;
+
+// Local-space position of parameter (u, v); see PrimitiveType.
+vec3 primitivePos(int type, vec2 uv) {
+    float major = uPrim[4].x, minor = uPrim[4].y;
+    float wu = uPrim[4].z * sin(TAU * uPrim[5].x * uv.x + uPrim[5].z);
+    float wv = uPrim[4].w * sin(TAU * uPrim[5].y * uv.y + uPrim[5].z);
+
+    if (type == 0) { // Torus
+        float R = major * (1.0 + wu);
+        float r = minor * (1.0 + wv);
+        float cu = cos(TAU * uv.x), su = sin(TAU * uv.x);
+        float cv = cos(TAU * uv.y), sv = sin(TAU * uv.y);
+        return vec3((R + r * cv) * cu, r * sv, (R + r * cv) * su);
+    }
+    if (type == 1) { // Ring (uv.y = ring index)
+        float R = (major + uv.y * minor) * (1.0 + wu);
+        return vec3(R * cos(TAU * uv.x), 0.0, R * sin(TAU * uv.x));
+    }
+    if (type == 2) { // Grid (waves are absolute heights)
+        return vec3((uv.x - 0.5) * major, wu + wv, (uv.y - 0.5) * minor);
+    }
+    // Helix (uv.y = strand phase)
+    float ang = TAU * (uv.x * uPrim[3].w + uv.y);
+    float R = major * (1.0 + wu);
+    return vec3(R * cos(ang), (uv.x - 0.5) * minor, R * sin(ang));
+}
+
+vec3 primitiveColor(float u) {
+    float stripe = 1.0 + uPrim[5].w * sin(TAU * uPrim[6].w * u + uPrim[7].w);
+    return mix(uPrim[6].rgb, uPrim[7].rgb, u) * max(stripe, 0.0);
+}
+
+void main() {
+    int type = int(uPrim[0].w);
+    int U = int(uPrim[1].w);
+    int V = int(uPrim[2].w);
+    int id = gl_InstanceID;
+
+    vec2 a, b; // parameter of start / end
+    if (type == 0) {
+        int cell = id / 2;
+        a = vec2(float(cell % U) / float(U), float(cell / U) / float(V));
+        b = a + ((id % 2) == 0 ? vec2(1.0 / float(U), 0.0) : vec2(0.0, 1.0 / float(V)));
+    }
+    else if (type == 1) {
+        a = vec2(float(id % U) / float(U), float(id / U));
+        b = a + vec2(1.0 / float(U), 0.0);
+    }
+    else if (type == 2) {
+        int rows = (V + 1) * U;
+        if (id < rows) {
+            a = vec2(float(id % U) / float(U), float(id / U) / float(V));
+            b = a + vec2(1.0 / float(U), 0.0);
+        }
+        else {
+            id -= rows;
+            a = vec2(float(id / V) / float(U), float(id % V) / float(V));
+            b = a + vec2(0.0, 1.0 / float(V));
+        }
+    }
+    else {
+        a = vec2(float(id % U) / float(U), float(id / U) / float(V));
+        b = a + vec2(1.0 / float(U), 0.0);
+    }
+
+    mat3 basis = mat3(uPrim[1].xyz, uPrim[2].xyz, uPrim[3].xyz);
+    vec3 p0 = uPrim[0].xyz + basis * primitivePos(type, a);
+    vec3 p1 = uPrim[0].xyz + basis * primitivePos(type, b);
+
+    emitRibbon(p0, p1, primitiveColor(a.x), primitiveColor(b.x),
+               uPrim[8].x, uPrim[8].y, uPrim[8].z);
+}
+)GLSL";
+
+    static const char* SCENE_FS = R"GLSL(
+#version 330 core
+in vec2  vUV;
+in vec3  vCol;
+in float vDist;
+in float vIntensity;
+in float vProfile;
+out vec4 FragColor;
+
+uniform float uSoft;          // 0..1 edge softness
+uniform float uEnergyPerHit;  // base contribution per segment
+uniform float uIntensityScale; // per-layer multiplier (1 for per-frame segments)
+uniform int   uAnalytic;       // JitterMode::Analytic
+uniform sampler2D uJitterProfile; // expected coverage: x = |v|, y = vProfile
+
+const float JITTER_PROFILE_SIZE = 128.0;
+
+void main() {
+    // vUV.y in [-1, 1] is across-ribbon coordinate
+    float v = vUV.y;
+    float r = abs(v);
+
+    float strip;
+    if (uAnalytic != 0) {
+        // Texel centers of the table (buildJitterProfile)
+        vec2 lut = (vec2(r, vProfile) * (JITTER_PROFILE_SIZE - 1.0) + 0.5) / JITTER_PROFILE_SIZE;
+        strip = texture(uJitterProfile, lut).r;
+    }
+    else {
+        // Soft edge falloff across width
+        float inner = mix(0.60, 0.95, uSoft);
+        float outer = 1.00;
+        float edge  = smoothstep(inner, outer, r);
+        strip = 1.0 - edge;
+    }
+
+    // Distance attenuation (keeps far segments dimmer)
+    float atten = 1.0 / (1.0 + 0.0008 * vDist * vDist);
+
+    vec3 col = vCol * strip * atten * uEnergyPerHit * max(vIntensity, 1.0) * uIntensityScale;
+    FragColor = vec4(col, 1.0);
+}
+)GLSL";
+
+    // Hairline splats (RenderSettings::splat_max_pixels): one invocation
+    // per segment and pass, item = pass * uCount + segment. The segment is
+    // jittered and seeded as in emitRibbon, clipped to the view volume and
+    // walked cell by cell (Amanatides-Woo); each pixel gets the energy of
+    // the ribbon area over it: screen length in the pixel * ribbon width *
+    // the mean of SCENE_FS's soft strip across it. Color and distance are
+    // interpolated perspective-correctly, as varyings would be. Adds are
+    // rounded with a hashed dither, so sums stay unbiased and repeatable.
+    static const char* SPLAT_CS = R"GLSL(
+#version 430 core
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 0) readonly buffer Segments { float uSeg[]; }; // LineParams
+layout(r32ui, binding = 0) uniform uimage2DArray uAccum;               // layer = channel
+
+uniform mat4  uProj;
+uniform mat4  uView;
+uniform ivec2 uSize;            // target pixels
+uniform float uThicknessScale;
+uniform float uSoft;
+uniform float uEnergyPerHit;
+uniform float uIntensityScale;  // per pass
+uniform float uFixedScale;      // accumulator units per HDR unit
+uniform int   uFrameIndex;
+uniform uint  uSeed;
+uniform int   uSegmentOffset;   // seed of uSeg's first segment
+uniform int   uFirst;           // first segment of this dispatch
+uniform int   uCount;           // segments of this dispatch
+uniform int   uPasses;
+
+uint hash_u(uint x){
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+float h1(uint x){ return float(hash_u(x)) / float(0xffffffffu); }
+
+void deposit(ivec2 p, vec3 e, uint h) {
+    if (any(lessThan(p, ivec2(0))) || any(greaterThanEqual(p, uSize))) return;
+    vec3 dither = vec3(h1(h), h1(h ^ 0x68e31da4u), h1(h ^ 0xb5297a4du));
+    uvec3 q = uvec3(e * uFixedScale + dither);
+    if (q.r != 0u) imageAtomicAdd(uAccum, ivec3(p, 0), q.r);
+    if (q.g != 0u) imageAtomicAdd(uAccum, ivec3(p, 1), q.g);
+    if (q.b != 0u) imageAtomicAdd(uAccum, ivec3(p, 2), q.b);
+}
+
+void main() {
+    int item = int(gl_GlobalInvocationID.x);
+    if (item >= uCount * uPasses) return;
+    int local = item % uCount;
+    int pass  = item / uCount;
+    int i     = (uFirst + local) * 15;
+
+    vec3  aStart      = vec3(uSeg[i + 0],  uSeg[i + 1],  uSeg[i + 2]);
+    vec3  aEnd        = vec3(uSeg[i + 3],  uSeg[i + 4],  uSeg[i + 5]);
+    vec3  aStartColor = vec3(uSeg[i + 6],  uSeg[i + 7],  uSeg[i + 8]);
+    vec3  aEndColor   = vec3(uSeg[i + 9],  uSeg[i + 10], uSeg[i + 11]);
+    float aThickness  = uSeg[i + 12];
+    float aJitter     = uSeg[i + 13];
+    float aIntensity  = uSeg[i + 14];
+
+    uint seed = uint(uSegmentOffset + uFirst + local);
+    seed ^= uint(pass)        * 2654435761u;
+    seed ^= uint(uFrameIndex) * 2246822519u;
+    seed ^= uSeed * 3266489917u;
+
+    vec3 dir     = aEnd - aStart;
+    float segLen = max(length(dir), 1e-5);
+    vec3 lineDir = dir / segLen;
+
+    vec3 camRight   = vec3(uView[0][0], uView[1][0], uView[2][0]);
+    vec3 camUp      = vec3(uView[0][1], uView[1][1], uView[2][1]);
+    vec3 camForward = normalize(cross(camRight, camUp));
+
+    vec3 side = normalize(cross(camForward, lineDir));
+    if (length(side) < 1e-4) {
+        side = camRight;
+    }
+    vec3 upLocal = normalize(cross(lineDir, side));
+
+    float ang   = h1(seed) * 6.2831853;
+    float rad01 = h1(seed ^ 0x9e3779b9u);
+    vec3 jitterOffset = (cos(ang)*side + sin(ang)*upLocal) * (aJitter * rad01);
+
+    vec3 p0 = aStart + jitterOffset;
+    vec3 p1 = aEnd + jitterOffset;
+    vec4 h0 = uProj * uView * vec4(p0, 1.0);
+    vec4 h1c = uProj * uView * vec4(p1, 1.0);
+
+    // Clip against the six planes (Liang-Barsky on the segment parameter).
+    float t0 = 0.0, t1 = 1.0;
+    for (int k = 0; k < 6; ++k) {
+        vec4 plane = vec4(0.0, 0.0, 0.0, 1.0);
+        plane[k / 2] = (k % 2 == 0) ? 1.0 : -1.0;
+        float fa = dot(h0, plane), fb = dot(h1c, plane);
+        if (fa < 0.0 && fb < 0.0) return;
+        if (fa < 0.0)      t0 = max(t0, fa / (fa - fb));
+        else if (fb < 0.0) t1 = min(t1, fa / (fa - fb));
+    }
+    if (t0 >= t1) return;
+
+    vec4 ca = mix(h0, h1c, t0);
+    vec4 cb = mix(h0, h1c, t1);
+    vec2 a  = (ca.xy / ca.w * 0.5 + 0.5) * vec2(uSize);
+    vec2 b  = (cb.xy / cb.w * 0.5 + 0.5) * vec2(uSize);
+    vec2 ab = b - a;
+    float len = length(ab);
+    if (len < 1e-6) return; // no area, like a ribbon seen end-on
+
+    // Energy per pixel of screen length, times clip w (width ~ 1 / w).
+    float inner = mix(0.60, 0.95, uSoft);
+    float strip = 0.5 * (1.0 + inner); // mean of 1 - smoothstep(inner, 1, |v|)
+    float widthW = 2.0 * aThickness * uThicknessScale * uProj[1][1] * 0.5 * float(uSize.y);
+    float k = strip * widthW * uEnergyPerHit * max(aIntensity, 1.0) * uIntensityScale;
+    float d0 = length(p0), d1 = length(p1);
+    float iw0 = 1.0 / ca.w, iw1 = 1.0 / cb.w;
+
+    ivec2 cell  = ivec2(floor(a));
+    ivec2 last  = ivec2(floor(b));
+    ivec2 stepC = ivec2(sign(ab));
+    vec2 tDelta = vec2(ab.x != 0.0 ? 1.0 / abs(ab.x) : 1e30,
+                       ab.y != 0.0 ? 1.0 / abs(ab.y) : 1e30);
+    vec2 tMax = vec2(
+        ab.x > 0.0 ? (float(cell.x + 1) - a.x) * tDelta.x :
+        ab.x < 0.0 ? (a.x - float(cell.x)) * tDelta.x : 1e30,
+        ab.y > 0.0 ? (float(cell.y + 1) - a.y) * tDelta.y :
+        ab.y < 0.0 ? (a.y - float(cell.y)) * tDelta.y : 1e30);
+    int steps = abs(last.x - cell.x) + abs(last.y - cell.y);
+
+    float s = 0.0;
+    for (int n = 0; n <= steps; ++n) {
+        float sNext = (n == steps) ? 1.0 : min(min(tMax.x, tMax.y), 1.0);
+        float sMid  = 0.5 * (s + sNext);
+        float iw    = mix(iw0, iw1, sMid);
+        float along = mix(t0, t1, sMid * iw1 / iw);
+
+        vec3  col   = mix(aStartColor, aEndColor, along);
+        float dist  = mix(d0, d1, along);
+        float atten = 1.0 / (1.0 + 0.0008 * dist * dist);
+        deposit(cell, col * (k * atten * iw * (sNext - s) * len),
+                hash_u(seed + uint(n) * 0x9e3779b9u));
+
+        if (n == steps) break;
+        if (tMax.x < tMax.y) { cell.x += stepC.x; tMax.x += tDelta.x; }
+        else                 { cell.y += stepC.y; tMax.y += tDelta.y; }
+        s = sNext;
+    }
+}
+)GLSL";
+
+    // Adds the splat accumulators to the HDR target (additive blend).
+    static const char* SPLAT_RESOLVE_FS = R"GLSL(
+#version 330 core
+out vec4 FragColor;
+uniform usampler2DArray uSplat;
+uniform float uScale; // HDR units per accumulator unit
+
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    uvec3 q = uvec3(texelFetch(uSplat, ivec3(p, 0), 0).r,
+                    texelFetch(uSplat, ivec3(p, 1), 0).r,
+                    texelFetch(uSplat, ivec3(p, 2), 0).r);
+    FragColor = vec4(vec3(q) * uScale, 0.0);
+}
+)GLSL";
+
+    // ========================================================================
+    // Readback (PBO + PNG / FFmpeg) from explicit FBO
+    // ========================================================================
+    struct PBOReadback {
+        bool   enabled = false;
+        GLuint pbo[2] = { 0, 0 };
+        int    curr = 0;
+        int    prev = 1;
+        bool   first = true;
+        size_t bytes = 0;
+        int    frame[2] = { 0, 0 }; // frame index read into each PBO
+    };
+
+    static void initPBO(PBOReadback& rb, bool enabled, int w, int h) {
+        rb.enabled = enabled;
+        rb.first = true;
+        rb.curr = 0;
+        rb.prev = 1;
+        rb.bytes = 0;
+
+        if (!enabled) {
             rb.pbo[0] = rb.pbo[1] = 0;
             return;
         }
@@ -526,6 +1502,7 @@ void main() {
         const std::string& outDir,
         OutputMode outputMode,
         FFmpegPipe* ffmpeg,
+        OutputProgress* output,
         GLuint srcFBO)
     {
         if (outputMode == OutputMode::FramesPNG) {
@@ -540,18 +1517,19 @@ void main() {
         auto writeFrame = [&](int effectiveIndex,
             const unsigned char* flipped)
             {
+                beginFrameOutput(output, effectiveIndex);
+                bool written;
                 if (outputMode == OutputMode::FFmpegVideo &&
                     ffmpeg && ffmpeg->enabled)
                 {
-                    ffmpegWriteFrame(*ffmpeg, flipped, w, h);
+                    written = ffmpegWriteFrame(*ffmpeg, flipped, w, h);
                 }
                 else {
-                    std::ostringstream oss;
-                    oss << outDir << "/frame_"
-                        << std::setw(4) << std::setfill('0') << effectiveIndex
-                        << ".png";
-                    stbi_write_png(oss.str().c_str(), w, h, 4, flipped, rowBytes);
+                    const std::string path = framePngPath(outDir, effectiveIndex);
+                    written = stbi_write_png(path.c_str(), w, h, 4, flipped, rowBytes) != 0;
                 }
+                if (written) endFrameOutput(output, effectiveIndex);
+                else failFrameOutput(output, effectiveIndex);
             };
 
         // No PBO: synchronous path
@@ -576,6 +1554,7 @@ void main() {
         glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo[rb.curr]);
         glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
         glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        rb.frame[rb.curr] = frameIndex;
 
         if (!rb.first) {
             glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo[rb.prev]);
@@ -592,8 +1571,8 @@ void main() {
                 }
                 glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
 
-                // Frame index - 1 because of the PBO pipeline delay
-                writeFrame(frameIndex - 1, flipped.data());
+                // The previous frame, because of the PBO pipeline delay
+                writeFrame(rb.frame[rb.prev], flipped.data());
             }
             glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
         }
@@ -606,11 +1585,11 @@ void main() {
     }
 
     static void flushLastPBOFrame(PBOReadback& rb,
-        int lastFrameIndex,
         int w, int h,
         const std::string& outDir,
         OutputMode outputMode,
-        FFmpegPipe* ffmpeg)
+        FFmpegPipe* ffmpeg,
+        OutputProgress* output)
     {
         if (!rb.enabled || rb.first) return;
 
@@ -619,18 +1598,20 @@ void main() {
         auto writeFrame = [&](int idx,
             const unsigned char* flipped)
             {
+                beginFrameOutput(output, idx);
+                bool written;
                 if (outputMode == OutputMode::FFmpegVideo &&
                     ffmpeg && ffmpeg->enabled)
                 {
-                    ffmpegWriteFrame(*ffmpeg, flipped, w, h);
+                    written = ffmpegWriteFrame(*ffmpeg, flipped, w, h);
                 }
                 else {
                     fs::create_directories(outDir);
-                    std::ostringstream oss;
-                    oss << outDir << "/frame_"
-                        << std::setw(4) << std::setfill('0') << idx << ".png";
-                    stbi_write_png(oss.str().c_str(), w, h, 4, flipped, rowBytes);
+                    const std::string path = framePngPath(outDir, idx);
+                    written = stbi_write_png(path.c_str(), w, h, 4, flipped, rowBytes) != 0;
                 }
+                if (written) endFrameOutput(output, idx);
+                else failFrameOutput(output, idx);
             };
 
         glBindBuffer(GL_PIXEL_PACK_BUFFER, rb.pbo[rb.prev]);
@@ -647,17 +1628,473 @@ void main() {
             }
             glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
 
-            writeFrame(lastFrameIndex, flipped.data());
+            writeFrame(rb.frame[rb.prev], flipped.data());
         }
         glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
     }
 
+    // ========================================================================
+    // Per-frame segment staging
+    // ========================================================================
+    // GPU layout: LineParams is uploaded as-is (15 tightly packed floats),
+    // which is what lets LineEmitContext write straight into staging.
+    using LineInstanceGPU = LineParams;
+
+    static_assert(sizeof(LineInstanceGPU) == 15 * sizeof(float),
+        "LineParams must stay 15 tightly packed floats (instance layout)");
+    static_assert(offsetof(LineParams, end_x) == 3 * sizeof(float) &&
+        offsetof(LineParams, start_r) == 6 * sizeof(float) &&
+        offsetof(LineParams, end_r) == 9 * sizeof(float) &&
+        offsetof(LineParams, thickness) == 12 * sizeof(float) &&
+        offsetof(LineParams, jitter) == 13 * sizeof(float) &&
+        offsetof(LineParams, intensity) == 14 * sizeof(float),
+        "LineParams field order must match the instance attributes");
+
+    // Engine-owned per-frame staging buffer. Segments are written into it
+    // (through LineSink for the push API) and uploaded straight out of it.
+    // Capacity is kept between frames, so growth only happens on the first
+    // big frame.
+    struct SegmentStaging {
+        std::vector<LineInstanceGPU> storage;
+        LineSink sink;
+        ShapeSink shapes; // add_shape() placements, expanded on the GPU
+        std::vector<ParametricPrimitive> primitives; // add_primitive()
+        std::vector<LodMark> lodMarks;               // set_lod_pixels()
+        std::vector<SampleMark> sampleMarks;         // set_samples()
+        std::vector<size_t> batchEnds;               // flush_now() positions
+
+        // Set while RenderSettings::stream_flush_batches renders a frame:
+        // flush_now() hands the staging buffer over instead of marking it.
+        std::function<void(SegmentStaging&)> onFlush;
+
+        const LineInstanceGPU* data() const { return storage.data(); }
+        size_t size() const { return sink.size; }
+    };
+
+    static void stagingGrow(LineSink& sink, size_t minCapacity) {
+        SegmentStaging& st = *static_cast<SegmentStaging*>(sink.owner);
+        size_t newCap = st.storage.size() * 2;
+        if (newCap < minCapacity) newCap = minCapacity;
+        if (newCap < 4096)        newCap = 4096;
+        st.storage.resize(newCap);
+        sink.data = st.storage.data();
+        sink.capacity = st.storage.size();
+    }
+
+    static void initStaging(SegmentStaging& st, size_t initialCapacity) {
+        st.sink.owner = &st;
+        st.sink.grow = &stagingGrow;
+        st.sink.size = 0;
+        stagingGrow(st.sink, initialCapacity);
+    }
+
+    static void resetStaging(SegmentStaging& st) {
+        st.sink.size = 0;
+        st.shapes.clear();
+        st.primitives.clear();
+        st.lodMarks.clear();
+        st.sampleMarks.clear();
+        st.batchEnds.clear();
+    }
+
+    // Keeps frame positions (LOD / sample marks, flush boundaries) valid while a
+    // pass compacts the staging buffer in place: a position p that pointed
+    // at input segment i ends up pointing at the output slot of i.
+    class PositionRemap {
+    public:
+        explicit PositionRemap(SegmentStaging& st) {
+            for (LodMark& m : st.lodMarks) positions_.push_back(&m.first);
+            for (SampleMark& m : st.sampleMarks) positions_.push_back(&m.first);
+            for (size_t& e : st.batchEnds) positions_.push_back(&e);
+            std::stable_sort(positions_.begin(), positions_.end(),
+                [](const size_t* a, const size_t* b) { return *a < *b; });
+        }
+
+        // Call before input segment i is written to output slot 'out'.
+        void at(size_t i, size_t out) {
+            while (next_ < positions_.size() && *positions_[next_] <= i) {
+                *positions_[next_++] = out;
+            }
+        }
+
+        // True when a position falls inside (.., i]: do not merge across it.
+        bool boundaryUpTo(size_t i) const {
+            return next_ < positions_.size() && *positions_[next_] <= i;
+        }
+
+        void finish(size_t out) {
+            for (; next_ < positions_.size(); ++next_) *positions_[next_] = out;
+        }
+
+    private:
+        std::vector<size_t*> positions_;
+        size_t next_ = 0;
+    };
+
+    // ========================================================================
+    // Worker pool (LineEmitContext::parallel_for)
+    // ========================================================================
+    // Fixed set of threads; run() hands out indices through an atomic
+    // counter and the calling thread helps until all indices are done.
+    class WorkerPool {
+    public:
+        // Threads a pool for 'threads' (RenderSettings::worker_threads) runs on.
+        static int resolveThreads(int threads) {
+            if (threads <= 0) {
+                threads = (int)std::thread::hardware_concurrency();
+            }
+            return std::max(threads, 1);
+        }
+
+        explicit WorkerPool(int threads) {
+            threads = resolveThreads(threads);
+            // The caller participates, so spawn one less.
+            for (int i = 1; i < threads; ++i) {
+                threads_.emplace_back([this]() { workerLoop(); });
+            }
+        }
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                stop_ = true;
+            }
+            cvWork_.notify_all();
+            for (std::thread& t : threads_) t.join();
+        }
+
+        WorkerPool(const WorkerPool&) = delete;
+        WorkerPool& operator=(const WorkerPool&) = delete;
+
+        int threadCount() const { return (int)threads_.size() + 1; }
+
+        // Runs job(i) for every i in [0, count) and returns when all are done.
+        void run(int count, const std::function<void(int)>& job) {
+            if (count <= 0) return;
+            if (threads_.empty() || count == 1) {
+                for (int i = 0; i < count; ++i) job(i);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                job_ = &job;
+                count_ = count;
+                next_.store(0);
+                busy_ = (int)threads_.size();
+                ++generation_;
+            }
+            cvWork_.notify_all();
+
+            drain();
+
+            std::unique_lock<std::mutex> lk(mtx_);
+            cvDone_.wait(lk, [this]() { return busy_ == 0; });
+            job_ = nullptr;
+        }
+
+    private:
+        void drain() {
+            int i;
+            while ((i = next_.fetch_add(1)) < count_) {
+                (*job_)(i);
+            }
+        }
+
+        void workerLoop() {
+            uint64_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lk(mtx_);
+                    cvWork_.wait(lk, [&]() { return stop_ || generation_ != seen; });
+                    if (stop_) return;
+                    seen = generation_;
+                }
+
+                drain();
+
+                std::lock_guard<std::mutex> lk(mtx_);
+                if (--busy_ == 0) cvDone_.notify_one();
+            }
+        }
+
+        std::vector<std::thread> threads_;
+        std::mutex               mtx_;
+        std::condition_variable  cvWork_;
+        std::condition_variable  cvDone_;
+
+        const std::function<void(int)>* job_ = nullptr;
+        int              count_ = 0;
+        std::atomic<int> next_{ 0 };
+        int              busy_ = 0;
+        uint64_t         generation_ = 0;
+        bool             stop_ = false;
+    };
+
+    struct EmitPool {
+        explicit EmitPool(int threads) : threads(WorkerPool::resolveThreads(threads)) {}
+
+        // Started by the first parallel_for, so sequences that never call
+        // it have no idle threads. Frames are produced one at a time, so
+        // this is never reached concurrently.
+        WorkerPool& workers() {
+            if (!started) started = std::make_unique<WorkerPool>(threads);
+            return *started;
+        }
+
+        int threads;
+        std::unique_ptr<WorkerPool> started;
+
+        // One staging buffer per task slot, kept across frames so their
+        // capacity settles after the first frame.
+        std::vector<std::unique_ptr<SegmentStaging>> taskBuffers;
+        std::vector<size_t> taskOffsets;
+    };
+
+    void LineEmitContext::parallel_for(int taskCount, const EmitTask& task) {
+        if (taskCount <= 0 || !task) return;
+
+        if (!pool || !sink || pool->threads <= 1) {
+            for (int i = 0; i < taskCount; ++i) task(i, *this);
+            return;
+        }
+
+        EmitPool& p = *pool;
+        while ((int)p.taskBuffers.size() < taskCount) {
+            p.taskBuffers.push_back(std::make_unique<SegmentStaging>());
+            initStaging(*p.taskBuffers.back(), 4096);
+        }
+
+        // 1) Generate: every task into its own buffer.
+        p.workers().run(taskCount, [&](int i)
+            {
+                SegmentStaging& st = *p.taskBuffers[i];
+                resetStaging(st);
+
+                LineEmitContext sub;
+                sub.user_ptr = user_ptr;
+                sub.seed = seed;
+                sub.sink = &st.sink;
+                sub.shapes = shapes ? &st.shapes : nullptr;
+                sub.primitives = primitives ? &st.primitives : nullptr;
+                sub.lod = lod ? &st.lodMarks : nullptr;
+                sub.sampleMarks = sampleMarks ? &st.sampleMarks : nullptr;
+                task(i, sub);
+            });
+
+        // LOD marks, shifted to the merged position. A task's last mark must
+        // not leak into the next task, so restore this context's setting.
+        if (lod) {
+            const float parentPixels = lod->empty() ? -1.0f : lod->back().pixels;
+            size_t offset = sink->size;
+            for (int i = 0; i < taskCount; ++i) {
+                const SegmentStaging& st = *p.taskBuffers[i];
+                for (const LodMark& m : st.lodMarks) {
+                    lod->push_back({ offset + m.first, m.pixels });
+                }
+                offset += st.size();
+                if (!st.lodMarks.empty()) lod->push_back({ offset, parentPixels });
+            }
+        }
+
+        // Sample marks, the same way.
+        if (sampleMarks) {
+            const int parentSamples = sampleMarks->empty() ? 0 : sampleMarks->back().samples;
+            size_t offset = sink->size;
+            for (int i = 0; i < taskCount; ++i) {
+                const SegmentStaging& st = *p.taskBuffers[i];
+                for (const SampleMark& m : st.sampleMarks) {
+                    sampleMarks->push_back({ offset + m.first, m.samples });
+                }
+                offset += st.size();
+                if (!st.sampleMarks.empty()) sampleMarks->push_back({ offset, parentSamples });
+            }
+        }
+
+        // 2) Concatenate in task order (deterministic), copies in parallel.
+        p.taskOffsets.resize((size_t)taskCount);
+        size_t total = sink->size;
+        for (int i = 0; i < taskCount; ++i) {
+            p.taskOffsets[i] = total;
+            total += p.taskBuffers[i]->size();
+        }
+        sink->reserve(total);
+
+        p.workers().run(taskCount, [&](int i)
+            {
+                const SegmentStaging& st = *p.taskBuffers[i];
+                if (st.size() == 0) return;
+                std::memcpy(sink->data + p.taskOffsets[i], st.data(),
+                    st.size() * sizeof(LineInstanceGPU));
+            });
+
+        sink->size = total;
+
+        // Shapes and primitives are few; append them serially, also in
+        // task order.
+        if (primitives) {
+            for (int i = 0; i < taskCount; ++i) {
+                const auto& src = p.taskBuffers[i]->primitives;
+                primitives->insert(primitives->end(), src.begin(), src.end());
+            }
+        }
+        if (shapes) {
+            for (int i = 0; i < taskCount; ++i) {
+                const ShapeSink& src = p.taskBuffers[i]->shapes;
+                for (size_t proto = 0; proto < src.instances.size(); ++proto) {
+                    for (const ShapeInstance& inst : src.instances[proto]) {
+                        shapes->add((int)proto, inst);
+                    }
+                }
+            }
+        }
+    }
+
+    // ========================================================================
+    // Packed instance format (InstanceFormat::PackedQuantized)
+    // ========================================================================
+    // Must match SCENE_VS_PACKED.
+    static const int PACKED_CHUNK_SEGMENTS = 64;
+
+    struct PackedSegmentGPU {
+        uint32_t w[6]; // 3 RG32UI texels, layout documented at SCENE_VS_PACKED
+    };
+    static_assert(sizeof(PackedSegmentGPU) == 24, "packed segment must be 24 bytes");
+
+    struct PackedChunkGPU {
+        float origin[4]; // xyz, w unused
+        float extent[4]; // xyz, w unused
+    };
+
+    namespace Pack_ {
+
+        static uint32_t floatBits(float f) {
+            uint32_t u;
+            std::memcpy(&u, &f, sizeof(u));
+            return u;
+        }
+
+        static float pow2(int e) { // exact 2^e for e in [-126, 127]
+            uint32_t u = uint32_t(e + 127) << 23;
+            float f;
+            std::memcpy(&f, &u, sizeof(f));
+            return f;
+        }
+
+        // IEEE half, round-to-nearest; tiny values flush to zero and large
+        // ones clamp to 65504 (thickness / jitter never get near either).
+        static uint32_t half(float f) {
+            const uint32_t u = floatBits(f);
+            const uint32_t sign = (u >> 16) & 0x8000u;
+            const int      e = int((u >> 23) & 0xffu) - 127 + 15;
+            uint32_t       m = u & 0x7fffffu;
+
+            if (e <= 0)  return sign;            // below half normal range
+            if (e >= 31) return sign | 0x7bffu;  // clamp to max finite
+
+            uint32_t h = sign | (uint32_t(e) << 10) | (m >> 13);
+            if (m & 0x1000u) ++h; // round (carry into exponent is correct)
+            if ((h & 0x7c00u) == 0x7c00u) h = sign | 0x7bffu;
+            return h;
+        }
+
+        // Shared-exponent RGB9E5 (EXT_texture_shared_exponent encoding).
+        static uint32_t rgb9e5(float r, float g, float b) {
+            const float maxVal = 65408.0f;
+            r = std::min(std::max(r, 0.0f), maxVal);
+            g = std::min(std::max(g, 0.0f), maxVal);
+            b = std::min(std::max(b, 0.0f), maxVal);
+
+            const float maxc = std::max(r, std::max(g, b));
+            if (maxc < 1.0e-7f) return 0u;
+
+            int expShared = std::max(-16, int((floatBits(maxc) >> 23) & 0xffu) - 127)
+                + 1 + 15;
+            float scale = pow2(-(expShared - 15 - 9));
+            if (uint32_t(maxc * scale + 0.5f) == 512u) {
+                ++expShared;
+                scale *= 0.5f;
+            }
+
+            const uint32_t rm = std::min(511u, uint32_t(r * scale + 0.5f));
+            const uint32_t gm = std::min(511u, uint32_t(g * scale + 0.5f));
+            const uint32_t bm = std::min(511u, uint32_t(b * scale + 0.5f));
+            return rm | (gm << 9) | (bm << 18) | (uint32_t(expShared) << 27);
+        }
+
+        static uint32_t unorm16(float v, float origin, float invExtent) {
+            float q = (v - origin) * invExtent * 65535.0f + 0.5f;
+            q = std::min(std::max(q, 0.0f), 65535.0f);
+            return uint32_t(q);
+        }
+
+    } // namespace Pack_
+
+    // Quantize src[0 .. n) into packed records plus one origin/extent entry
+    // per PACKED_CHUNK_SEGMENTS segments.
+    static void packSegments(const LineInstanceGPU* src, size_t n,
+        std::vector<PackedSegmentGPU>& out,
+        std::vector<PackedChunkGPU>& chunks)
+    {
+        out.resize(n);
+        chunks.resize((n + PACKED_CHUNK_SEGMENTS - 1) / PACKED_CHUNK_SEGMENTS);
+
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            const size_t i0 = c * PACKED_CHUNK_SEGMENTS;
+            const size_t i1 = std::min(n, i0 + PACKED_CHUNK_SEGMENTS);
+
+            float lo[3] = { src[i0].start_x, src[i0].start_y, src[i0].start_z };
+            float hi[3] = { lo[0], lo[1], lo[2] };
+            for (size_t i = i0; i < i1; ++i) {
+                const LineInstanceGPU& l = src[i];
+                const float p[6] = { l.start_x, l.start_y, l.start_z,
+                                     l.end_x,   l.end_y,   l.end_z };
+                for (int k = 0; k < 3; ++k) {
+                    lo[k] = std::min(lo[k], std::min(p[k], p[k + 3]));
+                    hi[k] = std::max(hi[k], std::max(p[k], p[k + 3]));
+                }
+            }
+
+            PackedChunkGPU& ch = chunks[c];
+            float inv[3];
+            for (int k = 0; k < 3; ++k) {
+                ch.origin[k] = lo[k];
+                ch.extent[k] = hi[k] - lo[k];
+                inv[k] = (ch.extent[k] > 0.0f) ? 1.0f / ch.extent[k] : 0.0f;
+            }
+            ch.origin[3] = ch.extent[3] = 0.0f;
+
+            for (size_t i = i0; i < i1; ++i) {
+                const LineInstanceGPU& l = src[i];
+                PackedSegmentGPU& o = out[i];
+
+                const uint32_t sx = Pack_::unorm16(l.start_x, lo[0], inv[0]);
+                const uint32_t sy = Pack_::unorm16(l.start_y, lo[1], inv[1]);
+                const uint32_t sz = Pack_::unorm16(l.start_z, lo[2], inv[2]);
+                const uint32_t ex = Pack_::unorm16(l.end_x, lo[0], inv[0]);
+                const uint32_t ey = Pack_::unorm16(l.end_y, lo[1], inv[1]);
+                const uint32_t ez = Pack_::unorm16(l.end_z, lo[2], inv[2]);
+
+                // SCENE_FS scales color by max(intensity, 1): fold it in here.
+                const float k = std::max(l.intensity, 1.0f);
+
+                o.w[0] = sx | (sy << 16);
+                o.w[1] = sz | (ex << 16);
+                o.w[2] = ey | (ez << 16);
+                o.w[3] = Pack_::rgb9e5(l.start_r * k, l.start_g * k, l.start_b * k);
+                o.w[4] = Pack_::rgb9e5(l.end_r * k, l.end_g * k, l.end_b * k);
+                o.w[5] = Pack_::half(l.thickness) | (Pack_::half(l.jitter) << 16);
+            }
+        }
+    }
+
     // ========================================================================
     // Renderer state & uniforms
     // ========================================================================
     struct SceneUniforms {
         GLint uProj = -1;
         GLint uView = -1;
+        GLint uModel = -1;
         GLint uThicknessScale = -1;
         GLint uPassIndex = -1;
         GLint uFrameIndex = -1;
@@ -665,6 +2102,23 @@ void main() {
         GLint uSoft = -1;
         GLint uEnergy = -1;
         GLint uSegmentOffset = -1;
+        GLint uIntensityScale = -1;
+        GLint uSeed = -1;
+        GLint uPackedSegments = -1;
+        GLint uPackedChunks = -1;
+        GLint uInstanceBase = -1;
+        GLint uPassFold = -1;
+        GLint uAnalytic = -1;
+        GLint uJitterProfile = -1;
+    };
+
+    // Extra uniforms of the shape program (SCENE_VS_SHAPES).
+    struct ShapeUniforms {
+        GLint uProtoFirst = -1;
+        GLint uProtoCount = -1;
+        GLint uShapeFirst = -1;
+        GLint uPrototypes = -1;
+        GLint uShapes = -1;
     };
 
     struct BrightUniforms {
@@ -688,9 +2142,15 @@ void main() {
 
     struct Programs {
         GLuint scene = 0;
+        GLuint shapes = 0;  // only with RenderSettings::shape_prototypes
+        GLuint primitives = 0;
         GLuint bright = 0;
         GLuint blur = 0;
         GLuint composite = 0;
+        GLuint add = 0;        // RenderSettings::adaptive_error only
+        GLuint tileError = 0;
+        GLuint splat = 0;      // RenderSettings::splat_max_pixels only
+        GLuint splatResolve = 0;
     };
 
     struct Framebuffers {
@@ -700,25 +2160,208 @@ void main() {
         Utils_::ColorFBO ldr;   // final composited LDR image
     };
 
+    // GPU instance storage in one InstanceFormat: per-instance attributes
+    // on 'vao' (Float32) or buffer textures the vertex shader pulls from
+    // (PackedQuantized). 'vao' always carries the ribbon quad.
+    struct InstanceBuffers {
+        GLuint vao = 0;
+        GLuint vboInstance = 0; // Float32
+        GLuint bufPacked = 0;   // PackedQuantized
+        GLuint texPacked = 0;
+        GLuint bufChunks = 0;
+        GLuint texChunks = 0;
+        size_t capacity = 0;    // segments
+        size_t first = 0;       // instance the draws start at (bindInstances)
+        int    divisor = 1;     // Float32 attribute divisor (= pass fold)
+
+        // Persistent write-only mappings (stream buffer with
+        // ARB_buffer_storage), null otherwise. Writers must wait for the
+        // fences of the range first, see waitStreamRange().
+        unsigned char* mapInstance = nullptr;
+        unsigned char* mapPacked = nullptr;
+        unsigned char* mapChunks = nullptr;
+        bool persistent = false;
+    };
+
+    // Retained layer (RenderSettings::static_layers), uploaded once.
+    struct RetainedLayer {
+        std::string     name;
+        InstanceBuffers gpu;
+        size_t          count = 0;
+        int             seedBase = 0; // uSegmentOffset, keeps jitter stable
+    };
+
+    // ParametricPrimitive as the uPrim[9] uniform array (SCENE_VS_PRIMITIVES).
+    struct PrimitiveGPU {
+        float v[9][4];
+        GLsizei segments = 0;
+    };
+
+    // Shape prototypes (uploaded once) + per-frame ShapeInstance records.
+    struct ShapeBuffers {
+        GLuint vao = 0;             // quad only
+        GLuint bufPrototypes = 0;
+        GLuint texPrototypes = 0;
+        GLuint bufInstances = 0;
+        GLuint texInstances = 0;
+        size_t instanceCapacity = 0; // ShapeInstance records
+        size_t maxInstances = 0;     // GL_MAX_TEXTURE_BUFFER_SIZE / 5
+
+        std::vector<int> protoFirst; // by prototype id
+        std::vector<int> protoCount; // 0 => nothing to draw
+
+        // Per-frame draw list, built at upload.
+        struct Draw { int proto; int first; int count; };
+        std::vector<Draw> draws;
+        bool warnedClamp = false;
+    };
+
     struct Geometry {
         GLuint vaoSegment = 0;
         GLuint vboSegment = 0;  // base quad for segment ribbons
         GLuint vaoFSQ = 0;
         GLuint vboFSQ = 0;
 
-        GLuint vboInstance = 0; // per-segment instance data buffer
+        InstanceBuffers stream; // per-frame segments (vao == vaoSegment)
         int    maxSegments = 0; // capacity (segments per frame)
+
+        InstanceFormat format = InstanceFormat::Float32;
+        GLint  maxBufferTexels = 0;                 // GL_MAX_TEXTURE_BUFFER_SIZE
+        std::vector<PackedSegmentGPU> packed;       // host-side pack scratch
+        std::vector<PackedChunkGPU>   packedChunks;
+
+        std::vector<RetainedLayer> layers;
+        ShapeBuffers shapes;
+        std::vector<PrimitiveGPU> primitives; // this frame's, as uniforms
+        GLuint vaoPrimitives = 0;             // quad only
     };
 
+    // Render target size; the output frame is larger in tiled mode.
     struct Viewport {
         int width = 1280;
         int height = 720;
         int halfWidth = 640;
         int halfHeight = 360;
+        int frameWidth = 1280;
+        int frameHeight = 720;
     };
 
-    struct Renderer {
-        Viewport      viewport;
+    // Slot table of the stream buffer for RenderSettings::incremental_upload.
+    struct UploadBatch {
+        size_t   slot = 0;      // first instance in the stream buffer
+        size_t   capacity = 0;  // slot size (count rounded up, padded)
+        size_t   count = 0;
+        uint64_t hash = 0;
+    };
+
+    struct IncrementalUpload {
+        std::vector<UploadBatch> batches; // what the GPU buffer holds now
+        bool valid = false;               // false => buffer content unknown
+        std::vector<LineInstanceGPU> scratch;
+    };
+
+    // Stream buffer range read by queued draws (StreamRing).
+    struct StreamFence {
+        size_t first = 0;
+        size_t end = 0;
+        GLsync sync = nullptr;
+    };
+
+    // Streaming writes go round the stream buffer in chunk-aligned pieces,
+    // so one piece is written while the GPU still draws the previous ones.
+    struct StreamRing {
+        size_t head = 0;
+        std::deque<StreamFence> fences; // oldest first
+    };
+
+    // RenderSettings::submit_slice_ms: GPU time per drawn stream instance,
+    // from a pair of GL_TIMESTAMP queries around a frame's accumulation,
+    // read back without waiting a frame or more later. Layers, shapes and
+    // primitives are in the measured time too, which errs on the side of
+    // flushing more often.
+    struct SubmitPacing {
+        GLuint queries[2] = { 0, 0 };
+        bool   measuring = false;      // queries[0] issued this frame
+        bool   pending = false;        // result not read back yet
+        size_t instances = 0;          // counted while measuring
+        size_t pendingInstances = 0;
+        double nsPerInstance = 0.0;    // 0 => no measurement yet
+        double sliceNs = 0.0;          // estimate submitted since last flush
+        int    passesSinceYield = 0;
+    };
+
+    // RenderSettings::adaptive_error: odd passes go to 'oddTex' (second
+    // color attachment of fbos.hdr), even ones to the usual target; the
+    // tile noise of the two is rendered into 'tiles' and read back.
+    struct AdaptiveAccum {
+        bool   enabled = false;
+        GLuint oddTex = 0;
+        GLuint evenFbo = 0;           // fbos.hdr's color only, for the resolve
+        Utils_::ColorFBO tiles;       // R32F, one texel per ADAPTIVE_TILE px
+        int    tilesX = 0;
+        int    tilesY = 0;
+        GLint  uSize = -1;            // programs.tileError
+        GLint  uScale = -1;
+        GLint  uExposure = -1;
+        std::vector<float> errors;    // readback scratch
+    };
+
+    // RenderSettings::tile_size: tiles of size x size output pixels, each
+    // drawn into the (size + 2 * margin)^2 targets of r.viewport.
+    struct TileGrid {
+        bool enabled = false;
+        int  size = 0;
+        int  margin = 0;
+        std::vector<unsigned char> pixels; // one tile's readback (bottom-up)
+        std::vector<unsigned char> band;   // one row of tiles, top-down
+        std::vector<unsigned char> image;  // whole frame, PNG output only
+    };
+
+    // Tile edge of the adaptive noise estimate (TILE in TILE_ERROR_FS).
+    static const int ADAPTIVE_TILE = 32;
+
+    // SPLAT_CS accumulator units per HDR unit: 2^20 leaves room for 4096
+    // per channel and pixel, far past where the tonemap saturates.
+    static const float SPLAT_FIXED_SCALE = 1048576.0f;
+    static const int   SPLAT_GROUP_SIZE = 64; // local_size_x of SPLAT_CS
+
+    // Per-frame segments drawn in 'samples' < accum_passes passes
+    // (RenderSettings::sample_budget).
+    struct SampleGroup {
+        int samples = 1;
+        std::vector<LineInstanceGPU> segments;
+    };
+
+    // RenderSettings::splat_max_pixels: this frame's (or batch's)
+    // hairlines by pass count, the segment buffer SPLAT_CS reads and its
+    // fixed-point accumulators (R32UI array, one layer per channel).
+    struct SplatAccum {
+        bool   enabled = false;
+        GLuint accumTex = 0;
+        GLuint clearFbo = 0;          // accumTex, all layers
+        GLuint buffer = 0;            // GL_SHADER_STORAGE_BUFFER
+        bool   dirty = false;         // accumTex written since the last clear
+        size_t seedNext = 0;          // seed of the next splatted segment
+        GLint  uProj = -1;            // programs.splat
+        GLint  uView = -1;
+        GLint  uSize = -1;
+        GLint  uThicknessScale = -1;
+        GLint  uSoft = -1;
+        GLint  uEnergy = -1;
+        GLint  uIntensityScale = -1;
+        GLint  uFixedScale = -1;
+        GLint  uFrameIndex = -1;
+        GLint  uSeed = -1;
+        GLint  uSegmentOffset = -1;
+        GLint  uFirst = -1;
+        GLint  uCount = -1;
+        GLint  uPasses = -1;
+        GLint  uResolveScale = -1;    // programs.splatResolve
+        std::vector<SampleGroup> groups;
+    };
+
+    struct Renderer {
+        Viewport      viewport;
         Programs      programs;
         Framebuffers  fbos;
         Geometry      geom;
@@ -726,6 +2369,10 @@ void main() {
         glm::mat4     view;
         PBOReadback   readback;
         SceneUniforms sceneU;
+        SceneUniforms shapeSceneU; // same uniforms, shape program
+        ShapeUniforms shapeU;
+        SceneUniforms primSceneU;  // same uniforms, primitive program
+        GLint         uPrim = -1;
         BrightUniforms brightU;
         BlurUniforms   blurU;
         CompositeUniforms compU;
@@ -743,657 +2390,4624 @@ void main() {
         float baseFarPlane;
 
         LineBlendMode blendMode;
-    };
-
-    // GPU layout matching LineParams
-    struct LineInstanceGPU {
-        float start_x, start_y, start_z;
-        float end_x, end_y, end_z;
-        float start_r, start_g, start_b;
-        float end_r, end_g, end_b;
-        float thickness;
-        float jitter;
-        float intensity;
+        uint32_t      seed32 = 0;  // RenderSettings::seed for the shaders
+
+        // Passes actually drawn per frame and the weight of each: 1 and
+        // accum_passes with JitterMode::Analytic (additive blend only),
+        // else accum_passes and 1.
+        int           passCount = 1;
+        float         passWeight = 1.0f;
+        bool          analytic = false;     // JitterMode::Analytic in effect
+        GLuint        jitterProfileTex = 0; // JitterMode::Analytic only
+        AdaptiveAccum adaptive;
+        float         hdrScale = 1.0f;      // fbos.hdr to accum_passes' energy
+        TileGrid      tiles;
+
+        SegmentStaging staging; // per-frame segments, written by callbacks
+        IncrementalUpload incremental;
+        StreamRing    ring;                 // streaming writes into geom.stream
+        SubmitPacing  pacing;
+        std::vector<SampleGroup> sampleGroups; // this frame's (or batch's)
+        SplatAccum    splat;
+        size_t        streamedSegments = 0; // stream_flush_batches, this frame
+        std::vector<LayerState> layerStates; // per frame, one per geom.layers
+        OutputProgress* output = nullptr;   // segments / checkpoint of the run
+        bool          windowEvents = true;  // false without a GLFW window
+        double        contextMs = 0.0;      // reported with the first frame
+
+        FrameStatsCallback statsCb;
+        GLuint timerQuery = 0;  // GL_TIME_ELAPSED, only when statsCb is set
     };
 
     // ========================================================================
-    // Renderer setup / teardown
+    // Instance buffers (per-frame stream and retained layers)
     // ========================================================================
-    static void initRenderer(Renderer& r, const RenderSettings& settings) {
-        r.viewport.width = settings.width;
-        r.viewport.height = settings.height;
-        r.viewport.halfWidth = settings.width / 2;
-        r.viewport.halfHeight = settings.height / 2;
-
-        r.exposure = settings.exposure;
-        r.bloomThreshold = settings.bloom_threshold;
-        r.bloomStrength = settings.bloom_strength;
-        r.bloomEnabled = settings.bloom_enabled;
-        r.softEdge = settings.soft_edge;
-        r.energyPerHit = settings.energy_per_hit;
-        r.thicknessScale = settings.thickness_scale;
-
-        r.baseFovYDeg = 60.0f;
-        r.baseNearPlane = 0.1f;
-        r.baseFarPlane = 3000.0f;
-
-        r.blendMode = settings.line_blend_mode;
-
-        // Programs
-        r.programs.scene = Utils_::createProgram(SCENE_VS, Utils_::BRIGHT_FS); // placeholder
-        // Small trick: we want SCENE_VS + SCENE_FS, not BRIGHT_FS; fix:
-        glDeleteProgram(r.programs.scene);
-        r.programs.scene = Utils_::createProgram(SCENE_VS, SCENE_FS);
-        r.programs.bright = Utils_::createProgram(Utils_::FSQ_VS, Utils_::BRIGHT_FS);
-        r.programs.blur = Utils_::createProgram(Utils_::FSQ_VS, Utils_::BLUR_FS);
-        r.programs.composite = Utils_::createProgram(Utils_::FSQ_VS, Utils_::COMPOSITE_FS);
-
-        // FBOs
-        r.fbos.hdr = Utils_::createHDRFBO(r.viewport.width, r.viewport.height);
-        r.fbos.bloomA = Utils_::createColorFBO(r.viewport.halfWidth, r.viewport.halfHeight, GL_RGBA16F);
-        r.fbos.bloomB = Utils_::createColorFBO(r.viewport.halfWidth, r.viewport.halfHeight, GL_RGBA16F);
-        r.fbos.ldr = Utils_::createColorFBO(r.viewport.width, r.viewport.height, GL_RGBA16F);
-
-        // Geometry (segment quad + fullscreen quad)
-        Utils_::makeVAO(r.geom.vaoSegment, r.geom.vboSegment,
-            Utils_::SEGMENT_QUAD, sizeof(Utils_::SEGMENT_QUAD));
-        Utils_::makeVAO(r.geom.vaoFSQ, r.geom.vboFSQ,
-            Utils_::FSQ, sizeof(Utils_::FSQ));
-
-        // Instance buffer: big chunk of segments, reused every frame.
-        r.geom.maxSegments = settings.max_line_segments_hint;
-        if (r.geom.maxSegments <= 0) {
-            r.geom.maxSegments = 1024 * 1024; // sane fallback
-        }
-
-        glBindVertexArray(r.geom.vaoSegment);
-        glGenBuffers(1, &r.geom.vboInstance);
-        glBindBuffer(GL_ARRAY_BUFFER, r.geom.vboInstance);
-        glBufferData(GL_ARRAY_BUFFER,
-            (GLsizeiptr)((size_t)r.geom.maxSegments *
-                sizeof(LineInstanceGPU)),
-            nullptr,
-            GL_DYNAMIC_DRAW);
-
+    // Float32 instance attributes (locations 2..8) of the bound VAO, read
+    // from the bound GL_ARRAY_BUFFER starting at instance 'first'. GL 3.3
+    // has no base instance, so drawing from an offset re-points them.
+    // 'divisor' instances share one segment (folded passes).
+    static void setInstanceAttribs(size_t first, int divisor = 1) {
         GLsizei stride = (GLsizei)sizeof(LineInstanceGPU);
-        std::size_t offset = 0;
+        std::size_t offset = first * sizeof(LineInstanceGPU);
 
         // aStartPos (location 2)
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(2, 1);
+        glVertexAttribDivisor(2, (GLuint)divisor);
         offset += sizeof(float) * 3;
 
         // aEndPos (location 3)
         glEnableVertexAttribArray(3);
         glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(3, 1);
+        glVertexAttribDivisor(3, (GLuint)divisor);
         offset += sizeof(float) * 3;
 
         // aStartColor (location 4)
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(4, 1);
+        glVertexAttribDivisor(4, (GLuint)divisor);
         offset += sizeof(float) * 3;
 
         // aEndColor (location 5)
         glEnableVertexAttribArray(5);
         glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(5, 1);
+        glVertexAttribDivisor(5, (GLuint)divisor);
         offset += sizeof(float) * 3;
 
         // aThickness (location 6)
         glEnableVertexAttribArray(6);
         glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(6, 1);
+        glVertexAttribDivisor(6, (GLuint)divisor);
         offset += sizeof(float);
 
         // aJitter (location 7)
         glEnableVertexAttribArray(7);
         glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(7, 1);
+        glVertexAttribDivisor(7, (GLuint)divisor);
         offset += sizeof(float);
 
         // aIntensity (location 8)
         glEnableVertexAttribArray(8);
         glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, stride, (void*)offset);
-        glVertexAttribDivisor(8, 1);
+        glVertexAttribDivisor(8, (GLuint)divisor);
         offset += sizeof(float);
+    }
+
+    // Storage for the buffer bound to 'target'. Persistent: immutable
+    // storage, mapped once for coherent writes (returns the mapping).
+    static unsigned char* allocInstanceStorage(GLenum target, size_t bytes,
+        bool persistent)
+    {
+        if (!persistent) {
+            glBufferData(target, (GLsizeiptr)bytes, nullptr, GL_DYNAMIC_DRAW);
+            return nullptr;
+        }
+        const GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, (GLsizeiptr)bytes, nullptr,
+            flags | GL_DYNAMIC_STORAGE_BIT);
+        return static_cast<unsigned char*>(
+            glMapBufferRange(target, 0, (GLsizeiptr)bytes, flags));
+    }
+
+    // 'vao' must already carry the quad attributes (locations 0, 1).
+    // 'persistent' needs ARB_buffer_storage (GL 4.4).
+    static void createInstanceBuffers(InstanceBuffers& ib, InstanceFormat format,
+        GLuint vao, size_t capacity, bool persistent = false)
+    {
+        ib.vao = vao;
+        ib.capacity = capacity;
+        ib.persistent = persistent;
+
+        if (format == InstanceFormat::PackedQuantized) {
+            // Buffer textures: segments as RG32UI (3 texels each), chunk
+            // table as RGBA32F (2 texels per chunk). The quad VAO stays
+            // attribute-only; the vertex shader pulls everything else.
+            const size_t maxChunks =
+                (capacity + PACKED_CHUNK_SEGMENTS - 1) / PACKED_CHUNK_SEGMENTS;
+
+            glGenBuffers(1, &ib.bufPacked);
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufPacked);
+            ib.mapPacked = allocInstanceStorage(GL_TEXTURE_BUFFER,
+                capacity * sizeof(PackedSegmentGPU), persistent);
+
+            glGenBuffers(1, &ib.bufChunks);
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufChunks);
+            ib.mapChunks = allocInstanceStorage(GL_TEXTURE_BUFFER,
+                maxChunks * sizeof(PackedChunkGPU), persistent);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+            glGenTextures(1, &ib.texPacked);
+            glBindTexture(GL_TEXTURE_BUFFER, ib.texPacked);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, ib.bufPacked);
+
+            glGenTextures(1, &ib.texChunks);
+            glBindTexture(GL_TEXTURE_BUFFER, ib.texChunks);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, ib.bufChunks);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+            return;
+        }
+
+        glBindVertexArray(vao);
+        glGenBuffers(1, &ib.vboInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, ib.vboInstance);
+        ib.mapInstance = allocInstanceStorage(GL_ARRAY_BUFFER,
+            capacity * sizeof(LineInstanceGPU), persistent);
+
+        setInstanceAttribs(0);
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
+    }
 
-        // Default camera (will be overridden each frame)
-        r.proj = glm::perspective(glm::radians(r.baseFovYDeg),
-            float(r.viewport.width) / float(r.viewport.height),
-            r.baseNearPlane, r.baseFarPlane);
-        r.view = glm::lookAt(glm::vec3(0, 0, 450),
-            glm::vec3(0, 0, 0),
-            glm::vec3(0, 1, 0));
+    // Deletes the instance storage (the VAO is owned by the caller).
+    static void destroyInstanceBuffers(InstanceBuffers& ib) {
+        if (ib.mapInstance) {
+            glBindBuffer(GL_ARRAY_BUFFER, ib.vboInstance);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (ib.mapPacked || ib.mapChunks) {
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufPacked);
+            if (ib.mapPacked) glUnmapBuffer(GL_TEXTURE_BUFFER);
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufChunks);
+            if (ib.mapChunks) glUnmapBuffer(GL_TEXTURE_BUFFER);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+        if (ib.vboInstance) glDeleteBuffers(1, &ib.vboInstance);
+        if (ib.texPacked)   glDeleteTextures(1, &ib.texPacked);
+        if (ib.bufPacked)   glDeleteBuffers(1, &ib.bufPacked);
+        if (ib.texChunks)   glDeleteTextures(1, &ib.texChunks);
+        if (ib.bufChunks)   glDeleteBuffers(1, &ib.bufChunks);
+        ib = InstanceBuffers{};
+    }
 
-        // Uniform locations
-        glUseProgram(r.programs.scene);
-        r.sceneU.uProj = glGetUniformLocation(r.programs.scene, "uProj");
-        r.sceneU.uView = glGetUniformLocation(r.programs.scene, "uView");
-        r.sceneU.uThicknessScale = glGetUniformLocation(r.programs.scene, "uThicknessScale");
-        r.sceneU.uPassIndex = glGetUniformLocation(r.programs.scene, "uPassIndex");
-        r.sceneU.uFrameIndex = glGetUniformLocation(r.programs.scene, "uFrameIndex");
-        r.sceneU.uTime = glGetUniformLocation(r.programs.scene, "uTime");
-        r.sceneU.uSoft = glGetUniformLocation(r.programs.scene, "uSoft");
-        r.sceneU.uEnergy = glGetUniformLocation(r.programs.scene, "uEnergyPerHit");
-        r.sceneU.uSegmentOffset = glGetUniformLocation(r.programs.scene, "uSegmentOffset");
+    // Upload src[0 .. n) to instances dstFirst .. dstFirst + n of 'ib' in
+    // the renderer's InstanceFormat. Returns the number of bytes sent.
+    // PackedQuantized needs dstFirst on a PACKED_CHUNK_SEGMENTS boundary.
+    // Persistent buffers are written through their mapping.
+    static size_t uploadInstances(Renderer& r, InstanceBuffers& ib,
+        const LineInstanceGPU* src, size_t n, size_t dstFirst)
+    {
+        if (r.geom.format == InstanceFormat::PackedQuantized) {
+            packSegments(src, n, r.geom.packed, r.geom.packedChunks);
+
+            const size_t segBytes = n * sizeof(PackedSegmentGPU);
+            const size_t chunkBytes = r.geom.packedChunks.size() * sizeof(PackedChunkGPU);
+            const size_t segOffset = dstFirst * sizeof(PackedSegmentGPU);
+            const size_t chunkOffset =
+                dstFirst / PACKED_CHUNK_SEGMENTS * sizeof(PackedChunkGPU);
+
+            if (ib.persistent) {
+                std::memcpy(ib.mapPacked + segOffset, r.geom.packed.data(), segBytes);
+                std::memcpy(ib.mapChunks + chunkOffset,
+                    r.geom.packedChunks.data(), chunkBytes);
+                return segBytes + chunkBytes;
+            }
 
-        glUseProgram(r.programs.bright);
-        r.brightU.uHDRTex = glGetUniformLocation(r.programs.bright, "uHDRTex");
-        r.brightU.uExposure = glGetUniformLocation(r.programs.bright, "uExposure");
-        r.brightU.uThreshold = glGetUniformLocation(r.programs.bright, "uThreshold");
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufPacked);
+            glBufferSubData(GL_TEXTURE_BUFFER,
+                (GLintptr)segOffset, (GLsizeiptr)segBytes, r.geom.packed.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufChunks);
+            glBufferSubData(GL_TEXTURE_BUFFER,
+                (GLintptr)chunkOffset, (GLsizeiptr)chunkBytes, r.geom.packedChunks.data());
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            return segBytes + chunkBytes;
+        }
 
-        glUseProgram(r.programs.blur);
-        r.blurU.uTex = glGetUniformLocation(r.programs.blur, "uTex");
-        r.blurU.uTexelSize = glGetUniformLocation(r.programs.blur, "uTexelSize");
-        r.blurU.uDirection = glGetUniformLocation(r.programs.blur, "uDirection");
+        const size_t bytes = n * sizeof(LineInstanceGPU);
+        if (ib.persistent) {
+            std::memcpy(ib.mapInstance + dstFirst * sizeof(LineInstanceGPU), src, bytes);
+            return bytes;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, ib.vboInstance);
+        glBufferSubData(GL_ARRAY_BUFFER,
+            (GLintptr)(dstFirst * sizeof(LineInstanceGPU)), (GLsizeiptr)bytes, src);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return bytes;
+    }
 
-        glUseProgram(r.programs.composite);
-        r.compU.uHDRTex = glGetUniformLocation(r.programs.composite, "uHDRTex");
-        r.compU.uBloomTex = glGetUniformLocation(r.programs.composite, "uBloomTex");
-        r.compU.uExposure = glGetUniformLocation(r.programs.composite, "uExposure");
-        r.compU.uBloomStrength = glGetUniformLocation(r.programs.composite, "uBloomStrength");
+    // Fresh storage for a non-persistent buffer: draws already queued keep
+    // reading the old one, so the next writes do not wait for them.
+    static void orphanInstanceBuffers(const Renderer& r, InstanceBuffers& ib) {
+        if (r.geom.format == InstanceFormat::PackedQuantized) {
+            const size_t maxChunks =
+                (ib.capacity + PACKED_CHUNK_SEGMENTS - 1) / PACKED_CHUNK_SEGMENTS;
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufPacked);
+            glBufferData(GL_TEXTURE_BUFFER,
+                (GLsizeiptr)(ib.capacity * sizeof(PackedSegmentGPU)),
+                nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, ib.bufChunks);
+            glBufferData(GL_TEXTURE_BUFFER,
+                (GLsizeiptr)(maxChunks * sizeof(PackedChunkGPU)),
+                nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, ib.vboInstance);
+        glBufferData(GL_ARRAY_BUFFER,
+            (GLsizeiptr)(ib.capacity * sizeof(LineInstanceGPU)),
+            nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-        glUseProgram(0);
+    // ------------------------------------------------------------------------
+    // Stream ring: fences for the persistently mapped stream buffer
+    // ------------------------------------------------------------------------
+    // Every draw range of the stream buffer gets a fence (persistent mapping
+    // only); a write first waits for the newest fence it overlaps. Fences
+    // retire in submission order, so older ones are dropped with it.
+    static void waitStreamRange(Renderer& r, size_t first, size_t n) {
+        std::deque<StreamFence>& fences = r.ring.fences;
+        size_t last = fences.size();
+        for (size_t i = 0; i < fences.size(); ++i) {
+            if (fences[i].first < first + n && first < fences[i].end) last = i;
+        }
+        if (last == fences.size()) return;
 
-        // Readback
-        initPBO(r.readback, settings.use_pbo,
-            r.viewport.width, r.viewport.height);
+        for (;;) {
+            GLenum res = glClientWaitSync(fences[last].sync,
+                GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            if (res != GL_TIMEOUT_EXPIRED) break;
+        }
+        for (size_t i = 0; i <= last; ++i) {
+            glDeleteSync(fences.front().sync);
+            fences.pop_front();
+        }
     }
 
-    static void destroyRenderer(Renderer& r) {
-        destroyPBO(r.readback);
+    static void fenceStreamRange(Renderer& r, size_t first, size_t n) {
+        if (!r.geom.stream.persistent || n == 0) return;
+        std::deque<StreamFence>& fences = r.ring.fences;
+
+        // Drop what the GPU is done with, so the list stays short when
+        // nothing is rewritten for a while (incremental upload).
+        while (!fences.empty()) {
+            GLenum res = glClientWaitSync(fences.front().sync, 0, 0);
+            if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) break;
+            glDeleteSync(fences.front().sync);
+            fences.pop_front();
+        }
 
-        if (r.geom.vboInstance) glDeleteBuffers(1, &r.geom.vboInstance);
-        if (r.geom.vboSegment)  glDeleteBuffers(1, &r.geom.vboSegment);
-        if (r.geom.vaoSegment)  glDeleteVertexArrays(1, &r.geom.vaoSegment);
-        if (r.geom.vboFSQ)      glDeleteBuffers(1, &r.geom.vboFSQ);
-        if (r.geom.vaoFSQ)      glDeleteVertexArrays(1, &r.geom.vaoFSQ);
+        StreamFence f;
+        f.first = first;
+        f.end = first + n;
+        f.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fences.push_back(f);
+    }
 
-        if (r.fbos.hdr.depthRbo) glDeleteRenderbuffers(1, &r.fbos.hdr.depthRbo);
-        if (r.fbos.hdr.colorTex) glDeleteTextures(1, &r.fbos.hdr.colorTex);
-        if (r.fbos.hdr.fbo)      glDeleteFramebuffers(1, &r.fbos.hdr.fbo);
+    static void destroyStreamRing(Renderer& r) {
+        for (const StreamFence& f : r.ring.fences) glDeleteSync(f.sync);
+        r.ring = StreamRing{};
+    }
 
-        if (r.fbos.ldr.colorTex) glDeleteTextures(1, &r.fbos.ldr.colorTex);
-        if (r.fbos.ldr.fbo)      glDeleteFramebuffers(1, &r.fbos.ldr.fbo);
+    // Ring position for n (<= capacity) segments, chunk aligned. Past the
+    // end it wraps to 0; without persistent mapping the buffer is orphaned
+    // there instead of waiting. Either way what it held is gone, so
+    // incremental upload starts over.
+    static size_t reserveStream(Renderer& r, size_t n) {
+        StreamRing& ring = r.ring;
+        if (ring.head + n > (size_t)r.geom.maxSegments) {
+            ring.head = 0;
+            r.incremental.valid = false;
+            if (!r.geom.stream.persistent) {
+                orphanInstanceBuffers(r, r.geom.stream);
+            }
+        }
+        const size_t first = ring.head;
+        waitStreamRange(r, first, n);
+        ring.head += (n + PACKED_CHUNK_SEGMENTS - 1) /
+            PACKED_CHUNK_SEGMENTS * PACKED_CHUNK_SEGMENTS;
+        return first;
+    }
 
-        if (r.fbos.bloomA.colorTex) glDeleteTextures(1, &r.fbos.bloomA.colorTex);
-        if (r.fbos.bloomA.fbo)      glDeleteFramebuffers(1, &r.fbos.bloomA.fbo);
-        if (r.fbos.bloomB.colorTex) glDeleteTextures(1, &r.fbos.bloomB.colorTex);
-        if (r.fbos.bloomB.fbo)      glDeleteFramebuffers(1, &r.fbos.bloomB.fbo);
+    // ------------------------------------------------------------------------
+    // Incremental upload (RenderSettings::incremental_upload)
+    // ------------------------------------------------------------------------
+    // Multiple of PACKED_CHUNK_SEGMENTS, so slots start on chunk boundaries.
+    static const size_t INCREMENTAL_SLOT_GRANULE = 256;
 
-        if (r.programs.scene)     glDeleteProgram(r.programs.scene);
-        if (r.programs.bright)    glDeleteProgram(r.programs.bright);
-        if (r.programs.blur)      glDeleteProgram(r.programs.blur);
-        if (r.programs.composite) glDeleteProgram(r.programs.composite);
+    static uint64_t hashSegments(const LineInstanceGPU* src, size_t n) {
+        return hashBytes(src, n * sizeof(LineInstanceGPU));
     }
 
-    // ========================================================================
-    // Frame building: cache segments once per frame
-    // ========================================================================
-    static void buildFrameSegments(const RenderSettings& settings,
-        int frameIndex, float timeSec,
-        const LineCallback& getLine,
-        std::vector<LineInstanceGPU>& outSegments)
+    // Upload the dirty batches of 'st' into their slots. On success
+    // drawCount is the slot extent to draw (padding included); false when
+    // the slots do not fit, the caller then uses a normal upload.
+    static bool uploadIncremental(Renderer& r, const SegmentStaging& st,
+        size_t& drawCount, FrameStats& stats)
     {
-        outSegments.clear();
-        if (!getLine) return;
-
-        int idx = 0;
-        while (true) {
-            LineParams lp{};
-            if (!getLine(frameIndex, timeSec, idx, lp)) {
-                break;
-            }
-            ++idx;
+        IncrementalUpload& inc = r.incremental;
+
+        std::vector<UploadBatch> batches;
+        std::vector<size_t> firsts;
+        size_t begin = 0;
+        size_t slot = 0;
+        auto addBatch = [&](size_t end) {
+            if (end <= begin) return;
+            UploadBatch b;
+            b.slot = slot;
+            b.count = end - begin;
+            b.capacity = (b.count + INCREMENTAL_SLOT_GRANULE - 1) /
+                INCREMENTAL_SLOT_GRANULE * INCREMENTAL_SLOT_GRANULE;
+            slot += b.capacity;
+            batches.push_back(b);
+            firsts.push_back(begin);
+            begin = end;
+        };
+        for (size_t e : st.batchEnds) addBatch(std::min(e, st.size()));
+        addBatch(st.size());
 
-            if (lp.thickness <= 0.0f) {
-                continue; // skip zero-thickness segments
-            }
+        if (slot > (size_t)r.geom.maxSegments) {
+            inc.valid = false;
+            return false;
+        }
 
-            LineInstanceGPU s{};
-            s.start_x = lp.start_x;
-            s.start_y = lp.start_y;
-            s.start_z = lp.start_z;
-            s.end_x = lp.end_x;
-            s.end_y = lp.end_y;
-            s.end_z = lp.end_z;
+        const size_t bytesPerSegment =
+            r.geom.format == InstanceFormat::PackedQuantized
+            ? sizeof(PackedSegmentGPU) : sizeof(LineInstanceGPU);
 
-            s.start_r = lp.start_r;
-            s.start_g = lp.start_g;
-            s.start_b = lp.start_b;
-            s.end_r = lp.end_r;
-            s.end_g = lp.end_g;
-            s.end_b = lp.end_b;
+        for (size_t k = 0; k < batches.size(); ++k) {
+            UploadBatch& b = batches[k];
+            const LineInstanceGPU* src = st.data() + firsts[k];
+            b.hash = hashSegments(src, b.count);
 
-            s.thickness = lp.thickness;
-            s.jitter = lp.jitter;
-            s.intensity = lp.intensity;
+            if (inc.valid && k < inc.batches.size()) {
+                const UploadBatch& old = inc.batches[k];
+                if (old.slot == b.slot && old.capacity == b.capacity &&
+                    old.count == b.count && old.hash == b.hash)
+                {
+                    stats.upload_skipped_bytes += b.capacity * bytesPerSegment;
+                    continue;
+                }
+            }
 
-            outSegments.push_back(s);
+            // Batch + invisible (zero-thickness) padding up to the slot size.
+            // Padding repeats the last segment's position so packed chunk
+            // bounds do not grow.
+            inc.scratch.resize(b.capacity);
+            std::memcpy(inc.scratch.data(), src, b.count * sizeof(LineInstanceGPU));
+            LineInstanceGPU pad = src[b.count - 1];
+            pad.thickness = 0.0f;
+            pad.jitter = 0.0f;
+            std::fill(inc.scratch.begin() + (std::ptrdiff_t)b.count, inc.scratch.end(), pad);
+
+            waitStreamRange(r, b.slot, b.capacity);
+            stats.upload_bytes += uploadInstances(r, r.geom.stream,
+                inc.scratch.data(), b.capacity, b.slot);
         }
 
-        // Optional: you could clamp to some absolute limit here if you want.
-        (void)settings;
+        inc.batches.swap(batches);
+        inc.valid = true;
+        drawCount = slot;
+        return true;
     }
 
-    // ========================================================================
-    // Rendering steps
-    // ========================================================================
-
-    // 1) Accumulate segment ribbons into HDR FBO
-    static void accumulateScene(Renderer& r,
-        const RenderSettings& settings,
-        int frameIndex, float timeSec,
-        const std::vector<LineInstanceGPU>& segments)
+    // Make 'ib' the source of the next instanced scene draw; instance 0 of
+    // the draw is 'first' in the buffer and each segment is drawn for
+    // 'fold' consecutive passes. PackedQuantized needs 'first' on a
+    // PACKED_CHUNK_SEGMENTS boundary.
+    static void bindInstances(const Renderer& r, InstanceBuffers& ib,
+        size_t first = 0, int fold = 1)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.hdr.fbo);
-        glViewport(0, 0, r.viewport.width, r.viewport.height);
-
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        if (r.blendMode == LineBlendMode::AdditiveLightPainting) {
-            glDisable(GL_DEPTH_TEST);
-            glDepthMask(GL_FALSE);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE);
+        glBindVertexArray(ib.vao);
+        if (r.geom.format == InstanceFormat::PackedQuantized) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_BUFFER, ib.texPacked);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, ib.texChunks);
+            glActiveTexture(GL_TEXTURE0);
+            glUniform1i(r.sceneU.uInstanceBase, (GLint)first);
         }
-        else {
-            glEnable(GL_DEPTH_TEST);
-            glDepthMask(GL_TRUE);
-            glDisable(GL_BLEND);
+        else if (ib.first != first || ib.divisor != fold) {
+            glBindBuffer(GL_ARRAY_BUFFER, ib.vboInstance);
+            setInstanceAttribs(first, fold);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
         }
+        glUniform1i(r.sceneU.uPassFold, fold);
+        ib.first = first;
+        ib.divisor = fold;
+    }
 
-        glUseProgram(r.programs.scene);
+    // Upload every RenderSettings::static_layers entry once, into its own
+    // buffers. Layers get seed bases far from the per-frame stream so their
+    // jitter pattern does not depend on how many dynamic segments there are.
+    static void createRetainedLayers(Renderer& r, const RenderSettings& settings) {
+        SegmentStaging filtered;
+        initStaging(filtered, 4096);
+
+        int seedBase = 0x40000000;
+        for (const StaticLayer& src : settings.static_layers) {
+            resetStaging(filtered);
+            LineEmitContext ctx;
+            ctx.sink = &filtered.sink;
+            ctx.add_span(src.segments); // drops zero-thickness segments
+
+            size_t count = filtered.size();
+            if (r.geom.format == InstanceFormat::PackedQuantized &&
+                r.geom.maxBufferTexels > 0 &&
+                count > (size_t)(r.geom.maxBufferTexels / 3))
+            {
+                std::cerr << "[WireEngine] Static layer '" << src.name
+                    << "' truncated to " << (r.geom.maxBufferTexels / 3)
+                    << " segments (GL_MAX_TEXTURE_BUFFER_SIZE)\n";
+                count = (size_t)(r.geom.maxBufferTexels / 3);
+            }
 
-        glUniformMatrix4fv(r.sceneU.uProj, 1, GL_FALSE, glm::value_ptr(r.proj));
-        glUniformMatrix4fv(r.sceneU.uView, 1, GL_FALSE, glm::value_ptr(r.view));
-        glUniform1f(r.sceneU.uThicknessScale, r.thicknessScale);
-        glUniform1i(r.sceneU.uFrameIndex, frameIndex);
-        glUniform1f(r.sceneU.uTime, timeSec);
-        glUniform1f(r.sceneU.uSoft, r.softEdge);
-        glUniform1f(r.sceneU.uEnergy, r.energyPerHit);
+            RetainedLayer layer;
+            layer.name = src.name;
+            layer.count = count;
+            layer.seedBase = seedBase;
+            seedBase += (int)count;
+
+            if (count > 0) {
+                GLuint vao = 0;
+                Utils_::makeQuadVAO(vao, r.geom.vboSegment);
+                createInstanceBuffers(layer.gpu, r.geom.format, vao, count);
+                uploadInstances(r, layer.gpu, filtered.data(), count, 0);
+            }
 
-        glBindVertexArray(r.geom.vaoSegment);
+            r.geom.layers.push_back(std::move(layer));
+            r.layerStates.push_back(src.state);
+        }
+    }
 
-        const size_t totalSegments = segments.size();
-        if (totalSegments == 0) {
-            glBindVertexArray(0);
-            glDisable(GL_BLEND);
-            glDisable(GL_DEPTH_TEST);
-            glDepthMask(GL_FALSE);
-            return;
+    // Per-frame layer state: the layer's own default, then layer_cb.
+    static void evalLayerStates(const RenderSettings& settings,
+        int frameIndex, float timeSec, std::vector<LayerState>& states)
+    {
+        states.resize(settings.static_layers.size());
+        for (size_t i = 0; i < states.size(); ++i) {
+            const StaticLayer& layer = settings.static_layers[i];
+            states[i] = layer.state;
+            if (settings.layer_cb) {
+                settings.layer_cb(frameIndex, timeSec, (int)i, layer.name, states[i]);
+            }
         }
+    }
 
-        const size_t capacity = (size_t)r.geom.maxSegments;
+    static void destroyRetainedLayers(Renderer& r) {
+        for (RetainedLayer& layer : r.geom.layers) {
+            GLuint vao = layer.gpu.vao;
+            destroyInstanceBuffers(layer.gpu);
+            if (vao) glDeleteVertexArrays(1, &vao);
+        }
+        r.geom.layers.clear();
+    }
 
-        const bool canUploadOnce = (totalSegments <= capacity);
+    // ========================================================================
+    // Shape prototypes (RenderSettings::shape_prototypes)
+    // ========================================================================
+    static_assert(sizeof(ShapeInstance) == 20 * sizeof(float),
+        "ShapeInstance must stay 5 tightly packed vec4 (SCENE_VS_SHAPES)");
+
+    // Prototype segments are stored as 4 RGBA32F texels each.
+    struct PrototypeSegmentGPU {
+        float start[3]; float thickness;
+        float end[3];   float jitter;
+        float c0[3];    float intensity;
+        float c1[3];    float unused;
+    };
 
-        if (canUploadOnce) {
-            // Upload all segments once, then reuse for all passes
-            glBindBuffer(GL_ARRAY_BUFFER, r.geom.vboInstance);
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
-                (GLsizeiptr)(totalSegments * sizeof(LineInstanceGPU)),
-                segments.data());
-            glBindBuffer(GL_ARRAY_BUFFER, 0);
+    static void createShapeBuffers(Renderer& r, const RenderSettings& settings) {
+        ShapeBuffers& sb = r.geom.shapes;
+        if (settings.shape_prototypes.empty()) return;
+
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        sb.maxInstances = maxTexels > 0 ? (size_t)maxTexels / 5 : (size_t)-1;
+
+        std::vector<PrototypeSegmentGPU> segs;
+        for (const ShapePrototype& proto : settings.shape_prototypes) {
+            sb.protoFirst.push_back((int)segs.size());
+            for (const LineParams& lp : proto.segments) {
+                if (!(lp.thickness > 0.0f)) continue;
+                PrototypeSegmentGPU g;
+                g.start[0] = lp.start_x; g.start[1] = lp.start_y; g.start[2] = lp.start_z;
+                g.end[0] = lp.end_x;     g.end[1] = lp.end_y;     g.end[2] = lp.end_z;
+                g.c0[0] = lp.start_r;    g.c0[1] = lp.start_g;    g.c0[2] = lp.start_b;
+                g.c1[0] = lp.end_r;      g.c1[1] = lp.end_g;      g.c1[2] = lp.end_b;
+                g.thickness = lp.thickness;
+                g.jitter = lp.jitter;
+                g.intensity = lp.intensity;
+                g.unused = 0.0f;
+                segs.push_back(g);
+            }
+            sb.protoCount.push_back((int)segs.size() - sb.protoFirst.back());
+        }
 
-            for (int pass = 0; pass < settings.accum_passes; ++pass) {
-                glUniform1i(r.sceneU.uPassIndex, pass);
-                glUniform1i(r.sceneU.uSegmentOffset, 0);
+        Utils_::makeQuadVAO(sb.vao, r.geom.vboSegment);
+
+        glGenBuffers(1, &sb.bufPrototypes);
+        glBindBuffer(GL_TEXTURE_BUFFER, sb.bufPrototypes);
+        glBufferData(GL_TEXTURE_BUFFER,
+            (GLsizeiptr)(std::max<size_t>(segs.size(), 1) * sizeof(PrototypeSegmentGPU)),
+            segs.empty() ? nullptr : segs.data(), GL_STATIC_DRAW);
+
+        glGenBuffers(1, &sb.bufInstances);
+        glBindBuffer(GL_TEXTURE_BUFFER, sb.bufInstances);
+        sb.instanceCapacity = 1024;
+        glBufferData(GL_TEXTURE_BUFFER,
+            (GLsizeiptr)(sb.instanceCapacity * sizeof(ShapeInstance)),
+            nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glGenTextures(1, &sb.texPrototypes);
+        glBindTexture(GL_TEXTURE_BUFFER, sb.texPrototypes);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, sb.bufPrototypes);
+
+        glGenTextures(1, &sb.texInstances);
+        glBindTexture(GL_TEXTURE_BUFFER, sb.texInstances);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, sb.bufInstances);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    static void destroyShapeBuffers(ShapeBuffers& sb) {
+        if (sb.texPrototypes) glDeleteTextures(1, &sb.texPrototypes);
+        if (sb.bufPrototypes) glDeleteBuffers(1, &sb.bufPrototypes);
+        if (sb.texInstances)  glDeleteTextures(1, &sb.texInstances);
+        if (sb.bufInstances)  glDeleteBuffers(1, &sb.bufInstances);
+        if (sb.vao)           glDeleteVertexArrays(1, &sb.vao);
+        sb = ShapeBuffers{};
+    }
 
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 6,
-                    (GLsizei)totalSegments);
+    // Upload this frame's placements (one list after the other) and build
+    // the draw list. Returns the number of bytes sent.
+    static size_t uploadShapes(Renderer& r, const ShapeSink& shapes) {
+        ShapeBuffers& sb = r.geom.shapes;
+        sb.draws.clear();
+        if (!sb.bufInstances) return 0;
 
-                if ((pass % YIELD_EVERY_PASSES) == 0) {
-                    glfwPollEvents();
-                    glFlush();
+        size_t total = 0;
+        for (size_t proto = 0; proto < shapes.instances.size() &&
+            proto < sb.protoCount.size(); ++proto)
+        {
+            if (sb.protoCount[proto] == 0) continue;
+            size_t n = shapes.instances[proto].size();
+            if (total + n > sb.maxInstances) {
+                if (!sb.warnedClamp) {
+                    std::cerr << "[WireEngine] Shape instances clamped to "
+                        << sb.maxInstances << " (GL_MAX_TEXTURE_BUFFER_SIZE)\n";
+                    sb.warnedClamp = true;
                 }
+                n = sb.maxInstances - total;
             }
+            if (n == 0) continue;
+            sb.draws.push_back({ (int)proto, (int)total, (int)n });
+            total += n;
         }
-        else {
-            // Streaming path: chunk segments into the fixed-size VBO
-            for (int pass = 0; pass < settings.accum_passes; ++pass) {
-                glUniform1i(r.sceneU.uPassIndex, pass);
-
-                size_t offset = 0;
-                while (offset < totalSegments) {
-                    size_t chunk = capacity;
-                    if (chunk > totalSegments - offset) {
-                        chunk = totalSegments - offset;
-                    }
+        if (total == 0) return 0;
+
+        glBindBuffer(GL_TEXTURE_BUFFER, sb.bufInstances);
+        if (total > sb.instanceCapacity) {
+            sb.instanceCapacity = std::max(total, sb.instanceCapacity * 2);
+            glBufferData(GL_TEXTURE_BUFFER,
+                (GLsizeiptr)(sb.instanceCapacity * sizeof(ShapeInstance)),
+                nullptr, GL_DYNAMIC_DRAW);
+        }
+        for (const ShapeBuffers::Draw& d : sb.draws) {
+            glBufferSubData(GL_TEXTURE_BUFFER,
+                (GLintptr)((size_t)d.first * sizeof(ShapeInstance)),
+                (GLsizeiptr)((size_t)d.count * sizeof(ShapeInstance)),
+                shapes.instances[(size_t)d.proto].data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return total * sizeof(ShapeInstance);
+    }
 
-                    glBindBuffer(GL_ARRAY_BUFFER, r.geom.vboInstance);
-                    glBufferSubData(GL_ARRAY_BUFFER, 0,
-                        (GLsizeiptr)(chunk * sizeof(LineInstanceGPU)),
-                        segments.data() + offset);
-                    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // ========================================================================
+    // Parametric primitives (LineEmitContext::add_primitive)
+    // ========================================================================
+    std::size_t primitiveSegmentCount(const ParametricPrimitive& prim) {
+        const size_t U = (size_t)std::max(prim.u_segments, 0);
+        const size_t V = (size_t)std::max(prim.v_segments, 0);
+        switch (prim.type) {
+        case PrimitiveType::Torus: return 2 * U * V;
+        case PrimitiveType::Grid:  return (V + 1) * U + (U + 1) * V;
+        case PrimitiveType::Ring:
+        case PrimitiveType::Helix:
+        default:                   return U * V;
+        }
+    }
 
-                    glUniform1i(r.sceneU.uSegmentOffset,
-                        (int)offset); // so RNG stays stable
+    static PrimitiveGPU toPrimitiveGPU(const ParametricPrimitive& p) {
+        PrimitiveGPU g;
+        auto row = [&g](int i, const float* xyz, float w) {
+            g.v[i][0] = xyz[0]; g.v[i][1] = xyz[1]; g.v[i][2] = xyz[2]; g.v[i][3] = w;
+        };
+        auto row4 = [&g](int i, float x, float y, float z, float w) {
+            g.v[i][0] = x; g.v[i][1] = y; g.v[i][2] = z; g.v[i][3] = w;
+        };
+        row(0, p.center, (float)(int)p.type);
+        row(1, p.axis_x, (float)p.u_segments);
+        row(2, p.axis_y, (float)p.v_segments);
+        row(3, p.axis_z, p.turns);
+        row4(4, p.major, p.minor, p.wave_amp_u, p.wave_amp_v);
+        row4(5, p.wave_freq_u, p.wave_freq_v, p.wave_phase, p.stripe_amp);
+        row(6, p.color0, p.stripe_freq);
+        row(7, p.color1, p.stripe_phase);
+        row4(8, p.thickness, p.jitter, p.intensity, 0.0f);
+
+        const size_t n = primitiveSegmentCount(p);
+        g.segments = (GLsizei)std::min<size_t>(n, (size_t)std::numeric_limits<GLsizei>::max());
+        return g;
+    }
 
-                    glDrawArraysInstanced(GL_TRIANGLES, 0, 6,
-                        (GLsizei)chunk);
+    // ========================================================================
+    // Renderer setup / teardown
+    // ========================================================================
+    // ------------------------------------------------------------------------
+    // Analytic jitter profile (JitterMode::Analytic)
+    // ------------------------------------------------------------------------
+    // Expected coverage of the soft ribbon profile under the shader's radial
+    // jitter, in units of the widened half width W = thickness + jitter:
+    // texel (x, k) holds E[strip((x - k r cos a) / (1 - k))] for r, a
+    // uniform in [0, 1) x [0, pi), with k = jitter / W. Only the in-plane
+    // (side) part of the jitter is modelled. 128 x 128 with bilinear
+    // filtering stays within 0.7% of the exact value.
+    static const int JITTER_PROFILE_SIZE = 128; // also in SCENE_FS
+    static const int JITTER_PROFILE_TAPS = 64;  // per dimension (r, a)
+
+    static void buildJitterProfile(float soft, std::vector<float>& out) {
+        const int n = JITTER_PROFILE_SIZE;
+        const int taps = JITTER_PROFILE_TAPS;
+        const float inner = 0.60f + (0.95f - 0.60f) * soft;
+
+        auto strip = [inner](float v) {
+            v = std::fabs(v);
+            if (v >= 1.0f) return 0.0f;
+            const float t = std::clamp((v - inner) / (1.0f - inner), 0.0f, 1.0f);
+            return 1.0f - t * t * (3.0f - 2.0f * t);
+        };
 
-                    offset += chunk;
-                }
+        std::vector<float> offsets((size_t)taps * taps); // r cos a
+        for (int i = 0; i < taps; ++i) {
+            const float rad = (float(i) + 0.5f) / float(taps);
+            for (int j = 0; j < taps; ++j) {
+                const float ang = (float(j) + 0.5f) / float(taps) * 3.14159265f;
+                offsets[(size_t)i * taps + j] = rad * std::cos(ang);
+            }
+        }
 
-                if ((pass % YIELD_EVERY_PASSES) == 0) {
-                    glfwPollEvents();
-                    glFlush();
-                }
+        out.assign((size_t)n * n, 0.0f);
+        for (int kk = 0; kk < n; ++kk) {
+            const float k = float(kk) / float(n - 1);
+            const float thickness = 1.0f - k;
+            if (thickness <= 1e-4f) continue; // all jitter, no ribbon
+
+            for (int xi = 0; xi < n; ++xi) {
+                const float x = float(xi) / float(n - 1);
+                double sum = 0.0;
+                for (float d : offsets) sum += strip((x - k * d) / thickness);
+                out[(size_t)kk * n + xi] = float(sum / double(offsets.size()));
             }
         }
+    }
 
-        glBindVertexArray(0);
-        glDisable(GL_BLEND);
-        glDisable(GL_DEPTH_TEST);
+    static GLuint createJitterProfileTexture(float soft) {
+        std::vector<float> table;
+        buildJitterProfile(soft, table);
+
+        GLuint tex = 0;
+        glGenTextures(1, &tex);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, JITTER_PROFILE_SIZE, JITTER_PROFILE_SIZE,
+            0, GL_RED, GL_FLOAT, table.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return tex;
+    }
+
+    // RenderSettings::adaptive_error: odd-pass target, tile grid and the
+    // two programs. Needs fbos.hdr.
+    static void createAdaptiveAccum(Renderer& r) {
+        AdaptiveAccum& a = r.adaptive;
+        const int w = r.viewport.width;
+        const int h = r.viewport.height;
+
+        glGenTextures(1, &a.oddTex);
+        glBindTexture(GL_TEXTURE_2D, a.oddTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, w, h, 0,
+            GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.hdr.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+            GL_TEXTURE_2D, a.oddTex, 0);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+        // Sampling oddTex while it is attached to the bound framebuffer is
+        // a feedback loop even if it is not drawn to.
+        glGenFramebuffers(1, &a.evenFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, a.evenFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D, r.fbos.hdr.colorTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        a.tilesX = (w + ADAPTIVE_TILE - 1) / ADAPTIVE_TILE;
+        a.tilesY = (h + ADAPTIVE_TILE - 1) / ADAPTIVE_TILE;
+        a.tiles = Utils_::createColorFBO(a.tilesX, a.tilesY, GL_R32F);
+        a.errors.resize((size_t)a.tilesX * (size_t)a.tilesY);
+
+        // Texture units 5 / 6, clear of the scene programs' ones.
+        r.programs.add = Utils_::createProgram(Utils_::FSQ_VS, Utils_::ADD_FS);
+        glUseProgram(r.programs.add);
+        glUniform1i(glGetUniformLocation(r.programs.add, "uTex"), 6);
+
+        r.programs.tileError = Utils_::createProgram(Utils_::FSQ_VS, Utils_::TILE_ERROR_FS);
+        glUseProgram(r.programs.tileError);
+        glUniform1i(glGetUniformLocation(r.programs.tileError, "uEven"), 5);
+        glUniform1i(glGetUniformLocation(r.programs.tileError, "uOdd"), 6);
+        a.uSize = glGetUniformLocation(r.programs.tileError, "uSize");
+        a.uScale = glGetUniformLocation(r.programs.tileError, "uScale");
+        a.uExposure = glGetUniformLocation(r.programs.tileError, "uExposure");
+        glUseProgram(0);
+
+        a.enabled = true;
+    }
+
+    static void destroyAdaptiveAccum(Renderer& r) {
+        AdaptiveAccum& a = r.adaptive;
+        if (a.oddTex)         glDeleteTextures(1, &a.oddTex);
+        if (a.evenFbo)        glDeleteFramebuffers(1, &a.evenFbo);
+        if (a.tiles.colorTex) glDeleteTextures(1, &a.tiles.colorTex);
+        if (a.tiles.fbo)      glDeleteFramebuffers(1, &a.tiles.fbo);
+        if (r.programs.add)       glDeleteProgram(r.programs.add);
+        if (r.programs.tileError) glDeleteProgram(r.programs.tileError);
+        a = AdaptiveAccum{};
+    }
+
+    // RenderSettings::splat_max_pixels: accumulators and the two programs,
+    // if the context has compute shaders. Needs r.viewport.
+    static void createSplatAccum(Renderer& r) {
+        if (!GLEW_VERSION_4_3) {
+            std::cerr << "[WireEngine] splat_max_pixels needs OpenGL 4.3 "
+                << "(compute shaders); drawing hairlines as ribbons.\n";
+            return;
+        }
+        SplatAccum& sp = r.splat;
+
+        glGenTextures(1, &sp.accumTex);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sp.accumTex);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32UI,
+            r.viewport.width, r.viewport.height, 3, 0,
+            GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        // Layered attachment: one glClearBufferuiv clears every channel.
+        glGenFramebuffers(1, &sp.clearFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, sp.clearFbo);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, sp.accumTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        sp.dirty = true;
+
+        glGenBuffers(1, &sp.buffer);
+
+        const GLuint cs = r.programs.splat = Utils_::createComputeProgram(SPLAT_CS);
+        sp.uProj = glGetUniformLocation(cs, "uProj");
+        sp.uView = glGetUniformLocation(cs, "uView");
+        sp.uSize = glGetUniformLocation(cs, "uSize");
+        sp.uThicknessScale = glGetUniformLocation(cs, "uThicknessScale");
+        sp.uSoft = glGetUniformLocation(cs, "uSoft");
+        sp.uEnergy = glGetUniformLocation(cs, "uEnergyPerHit");
+        sp.uIntensityScale = glGetUniformLocation(cs, "uIntensityScale");
+        sp.uFixedScale = glGetUniformLocation(cs, "uFixedScale");
+        sp.uFrameIndex = glGetUniformLocation(cs, "uFrameIndex");
+        sp.uSeed = glGetUniformLocation(cs, "uSeed");
+        sp.uSegmentOffset = glGetUniformLocation(cs, "uSegmentOffset");
+        sp.uFirst = glGetUniformLocation(cs, "uFirst");
+        sp.uCount = glGetUniformLocation(cs, "uCount");
+        sp.uPasses = glGetUniformLocation(cs, "uPasses");
+        glUseProgram(cs);
+        glUniform1f(sp.uFixedScale, SPLAT_FIXED_SCALE);
+
+        // Texture unit 7, clear of the scene and adaptive ones.
+        r.programs.splatResolve = Utils_::createProgram(Utils_::FSQ_VS, SPLAT_RESOLVE_FS);
+        glUseProgram(r.programs.splatResolve);
+        glUniform1i(glGetUniformLocation(r.programs.splatResolve, "uSplat"), 7);
+        sp.uResolveScale = glGetUniformLocation(r.programs.splatResolve, "uScale");
+        glUseProgram(0);
+
+        sp.enabled = true;
+    }
+
+    static void destroySplatAccum(Renderer& r) {
+        SplatAccum& sp = r.splat;
+        if (sp.accumTex) glDeleteTextures(1, &sp.accumTex);
+        if (sp.clearFbo) glDeleteFramebuffers(1, &sp.clearFbo);
+        if (sp.buffer)   glDeleteBuffers(1, &sp.buffer);
+        if (r.programs.splat)        glDeleteProgram(r.programs.splat);
+        if (r.programs.splatResolve) glDeleteProgram(r.programs.splatResolve);
+        sp = SplatAccum{};
+    }
+
+    // Render target size: the frame (as initRendererParams set it), or one
+    // tile plus margins.
+    static void initTileGrid(Renderer& r, const RenderSettings& settings) {
+        GLint maxTex = 0;
+        GLint maxViewport[2] = { 0, 0 };
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTex);
+        glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+        const int limit = std::min<int>(maxTex, std::min(maxViewport[0], maxViewport[1]));
+
+        TileGrid& t = r.tiles;
+        if (settings.tile_size <= 0) {
+            if (settings.width > limit || settings.height > limit) {
+                std::cerr << "[WireEngine] " << settings.width << "x" << settings.height
+                    << " exceeds the GL limit of " << limit
+                    << " px; set RenderSettings::tile_size.\n";
+            }
+            return;
+        }
+
+        t.margin = std::max(settings.tile_margin, 0);
+        t.size = std::min(settings.tile_size, limit - 2 * t.margin);
+        if (t.size <= 0) {
+            t.margin = 0;
+            t.size = std::min(settings.tile_size, limit);
+        }
+        t.enabled = true;
+
+        r.viewport.width = t.size + 2 * t.margin;
+        r.viewport.height = t.size + 2 * t.margin;
+
+        t.pixels.resize(size_t(t.size) * size_t(t.size) * 4);
+        t.band.resize(size_t(settings.width) * size_t(t.size) * 4);
+    }
+
+    static void querySceneUniforms(GLuint prog, SceneUniforms& u) {
+        u.uProj = glGetUniformLocation(prog, "uProj");
+        u.uView = glGetUniformLocation(prog, "uView");
+        u.uModel = glGetUniformLocation(prog, "uModel");
+        u.uThicknessScale = glGetUniformLocation(prog, "uThicknessScale");
+        u.uPassIndex = glGetUniformLocation(prog, "uPassIndex");
+        u.uFrameIndex = glGetUniformLocation(prog, "uFrameIndex");
+        u.uTime = glGetUniformLocation(prog, "uTime");
+        u.uSoft = glGetUniformLocation(prog, "uSoft");
+        u.uEnergy = glGetUniformLocation(prog, "uEnergyPerHit");
+        u.uSegmentOffset = glGetUniformLocation(prog, "uSegmentOffset");
+        u.uIntensityScale = glGetUniformLocation(prog, "uIntensityScale");
+        u.uSeed = glGetUniformLocation(prog, "uSeed");
+        u.uPackedSegments = glGetUniformLocation(prog, "uPackedSegments");
+        u.uPackedChunks = glGetUniformLocation(prog, "uPackedChunks");
+        u.uInstanceBase = glGetUniformLocation(prog, "uInstanceBase");
+        u.uPassFold = glGetUniformLocation(prog, "uPassFold");
+        u.uAnalytic = glGetUniformLocation(prog, "uAnalytic");
+        u.uJitterProfile = glGetUniformLocation(prog, "uJitterProfile");
+    }
+
+    // Settings the CPU side (culling, LOD, sample groups, the software
+    // backend) reads; no GL calls.
+    static void initRendererParams(Renderer& r, const RenderSettings& settings) {
+        r.viewport.frameWidth = settings.width;
+        r.viewport.frameHeight = settings.height;
+        r.viewport.width = settings.width;
+        r.viewport.height = settings.height;
+        r.viewport.halfWidth = settings.width / 2;
+        r.viewport.halfHeight = settings.height / 2;
+
+        r.exposure = settings.exposure;
+        r.bloomThreshold = settings.bloom_threshold;
+        r.bloomStrength = settings.bloom_strength;
+        r.bloomEnabled = settings.bloom_enabled;
+        r.softEdge = settings.soft_edge;
+        r.energyPerHit = settings.energy_per_hit;
+        r.thicknessScale = settings.thickness_scale;
+
+        r.baseFovYDeg = 60.0f;
+        r.baseNearPlane = 0.1f;
+        r.baseFarPlane = 3000.0f;
+
+        r.blendMode = settings.line_blend_mode;
+        r.seed32 = (uint32_t)(settings.seed ^ (settings.seed >> 32));
+
+        // The accum_passes weight stands for that many added passes, which
+        // opaque blending does not do.
+        r.analytic = settings.jitter_mode == JitterMode::Analytic;
+        if (r.analytic && r.blendMode != LineBlendMode::AdditiveLightPainting) {
+            std::cerr << "[WireEngine] JitterMode::Analytic needs additive blending; "
+                << "using Stochastic.\n";
+            r.analytic = false;
+        }
+        if (r.analytic) {
+            r.passCount = 1;
+            r.passWeight = (float)std::max(settings.accum_passes, 1);
+        }
+        else {
+            r.passCount = settings.accum_passes;
+            r.passWeight = 1.0f;
+        }
+
+        // Host staging grows on demand; only the GPU buffer is sized by the hint.
+        initStaging(r.staging, 4096);
+
+        r.geom.format = settings.instance_format;
+        r.statsCb = settings.frame_stats_cb;
+    }
+
+    static void initRenderer(Renderer& r, const RenderSettings& settings) {
+        initRendererParams(r, settings);
+        initTileGrid(r, settings);
+        r.viewport.halfWidth = r.viewport.width / 2;
+        r.viewport.halfHeight = r.viewport.height / 2;
+
+        // Programs (scene VS = common ribbon code + per-format fetch)
+        const std::string sceneVS = std::string(SCENE_VS_COMMON) +
+            (r.geom.format == InstanceFormat::PackedQuantized
+                ? SCENE_VS_PACKED : SCENE_VS_ATTRIB);
+        r.programs.scene = Utils_::createProgram(sceneVS.c_str(), SCENE_FS);
+        const std::string primitivesVS = std::string(SCENE_VS_COMMON) + SCENE_VS_PRIMITIVES;
+        r.programs.primitives = Utils_::createProgram(primitivesVS.c_str(), SCENE_FS);
+        if (!settings.shape_prototypes.empty()) {
+            const std::string shapesVS = std::string(SCENE_VS_COMMON) + SCENE_VS_SHAPES;
+            r.programs.shapes = Utils_::createProgram(shapesVS.c_str(), SCENE_FS);
+        }
+        r.programs.bright = Utils_::createProgram(Utils_::FSQ_VS, Utils_::BRIGHT_FS);
+        r.programs.blur = Utils_::createProgram(Utils_::FSQ_VS, Utils_::BLUR_FS);
+        r.programs.composite = Utils_::createProgram(Utils_::FSQ_VS, Utils_::COMPOSITE_FS);
+
+        // FBOs
+        r.fbos.hdr = Utils_::createHDRFBO(r.viewport.width, r.viewport.height);
+        r.fbos.bloomA = Utils_::createColorFBO(r.viewport.halfWidth, r.viewport.halfHeight, GL_RGBA16F);
+        r.fbos.bloomB = Utils_::createColorFBO(r.viewport.halfWidth, r.viewport.halfHeight, GL_RGBA16F);
+        r.fbos.ldr = Utils_::createColorFBO(r.viewport.width, r.viewport.height, GL_RGBA16F);
+
+        // Geometry (segment quad + fullscreen quad)
+        Utils_::makeVAO(r.geom.vaoSegment, r.geom.vboSegment,
+            Utils_::SEGMENT_QUAD, sizeof(Utils_::SEGMENT_QUAD));
+        Utils_::makeVAO(r.geom.vaoFSQ, r.geom.vboFSQ,
+            Utils_::FSQ, sizeof(Utils_::FSQ));
+
+        // Instance buffer: big chunk of segments, reused every frame.
+        r.geom.maxSegments = settings.max_line_segments_hint;
+        if (r.geom.maxSegments <= 0) {
+            r.geom.maxSegments = 1024 * 1024; // sane fallback
+        }
+
+        if (r.geom.format == InstanceFormat::PackedQuantized) {
+            glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &r.geom.maxBufferTexels);
+            if (r.geom.maxBufferTexels > 0 &&
+                r.geom.maxSegments > r.geom.maxBufferTexels / 3)
+            {
+                std::cerr << "[WireEngine] Packed instance buffer clamped to "
+                    << (r.geom.maxBufferTexels / 3)
+                    << " segments (GL_MAX_TEXTURE_BUFFER_SIZE)\n";
+                r.geom.maxSegments = r.geom.maxBufferTexels / 3;
+            }
+        }
+
+        // Persistently mapped when the driver has ARB_buffer_storage (GL 4.4
+        // core, common as an extension on 3.3 contexts); else glBufferSubData
+        // with orphaning.
+        createInstanceBuffers(r.geom.stream, r.geom.format,
+            r.geom.vaoSegment, (size_t)r.geom.maxSegments,
+            GLEW_ARB_buffer_storage != 0);
+
+        createRetainedLayers(r, settings);
+        createShapeBuffers(r, settings);
+        Utils_::makeQuadVAO(r.geom.vaoPrimitives, r.geom.vboSegment);
+
+        if (r.statsCb) {
+            glGenQueries(1, &r.timerQuery);
+        }
+        if (settings.submit_slice_ms > 0.0f) {
+            glGenQueries(2, r.pacing.queries);
+        }
+        if (r.analytic) {
+            r.jitterProfileTex = createJitterProfileTexture(settings.soft_edge);
+        }
+        if (settings.adaptive_error > 0.0f && r.passCount > 1 &&
+            r.blendMode == LineBlendMode::AdditiveLightPainting &&
+            (!settings.stream_flush_batches || r.tiles.enabled)) {
+            createAdaptiveAccum(r);
+        }
+        if (settings.splat_max_pixels > 0.0f &&
+            r.blendMode == LineBlendMode::AdditiveLightPainting) {
+            createSplatAccum(r);
+        }
+
+        // Default camera (will be overridden each frame)
+        r.proj = glm::perspective(glm::radians(r.baseFovYDeg),
+            float(r.viewport.frameWidth) / float(r.viewport.frameHeight),
+            r.baseNearPlane, r.baseFarPlane);
+        r.view = glm::lookAt(glm::vec3(0, 0, 450),
+            glm::vec3(0, 0, 0),
+            glm::vec3(0, 1, 0));
+
+        // Uniform locations
+        glUseProgram(r.programs.scene);
+        querySceneUniforms(r.programs.scene, r.sceneU);
+        glUniform1i(r.sceneU.uPackedSegments, 0); // texture units, see accumulateScene
+        glUniform1i(r.sceneU.uPackedChunks, 1);
+        glUniform1i(r.sceneU.uJitterProfile, 4);
+
+        glUseProgram(r.programs.primitives);
+        querySceneUniforms(r.programs.primitives, r.primSceneU);
+        r.uPrim = glGetUniformLocation(r.programs.primitives, "uPrim");
+        glUniform1i(r.primSceneU.uJitterProfile, 4);
+
+        if (r.programs.shapes) {
+            glUseProgram(r.programs.shapes);
+            querySceneUniforms(r.programs.shapes, r.shapeSceneU);
+            r.shapeU.uProtoFirst = glGetUniformLocation(r.programs.shapes, "uProtoFirst");
+            r.shapeU.uProtoCount = glGetUniformLocation(r.programs.shapes, "uProtoCount");
+            r.shapeU.uShapeFirst = glGetUniformLocation(r.programs.shapes, "uShapeFirst");
+            r.shapeU.uPrototypes = glGetUniformLocation(r.programs.shapes, "uPrototypes");
+            r.shapeU.uShapes = glGetUniformLocation(r.programs.shapes, "uShapes");
+            glUniform1i(r.shapeU.uPrototypes, 2); // texture units, see drawShapes
+            glUniform1i(r.shapeU.uShapes, 3);
+            glUniform1i(r.shapeSceneU.uJitterProfile, 4);
+        }
+
+        glUseProgram(r.programs.bright);
+        r.brightU.uHDRTex = glGetUniformLocation(r.programs.bright, "uHDRTex");
+        r.brightU.uExposure = glGetUniformLocation(r.programs.bright, "uExposure");
+        r.brightU.uThreshold = glGetUniformLocation(r.programs.bright, "uThreshold");
+
+        glUseProgram(r.programs.blur);
+        r.blurU.uTex = glGetUniformLocation(r.programs.blur, "uTex");
+        r.blurU.uTexelSize = glGetUniformLocation(r.programs.blur, "uTexelSize");
+        r.blurU.uDirection = glGetUniformLocation(r.programs.blur, "uDirection");
+
+        glUseProgram(r.programs.composite);
+        r.compU.uHDRTex = glGetUniformLocation(r.programs.composite, "uHDRTex");
+        r.compU.uBloomTex = glGetUniformLocation(r.programs.composite, "uBloomTex");
+        r.compU.uExposure = glGetUniformLocation(r.programs.composite, "uExposure");
+        r.compU.uBloomStrength = glGetUniformLocation(r.programs.composite, "uBloomStrength");
+
+        glUseProgram(0);
+
+        // Readback
+        initPBO(r.readback, settings.use_pbo && !r.tiles.enabled,
+            r.viewport.width, r.viewport.height);
+    }
+
+    static void destroyRenderer(Renderer& r) {
+        destroyPBO(r.readback);
+
+        if (r.timerQuery)       glDeleteQueries(1, &r.timerQuery);
+        if (r.pacing.queries[0]) glDeleteQueries(2, r.pacing.queries);
+        if (r.jitterProfileTex) glDeleteTextures(1, &r.jitterProfileTex);
+        destroyAdaptiveAccum(r);
+        destroySplatAccum(r);
+
+        destroyRetainedLayers(r);
+        destroyShapeBuffers(r.geom.shapes);
+        destroyStreamRing(r);
+        destroyInstanceBuffers(r.geom.stream);
+        if (r.geom.vboSegment)  glDeleteBuffers(1, &r.geom.vboSegment);
+        if (r.geom.vaoSegment)  glDeleteVertexArrays(1, &r.geom.vaoSegment);
+        if (r.geom.vboFSQ)      glDeleteBuffers(1, &r.geom.vboFSQ);
+        if (r.geom.vaoFSQ)      glDeleteVertexArrays(1, &r.geom.vaoFSQ);
+        if (r.geom.vaoPrimitives) glDeleteVertexArrays(1, &r.geom.vaoPrimitives);
+
+        if (r.fbos.hdr.depthRbo) glDeleteRenderbuffers(1, &r.fbos.hdr.depthRbo);
+        if (r.fbos.hdr.colorTex) glDeleteTextures(1, &r.fbos.hdr.colorTex);
+        if (r.fbos.hdr.fbo)      glDeleteFramebuffers(1, &r.fbos.hdr.fbo);
+
+        if (r.fbos.ldr.colorTex) glDeleteTextures(1, &r.fbos.ldr.colorTex);
+        if (r.fbos.ldr.fbo)      glDeleteFramebuffers(1, &r.fbos.ldr.fbo);
+
+        if (r.fbos.bloomA.colorTex) glDeleteTextures(1, &r.fbos.bloomA.colorTex);
+        if (r.fbos.bloomA.fbo)      glDeleteFramebuffers(1, &r.fbos.bloomA.fbo);
+        if (r.fbos.bloomB.colorTex) glDeleteTextures(1, &r.fbos.bloomB.colorTex);
+        if (r.fbos.bloomB.fbo)      glDeleteFramebuffers(1, &r.fbos.bloomB.fbo);
+
+        if (r.programs.scene)     glDeleteProgram(r.programs.scene);
+        if (r.programs.shapes)    glDeleteProgram(r.programs.shapes);
+        if (r.programs.primitives) glDeleteProgram(r.programs.primitives);
+        if (r.programs.bright)    glDeleteProgram(r.programs.bright);
+        if (r.programs.blur)      glDeleteProgram(r.programs.blur);
+        if (r.programs.composite) glDeleteProgram(r.programs.composite);
+    }
+
+    // ========================================================================
+    // Frame building: cache segments once per frame
+    // ========================================================================
+    static void buildFrameSegments(const RenderSettings& settings,
+        int frameIndex, float timeSec,
+        const LineCallback& getLine,
+        SegmentStaging& out)
+    {
+        resetStaging(out);
+        if (!getLine) return;
+
+        // Reuse the emit path so pull and push share one filter/grow policy.
+        LineEmitContext ctx;
+        ctx.sink = &out.sink;
+
+        int idx = 0;
+        while (true) {
+            LineParams lp{};
+            if (!getLine(frameIndex, timeSec, idx, lp)) {
+                break;
+            }
+            ++idx;
+
+            ctx.add(lp); // skips zero-thickness segments
+        }
+
+        // Optional: you could clamp to some absolute limit here if you want.
+        (void)settings;
+    }
+
+    // Batched pull: one count query, one reserve, then one callback per chunk
+    // writing straight into the staging buffer.
+    static void buildFrameSegmentsBatched(int frameIndex, float timeSec,
+        const LineCountCallback& countSegments,
+        const LineBatchCallback& fillBatch,
+        SegmentStaging& out)
+    {
+        resetStaging(out);
+        if (!fillBatch) return;
+
+        const int expected = countSegments ? countSegments(frameIndex, timeSec) : -1;
+        if (expected == 0) return;
+
+        if (expected > 0) {
+            out.sink.reserve((size_t)expected);
+        }
+
+        int first = 0;
+        while (true) {
+            size_t chunk = (size_t)PULL_BATCH_SEGMENTS;
+            if (expected > 0) {
+                if (first >= expected) break;
+                chunk = std::min(chunk, (size_t)(expected - first));
+            }
+
+            out.sink.reserve(out.sink.size + chunk);
+            std::span<LineParams> dst(out.sink.data + out.sink.size, chunk);
+
+            int written = fillBatch(frameIndex, timeSec, first, dst);
+            if (written < 0) written = 0;
+            if ((size_t)written > chunk) written = (int)chunk;
+
+            out.sink.commit((size_t)written); // skips zero-thickness segments
+            first += written;
+
+            if ((size_t)written < chunk) break;
+        }
+    }
+
+    // ========================================================================
+    // SegmentBatch (SoA) -> instance layout (AoS) interleave
+    // ========================================================================
+    // Each kernel loads one register per field for W segments, transposes
+    // W x 15(+1 pad) floats and stores W consecutive 60-byte records.
+    namespace Interleave_ {
+
+        struct Columns {
+            const float* f[15];
+        };
+
+        static Columns columnsOf(const SegmentBatch& b, size_t first) {
+            Columns c{};
+            const auto fields = b.fields();
+            for (int k = 0; k < 15; ++k) {
+                c.f[k] = fields[k]->data() + first;
+            }
+            return c;
+        }
+
+        static void scalar(const Columns& c, size_t i0, size_t i1, float* out) {
+            for (size_t i = i0; i < i1; ++i) {
+                float* o = out + i * 15;
+                for (int k = 0; k < 15; ++k) {
+                    o[k] = c.f[k][i];
+                }
+            }
+        }
+
+#if WIRE_SIMD_AVX2
+        static size_t avx2(const Columns& c, size_t n, float* out) {
+            const __m256i mask7 = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, -1, 0);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256 v[16];
+                for (int k = 0; k < 15; ++k) v[k] = _mm256_loadu_ps(c.f[k] + i);
+                v[15] = _mm256_setzero_ps();
+
+                // Two 8x8 transposes: fields 0..7 and 8..14 (+pad)
+                __m256 rows[2][8];
+                for (int g = 0; g < 2; ++g) {
+                    const __m256* r = v + g * 8;
+                    __m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+                    __m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+                    __m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+                    __m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+                    __m256 t4 = _mm256_unpacklo_ps(r[4], r[5]);
+                    __m256 t5 = _mm256_unpackhi_ps(r[4], r[5]);
+                    __m256 t6 = _mm256_unpacklo_ps(r[6], r[7]);
+                    __m256 t7 = _mm256_unpackhi_ps(r[6], r[7]);
+
+                    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+                    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+                    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+                    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+                    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+                    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+                    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+                    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+                    rows[g][0] = _mm256_permute2f128_ps(s0, s4, 0x20);
+                    rows[g][1] = _mm256_permute2f128_ps(s1, s5, 0x20);
+                    rows[g][2] = _mm256_permute2f128_ps(s2, s6, 0x20);
+                    rows[g][3] = _mm256_permute2f128_ps(s3, s7, 0x20);
+                    rows[g][4] = _mm256_permute2f128_ps(s0, s4, 0x31);
+                    rows[g][5] = _mm256_permute2f128_ps(s1, s5, 0x31);
+                    rows[g][6] = _mm256_permute2f128_ps(s2, s6, 0x31);
+                    rows[g][7] = _mm256_permute2f128_ps(s3, s7, 0x31);
+                }
+
+                float* o = out + i * 15;
+                for (int s = 0; s < 8; ++s) {
+                    _mm256_storeu_ps(o + s * 15, rows[0][s]);
+                    _mm256_maskstore_ps(o + s * 15 + 8, mask7, rows[1][s]);
+                }
+            }
+            return i;
+        }
+#endif
+
+#if WIRE_SIMD_SSE && !WIRE_SIMD_AVX2
+        static size_t sse(const Columns& c, size_t n, float* out) {
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128 v[16];
+                for (int k = 0; k < 15; ++k) v[k] = _mm_loadu_ps(c.f[k] + i);
+                v[15] = _mm_setzero_ps();
+
+                // Four 4x4 transposes: v[4g + s] becomes fields 4g..4g+3 of segment s
+                for (int g = 0; g < 4; ++g) {
+                    _MM_TRANSPOSE4_PS(v[g * 4 + 0], v[g * 4 + 1],
+                        v[g * 4 + 2], v[g * 4 + 3]);
+                }
+
+                float* o = out + i * 15;
+                for (int s = 0; s < 4; ++s) {
+                    float* rec = o + s * 15;
+                    _mm_storeu_ps(rec + 0, v[0 + s]);
+                    _mm_storeu_ps(rec + 4, v[4 + s]);
+                    _mm_storeu_ps(rec + 8, v[8 + s]);
+                    // fields 12..14 (3 floats, do not touch the next record)
+                    _mm_storel_pi(reinterpret_cast<__m64*>(rec + 12), v[12 + s]);
+                    _mm_store_ss(rec + 14, _mm_movehl_ps(v[12 + s], v[12 + s]));
+                }
+            }
+            return i;
+        }
+#endif
+
+    } // namespace Interleave_
+
+    void interleaveSegmentBatch(const SegmentBatch& batch,
+        std::size_t first, std::size_t n, LineParams* out)
+    {
+        if (n == 0) return;
+
+        const Interleave_::Columns cols = Interleave_::columnsOf(batch, first);
+        float* dst = reinterpret_cast<float*>(out);
+
+        size_t done = 0;
+#if WIRE_SIMD_AVX2
+        done = Interleave_::avx2(cols, n, dst);
+#elif WIRE_SIMD_SSE
+        done = Interleave_::sse(cols, n, dst);
+#endif
+        Interleave_::scalar(cols, done, n, dst);
+    }
+
+    // ========================================================================
+    // Counter-based RNG fill (rngFill)
+    // ========================================================================
+    namespace Rng_ {
+
+        static void scalar(RngKey key, uint32_t first, size_t i0, size_t i1,
+            float* out, float lo, float scale)
+        {
+            for (size_t i = i0; i < i1; ++i) {
+                out[i] = lo + scale * rngFloat01(key, first + (uint32_t)i);
+            }
+        }
+
+#if WIRE_SIMD_AVX2
+        static __m256i hash8(__m256i x) {
+            const __m256i m0 = _mm256_set1_epi32(0x7feb352d);
+            const __m256i m1 = _mm256_set1_epi32((int)0x846ca68bu);
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+            x = _mm256_mullo_epi32(x, m0);
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+            x = _mm256_mullo_epi32(x, m1);
+            x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+            return x;
+        }
+
+        static size_t avx2(RngKey key, uint32_t first, size_t n,
+            float* out, float lo, float scale)
+        {
+            const __m256i klo = _mm256_set1_epi32((int)key.lo);
+            const __m256i khi = _mm256_set1_epi32((int)key.hi);
+            const __m256  unit = _mm256_set1_ps(1.0f / 16777216.0f);
+            const __m256  vlo = _mm256_set1_ps(lo);
+            const __m256  vscale = _mm256_set1_ps(scale);
+            __m256i idx = _mm256_add_epi32(_mm256_set1_epi32((int)first),
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            const __m256i step = _mm256_set1_epi32(8);
+
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                __m256i h = hash8(_mm256_add_epi32(hash8(_mm256_xor_si256(idx, klo)), khi));
+                __m256 f = _mm256_mul_ps(
+                    _mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8)), unit);
+                _mm256_storeu_ps(out + i, _mm256_add_ps(vlo, _mm256_mul_ps(vscale, f)));
+                idx = _mm256_add_epi32(idx, step);
+            }
+            return i;
+        }
+#endif
+
+#if WIRE_SIMD_SSE && !WIRE_SIMD_AVX2
+        // SSE2 has no 32-bit mullo: two 32x32->64 multiplies, keep low halves.
+        static __m128i mullo4(__m128i a, __m128i b) {
+            __m128i even = _mm_mul_epu32(a, b);
+            __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+            return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+
+        static __m128i hash4(__m128i x) {
+            const __m128i m0 = _mm_set1_epi32(0x7feb352d);
+            const __m128i m1 = _mm_set1_epi32((int)0x846ca68bu);
+            x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+            x = mullo4(x, m0);
+            x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+            x = mullo4(x, m1);
+            x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+            return x;
+        }
+
+        static size_t sse(RngKey key, uint32_t first, size_t n,
+            float* out, float lo, float scale)
+        {
+            const __m128i klo = _mm_set1_epi32((int)key.lo);
+            const __m128i khi = _mm_set1_epi32((int)key.hi);
+            const __m128  unit = _mm_set1_ps(1.0f / 16777216.0f);
+            const __m128  vlo = _mm_set1_ps(lo);
+            const __m128  vscale = _mm_set1_ps(scale);
+            __m128i idx = _mm_add_epi32(_mm_set1_epi32((int)first),
+                _mm_setr_epi32(0, 1, 2, 3));
+            const __m128i step = _mm_set1_epi32(4);
+
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                __m128i h = hash4(_mm_add_epi32(hash4(_mm_xor_si128(idx, klo)), khi));
+                __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)), unit);
+                _mm_storeu_ps(out + i, _mm_add_ps(vlo, _mm_mul_ps(vscale, f)));
+                idx = _mm_add_epi32(idx, step);
+            }
+            return i;
+        }
+#endif
+
+    } // namespace Rng_
+
+    void rngFill(RngKey key, std::uint32_t firstIndex,
+        float* out, std::size_t n, float lo, float hi)
+    {
+        if (n == 0) return;
+        const float scale = hi - lo;
+
+        size_t done = 0;
+#if WIRE_SIMD_AVX2
+        done = Rng_::avx2(key, firstIndex, n, out, lo, scale);
+#elif WIRE_SIMD_SSE
+        done = Rng_::sse(key, firstIndex, n, out, lo, scale);
+#endif
+        Rng_::scalar(key, firstIndex, done, n, out, lo, scale);
+    }
+
+    // ========================================================================
+    // Culling (per-frame segments, before upload)
+    // ========================================================================
+    // Six frustum planes in SoA form, padded to 8 lanes with planes that
+    // never reject (n = 0, d = 1). A point p is inside plane i when
+    // n_i . p + d_i >= 0.
+    struct CullPlanes {
+        alignas(32) float nx[8];
+        alignas(32) float ny[8];
+        alignas(32) float nz[8];
+        alignas(32) float d[8];
+    };
+
+    static CullPlanes frustumPlanes(const glm::mat4& viewProj) {
+        // Gribb / Hartmann: rows of the clip matrix
+        const glm::mat4 m = glm::transpose(viewProj);
+        const glm::vec4 planes[6] = {
+            m[3] + m[0], m[3] - m[0],   // left, right
+            m[3] + m[1], m[3] - m[1],   // bottom, top
+            m[3] + m[2], m[3] - m[2]    // near, far
+        };
+
+        CullPlanes cp{};
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 pl(0.0f, 0.0f, 0.0f, 1.0f);
+            if (i < 6) {
+                const float len = glm::length(glm::vec3(planes[i]));
+                pl = len > 0.0f ? planes[i] / len : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            }
+            cp.nx[i] = pl.x; cp.ny[i] = pl.y; cp.nz[i] = pl.z; cp.d[i] = pl.w;
+        }
+        return cp;
+    }
+
+    namespace Cull_ {
+
+        // True when the segment, widened by 'radius', is outside some plane
+        // (both endpoints behind it). All planes are tested at once.
+        static bool outsideFrustum(const CullPlanes& cp,
+            const LineInstanceGPU& s, float radius)
+        {
+#if WIRE_SIMD_AVX2
+            const __m256 nx = _mm256_load_ps(cp.nx), ny = _mm256_load_ps(cp.ny);
+            const __m256 nz = _mm256_load_ps(cp.nz), d = _mm256_load_ps(cp.d);
+            __m256 d0 = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(nx, _mm256_set1_ps(s.start_x)),
+                _mm256_mul_ps(ny, _mm256_set1_ps(s.start_y))),
+                _mm256_add_ps(_mm256_mul_ps(nz, _mm256_set1_ps(s.start_z)), d));
+            __m256 d1 = _mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(nx, _mm256_set1_ps(s.end_x)),
+                _mm256_mul_ps(ny, _mm256_set1_ps(s.end_y))),
+                _mm256_add_ps(_mm256_mul_ps(nz, _mm256_set1_ps(s.end_z)), d));
+            __m256 out = _mm256_cmp_ps(_mm256_max_ps(d0, d1),
+                _mm256_set1_ps(-radius), _CMP_LT_OQ);
+            return _mm256_movemask_ps(out) != 0;
+#elif WIRE_SIMD_SSE
+            const __m128 r = _mm_set1_ps(-radius);
+            const __m128 sx = _mm_set1_ps(s.start_x), sy = _mm_set1_ps(s.start_y);
+            const __m128 sz = _mm_set1_ps(s.start_z);
+            const __m128 ex = _mm_set1_ps(s.end_x), ey = _mm_set1_ps(s.end_y);
+            const __m128 ez = _mm_set1_ps(s.end_z);
+            for (int g = 0; g < 8; g += 4) {
+                const __m128 nx = _mm_load_ps(cp.nx + g), ny = _mm_load_ps(cp.ny + g);
+                const __m128 nz = _mm_load_ps(cp.nz + g), d = _mm_load_ps(cp.d + g);
+                __m128 d0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, sx), _mm_mul_ps(ny, sy)),
+                    _mm_add_ps(_mm_mul_ps(nz, sz), d));
+                __m128 d1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, ex), _mm_mul_ps(ny, ey)),
+                    _mm_add_ps(_mm_mul_ps(nz, ez), d));
+                if (_mm_movemask_ps(_mm_cmplt_ps(_mm_max_ps(d0, d1), r)) != 0) return true;
+            }
+            return false;
+#else
+            for (int i = 0; i < 6; ++i) {
+                float d0 = cp.nx[i] * s.start_x + cp.ny[i] * s.start_y + cp.nz[i] * s.start_z + cp.d[i];
+                float d1 = cp.nx[i] * s.end_x + cp.ny[i] * s.end_y + cp.nz[i] * s.end_z + cp.d[i];
+                if (std::max(d0, d1) < -radius) return true;
+            }
+            return false;
+#endif
+        }
+
+        // Distance from the world origin to the segment (SCENE_FS attenuates
+        // by distance to the origin, not to the camera).
+        static float originDistance(const LineInstanceGPU& s) {
+            const glm::vec3 a(s.start_x, s.start_y, s.start_z);
+            const glm::vec3 ab = glm::vec3(s.end_x, s.end_y, s.end_z) - a;
+            const float len2 = glm::dot(ab, ab);
+            float t = len2 > 0.0f ? -glm::dot(a, ab) / len2 : 0.0f;
+            t = std::min(std::max(t, 0.0f), 1.0f);
+            return glm::length(a + ab * t);
+        }
+
+    } // namespace Cull_
+
+    // Compacts 'st' in place (order kept) and counts what was dropped.
+    static void cullSegments(const Renderer& r, const RenderSettings& settings,
+        SegmentStaging& st, FrameStats& stats)
+    {
+        const bool frustum = settings.frustum_cull;
+        const bool energy = settings.contribution_cull_quanta > 0.0f;
+        if (!frustum && !energy) return;
+
+        const CullPlanes planes = frustumPlanes(r.proj * r.view);
+
+        // Output is gamma(1 - exp(-hdr * exposure)); below the linear value
+        // of 'quanta' 8-bit steps a pixel never leaves zero. For small hdr
+        // 1 - exp(-x) ~ x, which only overestimates the output.
+        const float quantum = std::pow(settings.contribution_cull_quanta / 255.0f, 2.2f);
+        const float perSegment = r.energyPerHit * r.exposure *
+            (float)std::max(settings.accum_passes, 1);
+
+        LineInstanceGPU* data = st.sink.data;
+        const size_t n = st.sink.size;
+        size_t kept = 0;
+        PositionRemap remap(st);
+
+        for (size_t i = 0; i < n; ++i) {
+            remap.at(i, kept);
+
+            const LineInstanceGPU& s = data[i];
+            const float reach = s.thickness * r.thicknessScale + s.jitter;
+
+            if (frustum && Cull_::outsideFrustum(planes, s, reach)) {
+                ++stats.culled_frustum;
+                continue;
+            }
+
+            if (energy) {
+                const float peakColor = std::max(
+                    std::max(std::max(s.start_r, s.start_g), s.start_b),
+                    std::max(std::max(s.end_r, s.end_g), s.end_b));
+                const float dist = std::max(Cull_::originDistance(s) - reach, 0.0f);
+                const float atten = 1.0f / (1.0f + 0.0008f * dist * dist);
+                const float peak = peakColor * std::max(s.intensity, 1.0f) *
+                    perSegment * atten;
+                if (peak < quantum) {
+                    ++stats.culled_contribution;
+                    continue;
+                }
+            }
+
+            if (kept != i) data[kept] = s;
+            ++kept;
+        }
+
+        remap.finish(kept);
+        st.sink.size = kept;
+    }
+
+    // ------------------------------------------------------------------------
+    // Screen-space LOD (RenderSettings::lod_merge_pixels)
+    // ------------------------------------------------------------------------
+    namespace Lod_ {
+
+        // Threshold in effect at segment i; i must not decrease.
+        struct Cursor {
+            const std::vector<LodMark>& marks;
+            float defaultPixels;
+            size_t next = 0;
+            float pixels;
+
+            Cursor(const std::vector<LodMark>& m, float def)
+                : marks(m), defaultPixels(def), pixels(def) {}
+
+            float at(size_t i) {
+                while (next < marks.size() && marks[next].first <= i) {
+                    const float px = marks[next++].pixels;
+                    pixels = px < 0.0f ? defaultPixels : px;
+                }
+                return pixels;
+            }
+        };
+
+        struct Projector {
+            glm::mat4 viewProj;
+            glm::vec2 halfViewport;
+
+            // Pixel position; false when behind the camera.
+            bool project(const glm::vec3& p, glm::vec2& out) const {
+                const glm::vec4 c = viewProj * glm::vec4(p, 1.0f);
+                if (c.w <= 1e-4f) return false;
+                out = glm::vec2(c.x, c.y) / c.w * halfViewport;
+                return true;
+            }
+        };
+
+        static glm::vec3 startOf(const LineInstanceGPU& s) { return { s.start_x, s.start_y, s.start_z }; }
+        static glm::vec3 endOf(const LineInstanceGPU& s) { return { s.end_x, s.end_y, s.end_z }; }
+
+        static bool similar(float a, float b) {
+            return std::fabs(a - b) <= 0.25f * std::max(std::fabs(a), std::fabs(b)) + 1e-6f;
+        }
+
+    } // namespace Lod_
+
+    // Merges chains in place (order kept); LOD marks are remapped.
+    static void lodMergeSegments(const Renderer& r, const RenderSettings& settings,
+        SegmentStaging& st, FrameStats& stats)
+    {
+        bool any = settings.lod_merge_pixels > 0.0f;
+        for (const LodMark& m : st.lodMarks) any = any || m.pixels > 0.0f;
+        if (!any) return;
+
+        const Lod_::Projector proj{ r.proj * r.view,
+            glm::vec2(0.5f * r.viewport.frameWidth, 0.5f * r.viewport.frameHeight) };
+        const float minCos = std::cos(glm::radians(
+            std::min(std::max(settings.lod_merge_max_angle_deg, 0.0f), 90.0f)));
+
+        // The cursor reads marks that the remap rewrites behind it; a
+        // rewritten mark only moves down to a slot <= its input index, so
+        // the cursor still sees every mark at the right time.
+        Lod_::Cursor cursor(st.lodMarks, std::max(settings.lod_merge_pixels, 0.0f));
+        PositionRemap remap(st);
+
+        LineInstanceGPU* data = st.sink.data;
+        const size_t n = st.sink.size;
+        size_t out = 0;
+        size_t i = 0;
+
+        while (i < n) {
+            remap.at(i, out);
+
+            LineInstanceGPU cur = data[i];
+            const float px = cursor.at(i);
+
+            glm::vec2 screenStart;
+            size_t j = i + 1;
+            if (px > 0.0f && proj.project(Lod_::startOf(cur), screenStart)) {
+                glm::vec3 a = Lod_::startOf(cur);
+                float chainLen = glm::length(Lod_::endOf(cur) - a);
+                float intensityLen = cur.intensity * chainLen;
+
+                while (j < n && !remap.boundaryUpTo(j) && cursor.at(j) == px) {
+                    const LineInstanceGPU& nx = data[j];
+                    const glm::vec3 joint = Lod_::endOf(cur);
+                    const glm::vec3 b0 = Lod_::startOf(nx);
+                    const glm::vec3 b1 = Lod_::endOf(nx);
+                    const float segLen = glm::length(b1 - b0);
+
+                    const glm::vec3 gap = b0 - joint;
+                    const float tol = 1e-4f * (chainLen + segLen) + 1e-6f;
+                    if (glm::dot(gap, gap) > tol * tol) break;
+                    if (!Lod_::similar(cur.thickness, nx.thickness) ||
+                        !Lod_::similar(cur.jitter, nx.jitter)) break;
+
+                    const glm::vec3 chord = joint - a;
+                    const float chordLen = glm::length(chord);
+                    if (chordLen > 0.0f && segLen > 0.0f &&
+                        glm::dot(chord, b1 - b0) < minCos * chordLen * segLen) break;
+
+                    glm::vec2 screenEnd;
+                    if (!proj.project(b1, screenEnd) ||
+                        glm::length(screenEnd - screenStart) > px) break;
+
+                    cur.end_x = nx.end_x; cur.end_y = nx.end_y; cur.end_z = nx.end_z;
+                    cur.end_r = nx.end_r; cur.end_g = nx.end_g; cur.end_b = nx.end_b;
+                    chainLen += segLen;
+                    intensityLen += nx.intensity * segLen;
+                    ++j;
+                }
+
+                if (j > i + 1) {
+                    // Same energy per chain: the chord is a bit shorter than
+                    // the chain it replaces, so brighten by the ratio.
+                    const float chordLen = glm::length(Lod_::endOf(cur) - a);
+                    if (chainLen > 0.0f) cur.intensity = intensityLen / chainLen;
+                    if (chordLen > 0.0f) {
+                        const float k = std::min(chainLen / chordLen, 4.0f);
+                        cur.start_r *= k; cur.start_g *= k; cur.start_b *= k;
+                        cur.end_r *= k;   cur.end_g *= k;   cur.end_b *= k;
+                    }
+                    stats.lod_merged += j - i - 1;
+                }
+            }
+
+            data[out++] = cur;
+            i = j;
+        }
+
+        remap.finish(out);
+        st.sink.size = out;
+    }
+
+    // ------------------------------------------------------------------------
+    // Sample budget (RenderSettings::sample_budget)
+    // ------------------------------------------------------------------------
+    static SampleGroup& sampleGroup(std::vector<SampleGroup>& groups, int samples) {
+        for (SampleGroup& g : groups) {
+            if (g.samples == samples) return g;
+        }
+        groups.push_back(SampleGroup{});
+        groups.back().samples = samples;
+        return groups.back();
+    }
+
+    // Moves the segments that need fewer than accum_passes passes (jitter
+    // 0, or a set_samples mark) out of 'st' into r.sampleGroups. The rest
+    // keeps its order; marks are remapped.
+    static void splitSampleGroups(Renderer& r, const RenderSettings& settings,
+        SegmentStaging& st, FrameStats& stats)
+    {
+        for (SampleGroup& g : r.sampleGroups) g.segments.clear();
+
+        // Opaque passes overwrite each other: one pass at accum_passes
+        // times the energy would not look like accum_passes of them.
+        const int passes = r.passCount;
+        if (!settings.sample_budget || passes <= 1 ||
+            r.blendMode != LineBlendMode::AdditiveLightPainting) return;
+
+        LineInstanceGPU* data = st.storage.data();
+        const size_t n = st.size();
+
+        // Marks are read before remap.at() rewrites them.
+        PositionRemap remap(st);
+        size_t nextMark = 0;
+        int marked = passes;
+        size_t out = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            while (nextMark < st.sampleMarks.size() && st.sampleMarks[nextMark].first <= i) {
+                const int m = st.sampleMarks[nextMark++].samples;
+                marked = (m <= 0) ? passes : std::min(m, passes);
+            }
+            const int samples = (data[i].jitter == 0.0f) ? 1 : marked;
+
+            if (samples < passes) {
+                sampleGroup(r.sampleGroups, samples).segments.push_back(data[i]);
+                ++stats.sample_reduced;
+                continue;
+            }
+            remap.at(i, out);
+            if (out != i) data[out] = data[i];
+            ++out;
+        }
+
+        remap.finish(out);
+        st.sink.size = out;
+    }
+
+    // ------------------------------------------------------------------------
+    // Hairline splats (RenderSettings::splat_max_pixels)
+    // ------------------------------------------------------------------------
+    namespace Splat_ {
+
+        // Ribbon narrower than maxPixels at both ends; pixelsPerUnit is
+        // the width in pixels of one unit of thickness at clip w = 1.
+        static bool hairline(const glm::mat4& viewProj, float pixelsPerUnit,
+            float maxPixels, const LineInstanceGPU& s)
+        {
+            const float w0 = viewProj[0][3] * s.start_x + viewProj[1][3] * s.start_y +
+                viewProj[2][3] * s.start_z + viewProj[3][3];
+            const float w1 = viewProj[0][3] * s.end_x + viewProj[1][3] * s.end_y +
+                viewProj[2][3] * s.end_z + viewProj[3][3];
+            if (w0 <= 1e-4f || w1 <= 1e-4f) return false;
+            return s.thickness * pixelsPerUnit < maxPixels * std::min(w0, w1);
+        }
+
+    } // namespace Splat_
+
+    // Moves the hairlines of 'st' and of r.sampleGroups into
+    // r.splat.groups, keeping their pass counts. Runs after
+    // splitSampleGroups; the rest keeps its order, marks are remapped.
+    static void splitSplats(Renderer& r, const RenderSettings& settings,
+        SegmentStaging& st, FrameStats& stats)
+    {
+        SplatAccum& sp = r.splat;
+        for (SampleGroup& g : sp.groups) g.segments.clear();
+        if (!sp.enabled) return;
+
+        const glm::mat4 viewProj = r.proj * r.view;
+        const float pixelsPerUnit = 2.0f * r.thicknessScale * r.proj[1][1] *
+            0.5f * float(r.viewport.frameHeight);
+        const float maxPixels = settings.splat_max_pixels;
+        // JitterMode::Analytic widens jittered ribbons by the jitter.
+        const bool analytic = r.jitterProfileTex != 0;
+        auto qualifies = [&](const LineInstanceGPU& s) {
+            return (!analytic || s.jitter == 0.0f) &&
+                Splat_::hairline(viewProj, pixelsPerUnit, maxPixels, s);
+        };
+
+        std::vector<LineInstanceGPU>& full = sampleGroup(sp.groups, r.passCount).segments;
+        LineInstanceGPU* data = st.storage.data();
+        const size_t n = st.size();
+        PositionRemap remap(st);
+        size_t out = 0;
+
+        for (size_t i = 0; i < n; ++i) {
+            if (qualifies(data[i])) {
+                full.push_back(data[i]);
+                ++stats.splatted;
+                continue;
+            }
+            remap.at(i, out);
+            if (out != i) data[out] = data[i];
+            ++out;
+        }
+
+        remap.finish(out);
+        st.sink.size = out;
+
+        for (SampleGroup& g : r.sampleGroups) {
+            size_t kept = 0;
+            for (const LineInstanceGPU& s : g.segments) {
+                if (qualifies(s)) {
+                    sampleGroup(sp.groups, g.samples).segments.push_back(s);
+                    ++stats.splatted;
+                }
+                else {
+                    g.segments[kept++] = s;
+                }
+            }
+            g.segments.resize(kept);
+        }
+    }
+
+    // ========================================================================
+    // Rendering steps
+    // ========================================================================
+
+    using StatsClock = std::chrono::steady_clock;
+
+    static double msSince(StatsClock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(StatsClock::now() - t0).count();
+    }
+
+    // Let the window system process events (GLFW window only).
+    static void pollWindowEvents(const Renderer& r) {
+        if (r.windowEvents) glfwPollEvents();
+    }
+
+    static const glm::mat4 IDENTITY_MODEL(1.0f);
+
+    // Per-frame uniforms shared by the scene and shape programs (bound).
+    static void setFrameUniforms(const Renderer& r, const SceneUniforms& u,
+        int frameIndex, float timeSec)
+    {
+        glUniformMatrix4fv(u.uProj, 1, GL_FALSE, glm::value_ptr(r.proj));
+        glUniformMatrix4fv(u.uView, 1, GL_FALSE, glm::value_ptr(r.view));
+        glUniformMatrix4fv(u.uModel, 1, GL_FALSE, glm::value_ptr(IDENTITY_MODEL));
+        glUniform1f(u.uIntensityScale, r.passWeight);
+        glUniform1f(u.uThicknessScale, r.thicknessScale);
+        glUniform1i(u.uFrameIndex, frameIndex);
+        glUniform1f(u.uTime, timeSec);
+        glUniform1f(u.uSoft, r.softEdge);
+        glUniform1f(u.uEnergy, r.energyPerHit);
+        glUniform1ui(u.uSeed, r.seed32);
+        glUniform1i(u.uAnalytic, r.jitterProfileTex != 0 ? 1 : 0);
+    }
+
+    // Per-frame segments: no model transform, unit intensity (per pass).
+    static void bindStream(Renderer& r, size_t first = 0, int fold = 1) {
+        bindInstances(r, r.geom.stream, first, fold);
+        glUniformMatrix4fv(r.sceneU.uModel, 1, GL_FALSE, glm::value_ptr(IDENTITY_MODEL));
+        glUniform1f(r.sceneU.uIntensityScale, r.passWeight);
+    }
+
+    // Draw every visible retained layer for the current pass. Leaves the
+    // last layer bound; callers rebind the stream with bindStream().
+    static void drawRetainedLayers(Renderer& r) {
+        for (size_t i = 0; i < r.geom.layers.size(); ++i) {
+            RetainedLayer& layer = r.geom.layers[i];
+            const LayerState& state = r.layerStates[i];
+            if (layer.count == 0 || !state.visible || state.intensity <= 0.0f) continue;
+
+            bindInstances(r, layer.gpu);
+            glUniformMatrix4fv(r.sceneU.uModel, 1, GL_FALSE, state.transform);
+            glUniform1f(r.sceneU.uIntensityScale, state.intensity * r.passWeight);
+            glUniform1i(r.sceneU.uSegmentOffset, layer.seedBase);
+
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)layer.count);
+        }
+    }
+
+    // Draw this frame's shape placements for one pass (shape program), then
+    // switch back to the scene program.
+    static void drawShapes(const Renderer& r, int pass) {
+        const ShapeBuffers& sb = r.geom.shapes;
+        if (sb.draws.empty()) return;
+
+        glUseProgram(r.programs.shapes);
+        glUniform1i(r.shapeSceneU.uPassIndex, pass);
+        glBindVertexArray(sb.vao);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_BUFFER, sb.texPrototypes);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_BUFFER, sb.texInstances);
+        glActiveTexture(GL_TEXTURE0);
+
+        int seedBase = 0x20000000; // away from stream and layer seeds
+        for (const ShapeBuffers::Draw& d : sb.draws) {
+            const int protoCount = sb.protoCount[(size_t)d.proto];
+            glUniform1i(r.shapeU.uProtoFirst, sb.protoFirst[(size_t)d.proto]);
+            glUniform1i(r.shapeU.uProtoCount, protoCount);
+            glUniform1i(r.shapeU.uShapeFirst, d.first);
+            glUniform1i(r.shapeSceneU.uSegmentOffset, seedBase);
+
+            const GLsizei instances = (GLsizei)d.count * protoCount;
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances);
+            seedBase += instances;
+        }
+
+        glUseProgram(r.programs.scene);
+    }
+
+    // Draw this frame's parametric primitives for one pass, then switch
+    // back to the scene program.
+    static void drawPrimitives(const Renderer& r, int pass) {
+        if (r.geom.primitives.empty()) return;
+
+        glUseProgram(r.programs.primitives);
+        glUniform1i(r.primSceneU.uPassIndex, pass);
+        glBindVertexArray(r.geom.vaoPrimitives);
+
+        int seedBase = 0x30000000; // away from stream, shape and layer seeds
+        for (const PrimitiveGPU& prim : r.geom.primitives) {
+            if (prim.segments <= 0) continue;
+            glUniform4fv(r.uPrim, 9, &prim.v[0][0]);
+            glUniform1i(r.primSceneU.uSegmentOffset, seedBase);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, prim.segments);
+            seedBase += prim.segments;
+        }
+
+        glUseProgram(r.programs.scene);
+    }
+
+    // Clear the splat accumulators if the last frame (or tile) wrote them
+    // and set the splat program's per-frame uniforms.
+    static void beginSplats(Renderer& r, int frameIndex) {
+        SplatAccum& sp = r.splat;
+        sp.seedNext = 0;
+        if (sp.dirty) {
+            const GLuint zero[4] = { 0, 0, 0, 0 };
+            glBindFramebuffer(GL_FRAMEBUFFER, sp.clearFbo);
+            glClearBufferuiv(GL_COLOR, 0, zero);
+            sp.dirty = false;
+        }
+
+        glUseProgram(r.programs.splat);
+        glUniformMatrix4fv(sp.uProj, 1, GL_FALSE, glm::value_ptr(r.proj));
+        glUniformMatrix4fv(sp.uView, 1, GL_FALSE, glm::value_ptr(r.view));
+        glUniform2i(sp.uSize, r.viewport.width, r.viewport.height);
+        glUniform1f(sp.uThicknessScale, r.thicknessScale);
+        glUniform1f(sp.uSoft, r.softEdge);
+        glUniform1f(sp.uEnergy, r.energyPerHit);
+        glUniform1i(sp.uFrameIndex, frameIndex);
+        glUniform1ui(sp.uSeed, r.seed32);
+    }
+
+    // Seed base of the splatted segments, away from the other seeds.
+    static const size_t SPLAT_SEED_BASE = 0x50000000;
+
+    // r.splat.groups into the accumulators, each group for all of its
+    // passes at accum_passes' energy (adaptive_error does not stop them,
+    // resolveSplats undoes hdrScale). Uploaded in pieces of at most
+    // geom.maxSegments segments.
+    static void drawSplats(Renderer& r, FrameStats& stats) {
+        SplatAccum& sp = r.splat;
+        if (!sp.enabled) return;
+
+        glUseProgram(r.programs.splat);
+        glBindImageTexture(0, sp.accumTex, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+
+        const size_t piece = (size_t)r.geom.maxSegments;
+        for (const SampleGroup& g : sp.groups) {
+            if (g.segments.empty()) continue;
+
+            const int passes = std::max(g.samples, 1);
+            glUniform1i(sp.uPasses, passes);
+            glUniform1f(sp.uIntensityScale,
+                r.passWeight * float(r.passCount) / float(passes));
+            // Within the 65535 work groups every implementation allows.
+            const size_t perDispatch = std::max<size_t>(
+                size_t(65535) * SPLAT_GROUP_SIZE / (size_t)passes, 1);
+
+            for (size_t offset = 0; offset < g.segments.size(); offset += piece) {
+                const size_t n = std::min(piece, g.segments.size() - offset);
+                const size_t bytes = n * sizeof(LineInstanceGPU);
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, sp.buffer);
+                glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)bytes,
+                    g.segments.data() + offset, GL_STREAM_DRAW);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sp.buffer);
+                stats.upload_bytes += bytes;
+
+                glUniform1i(sp.uSegmentOffset, (int)(SPLAT_SEED_BASE + sp.seedNext + offset));
+                for (size_t first = 0; first < n; first += perDispatch) {
+                    const size_t count = std::min(perDispatch, n - first);
+                    const size_t items = count * (size_t)passes;
+                    glUniform1i(sp.uFirst, (int)first);
+                    glUniform1i(sp.uCount, (int)count);
+                    glDispatchCompute((GLuint)((items + SPLAT_GROUP_SIZE - 1) / SPLAT_GROUP_SIZE),
+                        1, 1);
+                }
+            }
+            sp.seedNext += g.segments.size();
+            sp.dirty = true;
+        }
+
+        glUseProgram(r.programs.scene);
+    }
+
+    // Add the accumulators to fbos.hdr (scene state as beginScene left it).
+    static void resolveSplats(Renderer& r) {
+        SplatAccum& sp = r.splat;
+        if (!sp.dirty) return;
+
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        glUseProgram(r.programs.splatResolve);
+        glUniform1f(sp.uResolveScale, 1.0f / (SPLAT_FIXED_SCALE * r.hdrScale));
+        glBindVertexArray(r.geom.vaoFSQ);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sp.accumTex);
+        glActiveTexture(GL_TEXTURE0);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glUseProgram(r.programs.scene);
+    }
+
+    // 1) Accumulate segment ribbons into HDR FBO
+    //
+    // beginScene / endScene bracket a frame's accumulation; in between,
+    // the per-frame segments are either drawn pass by pass
+    // (accumulateScene) or batch by batch as the callback flushes them
+    // (streamBatch, RenderSettings::stream_flush_batches). Additive
+    // accumulation does not depend on the order, so both give the same
+    // image up to float rounding.
+    static void beginScene(Renderer& r, int frameIndex, float timeSec) {
+        if (r.splat.enabled) beginSplats(r, frameIndex);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.hdr.fbo);
+        glViewport(0, 0, r.viewport.width, r.viewport.height);
+
+        glClearColor(0, 0, 0, 1);
+        if (r.adaptive.enabled) {
+            const GLenum both[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+            glDrawBuffers(2, both);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        }
+        else {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+        r.hdrScale = 1.0f;
+
+        if (r.blendMode == LineBlendMode::AdditiveLightPainting) {
+            glDisable(GL_DEPTH_TEST);
+            glDepthMask(GL_FALSE);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+        }
+        else {
+            glEnable(GL_DEPTH_TEST);
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+        }
+
+        if (r.jitterProfileTex) {
+            glActiveTexture(GL_TEXTURE4);
+            glBindTexture(GL_TEXTURE_2D, r.jitterProfileTex);
+            glActiveTexture(GL_TEXTURE0);
+        }
+
+        glUseProgram(r.programs.scene);
+        setFrameUniforms(r, r.sceneU, frameIndex, timeSec);
+    }
+
+    static void endScene() {
+        glBindVertexArray(0);
+        glDisable(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
         glDepthMask(GL_FALSE);
     }
 
-    // 2) Bloom
-    static void applyBloom(Renderer& r) {
-        const int hw = r.viewport.halfWidth;
-        const int hh = r.viewport.halfHeight;
+    // Upload this frame's shapes and primitives, set their programs up.
+    static void prepareExtras(Renderer& r, const SegmentStaging& frame,
+        int frameIndex, float timeSec, FrameStats& stats)
+    {
+        stats.upload_bytes += uploadShapes(r, frame.shapes);
+
+        r.geom.primitives.clear();
+        for (const ParametricPrimitive& prim : frame.primitives) {
+            r.geom.primitives.push_back(toPrimitiveGPU(prim));
+        }
+        stats.upload_bytes += r.geom.primitives.size() * sizeof(PrimitiveGPU::v);
+        if (!r.geom.primitives.empty()) {
+            glUseProgram(r.programs.primitives);
+            setFrameUniforms(r, r.primSceneU, frameIndex, timeSec);
+        }
+        if (r.programs.shapes) {
+            glUseProgram(r.programs.shapes);
+            setFrameUniforms(r, r.shapeSceneU, frameIndex, timeSec);
+        }
+        glUseProgram(r.programs.scene);
+    }
+
+    static bool hasExtras(const Renderer& r) {
+        return !r.geom.layers.empty() || !r.geom.shapes.draws.empty() ||
+            !r.geom.primitives.empty();
+    }
+
+    // Layers, shapes and primitives for one pass (uPassIndex already set).
+    static void drawExtras(Renderer& r, int pass) {
+        drawRetainedLayers(r);
+        drawShapes(r, pass);
+        drawPrimitives(r, pass);
+    }
+
+    static void beginTimer(const Renderer& r) {
+        if (r.statsCb) glBeginQuery(GL_TIME_ELAPSED, r.timerQuery);
+    }
+
+    static void endTimer(const Renderer& r, FrameStats& stats) {
+        if (!r.statsCb) return;
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(r.timerQuery, GL_QUERY_RESULT, &ns);
+        stats.draw_ms += double(ns) * 1.0e-6;
+    }
+
+    // Start of a frame's accumulation: pick up the last measurement if the
+    // GPU has it, and time this frame ('measure') unless one is still
+    // outstanding.
+    static void beginPacing(Renderer& r, bool measure = true) {
+        SubmitPacing& p = r.pacing;
+        p.sliceNs = 0.0;
+        p.passesSinceYield = YIELD_EVERY_PASSES - 1; // yield after the first pass
+        if (!p.queries[0]) return;
+
+        if (p.pending) {
+            GLint ready = 0;
+            glGetQueryObjectiv(p.queries[1], GL_QUERY_RESULT_AVAILABLE, &ready);
+            if (!ready) return;
+
+            GLuint64 t0 = 0, t1 = 0;
+            glGetQueryObjectui64v(p.queries[0], GL_QUERY_RESULT, &t0);
+            glGetQueryObjectui64v(p.queries[1], GL_QUERY_RESULT, &t1);
+            if (p.pendingInstances > 0 && t1 > t0) {
+                const double ns = double(t1 - t0) / double(p.pendingInstances);
+                p.nsPerInstance = (p.nsPerInstance > 0.0)
+                    ? 0.75 * p.nsPerInstance + 0.25 * ns : ns;
+            }
+            p.pending = false;
+        }
+        if (!measure) return;
+
+        glQueryCounter(p.queries[0], GL_TIMESTAMP);
+        p.measuring = true;
+        p.instances = 0;
+    }
+
+    static void endPacing(Renderer& r) {
+        SubmitPacing& p = r.pacing;
+        if (!p.measuring) return;
+        glQueryCounter(p.queries[1], GL_TIMESTAMP);
+        p.measuring = false;
+        p.pending = true;
+        p.pendingInstances = p.instances;
+    }
+
+    // After each submitted group: flush and poll window events every
+    // submit_slice_ms of estimated GPU work, or every YIELD_EVERY_PASSES
+    // passes without an estimate.
+    static void paceSubmit(Renderer& r, const RenderSettings& settings,
+        size_t instances, int passes)
+    {
+        SubmitPacing& p = r.pacing;
+        if (p.measuring) p.instances += instances;
+
+        bool yield;
+        if (settings.submit_slice_ms > 0.0f && p.nsPerInstance > 0.0) {
+            p.sliceNs += double(instances) * p.nsPerInstance;
+            yield = p.sliceNs >= double(settings.submit_slice_ms) * 1.0e6;
+        }
+        else {
+            p.passesSinceYield += passes;
+            yield = p.passesSinceYield >= YIELD_EVERY_PASSES;
+        }
+
+        if (yield) {
+            pollWindowEvents(r);
+            glFlush();
+            p.sliceNs = 0.0;
+            p.passesSinceYield = 0;
+        }
+    }
+
+    // Passes per stream draw of 'count' segments (RenderSettings::
+    // passes_per_draw), kept so the instance count fits a GLsizei.
+    static int passesPerDraw(const Renderer& r, const RenderSettings& settings,
+        size_t count, int passes)
+    {
+        passes = std::max(passes, 1);
+        int fold = settings.passes_per_draw;
+        if (fold <= 0) {
+            fold = passes;
+            const double nsPer = r.pacing.nsPerInstance;
+            if (settings.submit_slice_ms > 0.0f && nsPer > 0.0 && count > 0) {
+                const double fit = double(settings.submit_slice_ms) * 1.0e6 /
+                    (double(count) * nsPer);
+                fold = (int)std::min(fit, double(passes));
+            }
+        }
+        fold = std::clamp(fold, 1, passes);
+        if (count > 0) {
+            const size_t maxFold = (size_t)std::numeric_limits<GLsizei>::max() / count;
+            fold = (int)std::min((size_t)fold, std::max(maxFold, (size_t)1));
+        }
+        return fold;
+    }
+
+    // Passes firstPass .. firstPass + fold - 1 of stream instances
+    // first .. first + count in one draw.
+    static void drawStreamPasses(Renderer& r, size_t first, size_t count,
+        size_t seedBase, int firstPass, int fold, float intensityScale = 1.0f)
+    {
+        bindStream(r, first, fold);
+        if (intensityScale != 1.0f) {
+            glUniform1f(r.sceneU.uIntensityScale, intensityScale * r.passWeight);
+        }
+        glUniform1i(r.sceneU.uSegmentOffset, (int)seedBase);
+        glUniform1i(r.sceneU.uPassIndex, firstPass);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)(count * (size_t)fold));
+    }
+
+    // Ring pieces per stream buffer: with several in flight, writing one
+    // overlaps the GPU drawing the others.
+    static const size_t STREAM_RING_REGIONS = 4;
+
+    // Upload src[0 .. n) once through the stream ring and draw each piece
+    // for passes 0 .. passes - 1 right away (intensity scaled by
+    // intensityScale). Piece k is seeded as segment seedBase + (its offset
+    // in src), so the jitter matches a frame drawn from one buffer.
+    static void streamSegments(Renderer& r, const RenderSettings& settings,
+        const LineInstanceGPU* src, size_t n, size_t seedBase, FrameStats& stats,
+        int passes, float intensityScale = 1.0f)
+    {
+        const size_t capacity = (size_t)r.geom.maxSegments;
+        size_t piece = capacity / STREAM_RING_REGIONS /
+            PACKED_CHUNK_SEGMENTS * PACKED_CHUNK_SEGMENTS;
+        piece = std::min(capacity, std::max(piece, (size_t)PACKED_CHUNK_SEGMENTS));
+
+        const bool timed = (bool)r.statsCb;
+        size_t offset = 0;
+        while (offset < n) {
+            const size_t count = std::min(piece, n - offset);
+
+            StatsClock::time_point t0 = StatsClock::now();
+            const size_t first = reserveStream(r, count);
+            stats.upload_bytes += uploadInstances(r, r.geom.stream,
+                src + offset, count, first);
+            if (timed) stats.upload_ms += msSince(t0);
+
+            const int fold = passesPerDraw(r, settings, count, passes);
+            for (int pass = 0; pass < passes; pass += fold) {
+                const int k = std::min(fold, passes - pass);
+                drawStreamPasses(r, first, count, seedBase + offset, pass, k,
+                    intensityScale);
+                paceSubmit(r, settings, count * (size_t)k, k);
+            }
+            fenceStreamRange(r, first, count);
+            glFlush();
+
+            offset += count;
+        }
+    }
+
+    // Seed base of the sample groups, away from the per-frame stream.
+    static const size_t SAMPLE_GROUP_SEED_BASE = 0x10000000;
+
+    // r.sampleGroups through the stream ring, behind what the upload-once
+    // path keeps resident ('residentEnd'), weighted as 'passes' passes.
+    static void drawSampleGroups(Renderer& r, const RenderSettings& settings,
+        size_t residentEnd, int passes, FrameStats& stats)
+    {
+        const size_t aligned = (residentEnd + PACKED_CHUNK_SEGMENTS - 1) /
+            PACKED_CHUNK_SEGMENTS * PACKED_CHUNK_SEGMENTS;
+        r.ring.head = std::max(r.ring.head, aligned);
+
+        size_t seedBase = SAMPLE_GROUP_SEED_BASE + r.streamedSegments;
+        for (const SampleGroup& g : r.sampleGroups) {
+            if (g.segments.empty()) continue;
+            const float scale = float(passes) / float(g.samples);
+            streamSegments(r, settings, g.segments.data(), g.segments.size(),
+                seedBase, stats, g.samples, scale);
+            seedBase += g.segments.size();
+        }
+    }
+
+    // RenderSettings::adaptive_error after an even number of 'passes':
+    // the adaptive_percentile of the lit tiles' noise is below the target.
+    // Leaves the scene state as beginScene set it.
+    static bool adaptiveConverged(Renderer& r, const RenderSettings& settings,
+        int passes)
+    {
+        AdaptiveAccum& a = r.adaptive;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, a.tiles.fbo);
+        glViewport(0, 0, a.tilesX, a.tilesY);
+        glDisable(GL_BLEND);
+
+        glUseProgram(r.programs.tileError);
+        glBindVertexArray(r.geom.vaoFSQ);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, r.fbos.hdr.colorTex);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, a.oddTex);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform2i(a.uSize, r.viewport.width, r.viewport.height);
+        glUniform1f(a.uScale, float(r.passCount) / float(passes));
+        glUniform1f(a.uExposure, r.exposure);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        glReadPixels(0, 0, a.tilesX, a.tilesY, GL_RED, GL_FLOAT, a.errors.data());
+
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.hdr.fbo);
+        glViewport(0, 0, r.viewport.width, r.viewport.height);
+        glEnable(GL_BLEND);
+        glUseProgram(r.programs.scene);
+
+        const auto unlit = std::remove_if(a.errors.begin(), a.errors.end(),
+            [](float e) { return e < 0.0f; });
+        const size_t lit = (size_t)(unlit - a.errors.begin());
+        a.errors.resize((size_t)a.tilesX * (size_t)a.tilesY);
+        if (lit == 0) return true;
+
+        const float q = std::clamp(settings.adaptive_percentile, 0.0f, 1.0f);
+        const size_t k = std::min((size_t)(q * float(lit)), lit - 1);
+        std::nth_element(a.errors.begin(), a.errors.begin() + k,
+            a.errors.begin() + lit);
+        return a.errors[k] <= settings.adaptive_error;
+    }
+
+    // Add the odd passes to fbos.hdr and normalize the 'passes' drawn.
+    static void resolveAdaptive(Renderer& r, int passes) {
+        glBindFramebuffer(GL_FRAMEBUFFER, r.adaptive.evenFbo);
+        glUseProgram(r.programs.add);
+        glBindVertexArray(r.geom.vaoFSQ);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, r.adaptive.oddTex);
+        glActiveTexture(GL_TEXTURE0);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.hdr.fbo);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glUseProgram(r.programs.scene);
+        r.hdrScale = float(r.passCount) / float(passes);
+    }
+
+    static size_t sampleGroupSegments(const Renderer& r) {
+        size_t n = 0;
+        for (const SampleGroup& g : r.sampleGroups) n += g.segments.size();
+        for (const SampleGroup& g : r.splat.groups) n += g.segments.size();
+        return n;
+    }
+
+    static void accumulateScene(Renderer& r,
+        const RenderSettings& settings,
+        int frameIndex, float timeSec,
+        const SegmentStaging& frame,
+        FrameStats& stats)
+    {
+        const LineInstanceGPU* segments = frame.data();
+        const size_t totalSegments = frame.size();
+
+        beginScene(r, frameIndex, timeSec);
+        prepareExtras(r, frame, frameIndex, timeSec, stats);
+
+        stats.segments = totalSegments;
+        stats.passes = r.passCount;
+
+        if (totalSegments == 0 && !hasExtras(r) && sampleGroupSegments(r) == 0) {
+            endScene();
+            return;
+        }
+
+        const size_t capacity = (size_t)r.geom.maxSegments;
+
+        const bool canUploadOnce = (totalSegments <= capacity);
+        const bool timed = (bool)r.statsCb;
+
+        if (canUploadOnce) {
+            // Upload all segments once, then reuse for all passes
+            if (timed) glFinish();
+            StatsClock::time_point t0 = StatsClock::now();
+
+            bindStream(r);
+            size_t drawCount = totalSegments;
+            if (settings.incremental_upload && totalSegments > 0) {
+                if (!uploadIncremental(r, frame, drawCount, stats)) {
+                    drawCount = totalSegments;
+                    waitStreamRange(r, 0, totalSegments);
+                    stats.upload_bytes += uploadInstances(r, r.geom.stream,
+                        segments, totalSegments, 0);
+                }
+            }
+            else if (totalSegments > 0) {
+                r.incremental.valid = false;
+                waitStreamRange(r, 0, totalSegments);
+                stats.upload_bytes += uploadInstances(r, r.geom.stream,
+                    segments, totalSegments, 0);
+            }
+
+            if (timed) {
+                glFinish();
+                stats.upload_ms += msSince(t0);
+            }
+            beginTimer(r);
+            beginPacing(r);
+
+            // Adaptive: one pass per draw, alternating targets.
+            const bool adaptive = r.adaptive.enabled;
+            const int minPasses = (std::max(settings.adaptive_min_passes, 2) + 1) & ~1;
+            const int checkPasses = (std::max(settings.adaptive_check_passes, 2) + 1) & ~1;
+            int passes = r.passCount;
+
+            const int fold = adaptive ? 1 :
+                passesPerDraw(r, settings, drawCount, r.passCount);
+            for (int pass = 0; pass < r.passCount; pass += fold) {
+                const int n = std::min(fold, r.passCount - pass);
+
+                if (adaptive) {
+                    glDrawBuffer((pass & 1) ? GL_COLOR_ATTACHMENT1 : GL_COLOR_ATTACHMENT0);
+                }
+                if (totalSegments > 0) {
+                    drawStreamPasses(r, 0, drawCount, 0, pass, n);
+                }
+
+                for (int k = pass; k < pass + n; ++k) {
+                    glUniform1i(r.sceneU.uPassIndex, k);
+                    drawExtras(r, k);
+                }
+
+                paceSubmit(r, settings, totalSegments > 0 ? drawCount * (size_t)n : 0, n);
+
+                const int done = pass + 1;
+                if (adaptive && done < r.passCount && done >= minPasses &&
+                    (done - minPasses) % checkPasses == 0 &&
+                    adaptiveConverged(r, settings, done)) {
+                    passes = done;
+                    break;
+                }
+            }
+            if (totalSegments > 0) fenceStreamRange(r, 0, drawCount);
+            if (adaptive) resolveAdaptive(r, passes);
+            stats.passes = passes;
+
+            drawSampleGroups(r, settings, totalSegments > 0 ? drawCount : 0,
+                passes, stats);
+            endPacing(r);
+        }
+        else {
+            // Streaming path: the frame does not fit the stream buffer. Each
+            // ring chunk is uploaded once and drawn for all passes.
+            beginTimer(r);
+            beginPacing(r);
+            r.incremental.valid = false;
+
+            streamSegments(r, settings, segments, totalSegments, 0, stats,
+                r.passCount);
+            drawSampleGroups(r, settings, 0, r.passCount, stats);
+
+            for (int pass = 0; pass < r.passCount; ++pass) {
+                glUniform1i(r.sceneU.uPassIndex, pass);
+                drawExtras(r, pass);
+                paceSubmit(r, settings, 0, 1);
+            }
+            endPacing(r);
+        }
+
+        drawSplats(r, stats);
+        resolveSplats(r);
+
+        endTimer(r, stats);
+        endScene();
+    }
+
+    // Draw the batch in 'st' for all passes right away, then empty 'st'
+    // (shapes and primitives stay for the end of the frame). Seeds continue
+    // across batches (r.streamedSegments), as if the frame had been drawn
+    // whole.
+    static void streamBatch(Renderer& r, const RenderSettings& settings,
+        SegmentStaging& st, FrameStats& stats)
+    {
+        cullSegments(r, settings, st, stats);
+        lodMergeSegments(r, settings, st, stats);
+        splitSampleGroups(r, settings, st, stats);
+        splitSplats(r, settings, st, stats);
+
+        // Flushed per piece, so the GPU starts while the callback goes on.
+        streamSegments(r, settings, st.data(), st.size(), r.streamedSegments, stats,
+            r.passCount);
+        drawSampleGroups(r, settings, 0, r.passCount, stats);
+        drawSplats(r, stats);
+
+        r.streamedSegments += st.size();
+        stats.segments += st.size();
+
+        // Keep the LOD / sample settings in force for the next batch.
+        float lodPixels = -1.0f;
+        if (!st.lodMarks.empty()) lodPixels = st.lodMarks.back().pixels;
+        int samples = 0;
+        if (!st.sampleMarks.empty()) samples = st.sampleMarks.back().samples;
+        st.sink.size = 0;
+        st.lodMarks.clear();
+        st.sampleMarks.clear();
+        st.batchEnds.clear();
+        if (lodPixels >= 0.0f) st.lodMarks.push_back({ 0, lodPixels });
+        if (samples > 0) st.sampleMarks.push_back({ 0, samples });
+    }
+
+    // 2) Bloom
+    static void applyBloom(Renderer& r) {
+        const int hw = r.viewport.halfWidth;
+        const int hh = r.viewport.halfHeight;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.bloomA.fbo);
+        glViewport(0, 0, hw, hh);
+        glDisable(GL_DEPTH_TEST);
+        glClearColor(0, 0, 0, 0);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glUseProgram(r.programs.bright);
+        glBindVertexArray(r.geom.vaoFSQ);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, r.fbos.hdr.colorTex);
+        glUniform1i(r.brightU.uHDRTex, 0);
+        glUniform1f(r.brightU.uExposure, r.exposure * r.hdrScale);
+        glUniform1f(r.brightU.uThreshold, r.bloomThreshold);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // Blur H
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.bloomB.fbo);
+        glViewport(0, 0, hw, hh);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glUseProgram(r.programs.blur);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, r.fbos.bloomA.colorTex);
+        glUniform1i(r.blurU.uTex, 0);
+        glUniform2f(r.blurU.uTexelSize, 1.0f / hw, 1.0f / hh);
+        glUniform2f(r.blurU.uDirection, 1.0f, 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        // Blur V
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.bloomA.fbo);
+        glViewport(0, 0, hw, hh);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, r.fbos.bloomB.colorTex);
+        glUniform1i(r.blurU.uTex, 0);
+        glUniform2f(r.blurU.uDirection, 0.0f, 1.0f);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        glBindVertexArray(0);
+    }
+
+    // 3) Composite HDR + bloom into full-res LDR FBO
+    static void compositeToLDR(Renderer& r) {
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.ldr.fbo);
+        glViewport(0, 0, r.viewport.width, r.viewport.height);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        glUseProgram(r.programs.composite);
+        glBindVertexArray(r.geom.vaoFSQ);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, r.fbos.hdr.colorTex);
+        glUniform1i(r.compU.uHDRTex, 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, r.fbos.bloomA.colorTex);
+        glUniform1i(r.compU.uBloomTex, 1);
+
+        glUniform1f(r.compU.uExposure, r.exposure * r.hdrScale);
+        glUniform1f(r.compU.uBloomStrength,
+            r.bloomEnabled ? r.bloomStrength : 0.0f);
+
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+    }
+
+    // Fills the staging buffer with all segments of one frame.
+    using FrameSegmentSource =
+        std::function<void(int frame, float t, SegmentStaging& out)>;
+
+    static float frameTime(const RenderSettings& settings, int f) {
+        return (settings.fps > 0.0f) ? (float(f) / settings.fps) : float(f);
+    }
+
+    static void applyCamera(Renderer& renderer, const CameraParams& cam) {
+        glm::vec3 eye = glm::vec3(cam.eye_x, cam.eye_y, cam.eye_z);
+        glm::vec3 target = glm::vec3(cam.target_x, cam.target_y, cam.target_z);
+        glm::vec3 up = glm::vec3(cam.up_x, cam.up_y, cam.up_z);
+
+        renderer.view = glm::lookAt(eye, target, up);
+
+        float fovY = renderer.baseFovYDeg;
+        float nearP = renderer.baseNearPlane;
+        float farP = renderer.baseFarPlane;
+
+        if (cam.has_custom_fov)   fovY = cam.fov_y_deg;
+        if (cam.has_custom_clip) { nearP = cam.near_plane; farP = cam.far_plane; }
+
+        if (fovY <= 0.0f)          fovY = renderer.baseFovYDeg;
+        if (nearP <= 0.0f)         nearP = renderer.baseNearPlane;
+        if (farP <= nearP + 1e-4f) farP = renderer.baseFarPlane;
+
+        float aspect = float(renderer.viewport.frameWidth) /
+            float(renderer.viewport.frameHeight);
+
+        renderer.proj = glm::perspective(glm::radians(fovY),
+            aspect,
+            nearP,
+            farP);
+    }
+
+    // Bloom, composite, readback and stats of a frame whose scene is drawn.
+    static void finishFrame(Renderer& r,
+        const RenderSettings& settings,
+        FFmpegPipe* ffmpeg,
+        int frameIndex,
+        const FrameStats& stats)
+    {
+        if (r.bloomEnabled) {
+            applyBloom(r);
+        }
+
+        compositeToLDR(r);
+
+        // Read back from full-res LDR FBO
+        saveOrStreamBackbuffer(r.readback,
+            frameIndex,
+            r.viewport.width,
+            r.viewport.height,
+            settings.output_dir,
+            settings.output_mode,
+            ffmpeg,
+            r.output,
+            r.fbos.ldr.fbo);
+
+        if (r.statsCb) {
+            r.statsCb(stats);
+        }
+    }
+
+    // Projection of the tile whose core starts at output pixel (x, y), top
+    // left origin: 'proj' of the whole frame, narrowed to the tile target
+    // (core plus margins) so pixels keep their size and position.
+    static glm::mat4 tileProjection(const Renderer& r, const glm::mat4& proj,
+        int x, int y)
+    {
+        const float W = float(r.viewport.frameWidth);
+        const float H = float(r.viewport.frameHeight);
+        const float m = float(r.tiles.margin);
+
+        // Target edges in the frame's NDC (GL y points up).
+        const float left = 2.0f * (float(x) - m) / W - 1.0f;
+        const float right = 2.0f * (float(x) - m + float(r.viewport.width)) / W - 1.0f;
+        const float top = 1.0f - 2.0f * (float(y) - m) / H;
+        const float bottom = 1.0f - 2.0f * (float(y) - m + float(r.viewport.height)) / H;
+
+        glm::mat4 crop(1.0f);
+        crop[0][0] = 2.0f / (right - left);
+        crop[3][0] = -(right + left) / (right - left);
+        crop[1][1] = 2.0f / (top - bottom);
+        crop[3][1] = -(top + bottom) / (top - bottom);
+        return crop * proj;
+    }
+
+    // Copy the core (cols x rows) of the tile in fbos.ldr to 'dst' at
+    // column x, rows top-down 'stride' bytes apart.
+    static void readTile(Renderer& r, int x, int cols, int rows,
+        unsigned char* dst, size_t stride)
+    {
+        TileGrid& t = r.tiles;
+        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.ldr.fbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(t.margin, r.viewport.height - t.margin - rows, cols, rows,
+            GL_RGBA, GL_UNSIGNED_BYTE, t.pixels.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        const size_t rowBytes = size_t(cols) * 4;
+        for (int k = 0; k < rows; ++k) {
+            std::memcpy(dst + size_t(k) * stride + size_t(x) * 4,
+                &t.pixels[size_t(rows - 1 - k) * rowBytes], rowBytes);
+        }
+    }
+
+    // RenderSettings::tile_size: the segments (culled, merged and split
+    // for the whole frame) are drawn, bloomed and composited once per tile;
+    // each row of tiles goes to ffmpeg when done, PNG frames are written
+    // whole at the end.
+    static void renderTiles(Renderer& r,
+        const RenderSettings& settings,
+        FFmpegPipe* ffmpeg,
+        int frameIndex,
+        float timeSec,
+        SegmentStaging& segments,
+        FrameStats& stats)
+    {
+        TileGrid& t = r.tiles;
+        const int W = r.viewport.frameWidth;
+        const int H = r.viewport.frameHeight;
+        const size_t stride = size_t(W) * 4;
+        const bool toFFmpeg = settings.output_mode == OutputMode::FFmpegVideo &&
+            ffmpeg && ffmpeg->enabled;
+        if (!toFFmpeg) t.image.resize(stride * size_t(H));
+
+        const glm::mat4 proj = r.proj;
+        int passes = 0;
+        bool written = true;
+
+        beginFrameOutput(r.output, frameIndex);
+        for (int y = 0; y < H; y += t.size) {
+            const int rows = std::min(t.size, H - y);
+            unsigned char* dst = toFFmpeg ? t.band.data() : &t.image[size_t(y) * stride];
+
+            for (int x = 0; x < W; x += t.size) {
+                r.proj = tileProjection(r, proj, x, y);
+                accumulateScene(r, settings, frameIndex, timeSec, segments, stats);
+                passes = std::max(passes, stats.passes);
+
+                if (r.bloomEnabled) {
+                    applyBloom(r);
+                }
+                compositeToLDR(r);
+                readTile(r, x, std::min(t.size, W - x), rows, dst, stride);
+            }
+
+            if (toFFmpeg && written) {
+                written = ffmpegWriteFrame(*ffmpeg, dst, W, rows);
+            }
+            pollWindowEvents(r);
+        }
+        r.proj = proj;
+        stats.passes = passes;
+
+        if (!toFFmpeg) {
+            fs::create_directories(settings.output_dir);
+            const std::string path = framePngPath(settings.output_dir, frameIndex);
+            written = stbi_write_png(path.c_str(), W, H, 4, t.image.data(), (int)stride) != 0;
+        }
+        if (written) endFrameOutput(r.output, frameIndex);
+        else failFrameOutput(r.output, frameIndex);
+
+        if (r.statsCb) {
+            r.statsCb(stats);
+        }
+    }
+
+    // Culls and LOD-merges 'segments' in place before uploading them.
+    static void renderFrame(Renderer& r,
+        const RenderSettings& settings,
+        FFmpegPipe* ffmpeg,
+        int frameIndex,
+        float timeSec,
+        SegmentStaging& segments)
+    {
+        FrameStats stats;
+        stats.frame = frameIndex;
+        stats.context_ms = std::exchange(r.contextMs, 0.0);
+
+        cullSegments(r, settings, segments, stats);
+        lodMergeSegments(r, settings, segments, stats);
+        splitSampleGroups(r, settings, segments, stats);
+        splitSplats(r, settings, segments, stats);
+
+        if (r.tiles.enabled) {
+            renderTiles(r, settings, ffmpeg, frameIndex, timeSec, segments, stats);
+            return;
+        }
+
+        accumulateScene(r, settings, frameIndex, timeSec, segments, stats);
+
+        finishFrame(r, settings, ffmpeg, frameIndex, stats);
+    }
+
+    // RenderSettings::stream_flush_batches: the source runs with the scene
+    // already bound, each flush_now() draws its batch (streamBatch) and the
+    // rest is drawn when the source returns. draw_ms is the GPU time from
+    // the first batch to the end of the frame, generation gaps included.
+    static void renderFrameStreamed(Renderer& r,
+        const RenderSettings& settings,
+        FFmpegPipe* ffmpeg,
+        int frameIndex,
+        float timeSec,
+        const FrameSegmentSource& source)
+    {
+        FrameStats stats;
+        stats.frame = frameIndex;
+        stats.passes = r.passCount;
+        stats.context_ms = std::exchange(r.contextMs, 0.0);
+
+        SegmentStaging& st = r.staging;
+        resetStaging(st);
+        r.streamedSegments = 0;
+        r.incremental.valid = false;
+
+        beginScene(r, frameIndex, timeSec);
+        beginTimer(r);
+        beginPacing(r, false); // GPU idles while the callback generates
+
+        st.onFlush = [&r, &settings, &stats](SegmentStaging& batch) {
+            streamBatch(r, settings, batch, stats);
+        };
+        if (source) {
+            source(frameIndex, timeSec, st);
+        }
+        st.onFlush = nullptr;
+
+        streamBatch(r, settings, st, stats);
+
+        prepareExtras(r, st, frameIndex, timeSec, stats);
+        if (hasExtras(r)) {
+            for (int pass = 0; pass < r.passCount; ++pass) {
+                glUniform1i(r.sceneU.uPassIndex, pass);
+                drawExtras(r, pass);
+                paceSubmit(r, settings, 0, 1);
+            }
+        }
+        resolveSplats(r);
+
+        endTimer(r, stats);
+        endScene();
+
+        finishFrame(r, settings, ffmpeg, frameIndex, stats);
+    }
+
+    // ========================================================================
+    // Frame pipeline: produce frames ahead of the GL thread
+    // ========================================================================
+    // One producer thread runs camera + line callbacks for frame 0, 1, 2, ...
+    // in order (exactly like the serial loop, so callbacks that share state
+    // keep working) into a bounded queue of ready segment buffers. The GL
+    // thread only uploads, draws and reads back.
+    struct ProducedFrame {
+        int             frame = 0;
+        float           t = 0.0f;
+        CameraParams    cam;
+        std::vector<LayerState> layers;
+        SegmentStaging* segments = nullptr;
+    };
+
+    class FramePipeline {
+    public:
+        FramePipeline(const RenderSettings& settings,
+            const FrameRange& range,
+            const CameraCallback& cameraCb,
+            void* cameraUserPtr,
+            const FrameSegmentSource& source)
+            : settings_(settings), range_(range), cameraCb_(cameraCb),
+            cameraUserPtr_(cameraUserPtr), source_(source)
+        {
+            // depth frames in flight on the producer side + 1 on the GL thread
+            const int bufferCount = std::max(1, settings.pipeline_depth) + 1;
+            for (int i = 0; i < bufferCount; ++i) {
+                buffers_.push_back(std::make_unique<SegmentStaging>());
+                initStaging(*buffers_.back(), 4096);
+                free_.push_back(buffers_.back().get());
+            }
+            producer_ = std::thread([this]() { producerLoop(); });
+        }
+
+        ~FramePipeline() {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                stop_ = true;
+            }
+            cvFree_.notify_all();
+            producer_.join();
+        }
+
+        FramePipeline(const FramePipeline&) = delete;
+        FramePipeline& operator=(const FramePipeline&) = delete;
+
+        // Blocks until the next frame is ready; false once all are consumed.
+        bool pop(ProducedFrame& out) {
+            std::unique_lock<std::mutex> lk(mtx_);
+            cvReady_.wait(lk, [this]() { return !ready_.empty() || done_; });
+            if (ready_.empty()) return false;
+
+            out = std::move(ready_.front());
+            ready_.pop_front();
+            queuedBytes_ -= bytesOf(*out.segments);
+            lk.unlock();
+            cvFree_.notify_all();
+            return true;
+        }
+
+        // Hand a rendered frame's buffer back to the producer.
+        void recycle(SegmentStaging* buffer) {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                free_.push_back(buffer);
+            }
+            cvFree_.notify_all();
+        }
+
+    private:
+        static size_t bytesOf(const SegmentStaging& st) {
+            return st.size() * sizeof(LineInstanceGPU) +
+                st.shapes.count() * sizeof(ShapeInstance) +
+                st.primitives.size() * sizeof(ParametricPrimitive);
+        }
+
+        // Memory bound: never block on an empty queue (that would deadlock
+        // on a single frame larger than the bound).
+        bool canProduce() const {
+            if (free_.empty()) return false;
+            if (settings_.pipeline_max_bytes == 0 || ready_.empty()) return true;
+            return queuedBytes_ < settings_.pipeline_max_bytes;
+        }
+
+        void producerLoop() {
+            for (int f = range_.begin; f < range_.end; f += range_.step) {
+                SegmentStaging* buffer = nullptr;
+                {
+                    std::unique_lock<std::mutex> lk(mtx_);
+                    cvFree_.wait(lk, [this]() { return stop_ || canProduce(); });
+                    if (stop_) break;
+                    buffer = free_.back();
+                    free_.pop_back();
+                }
+
+                ProducedFrame pf;
+                pf.frame = f;
+                pf.t = frameTime(settings_, f);
+                pf.cam.user_ptr = cameraUserPtr_;
+                pf.segments = buffer;
+
+                if (cameraCb_) {
+                    cameraCb_(f, pf.t, pf.cam);
+                }
+                evalLayerStates(settings_, f, pf.t, pf.layers);
+
+                resetStaging(*buffer);
+                if (source_) {
+                    source_(f, pf.t, *buffer);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lk(mtx_);
+                    queuedBytes_ += bytesOf(*buffer);
+                    ready_.push_back(std::move(pf));
+                }
+                cvReady_.notify_one();
+            }
+
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                done_ = true;
+            }
+            cvReady_.notify_all();
+        }
+
+        const RenderSettings&     settings_;
+        const FrameRange          range_;
+        const CameraCallback&     cameraCb_;
+        void*                     cameraUserPtr_;
+        const FrameSegmentSource& source_;
+
+        std::vector<std::unique_ptr<SegmentStaging>> buffers_;
+        std::vector<SegmentStaging*> free_;
+        std::deque<ProducedFrame>    ready_;
+        size_t                       queuedBytes_ = 0;
+
+        std::mutex              mtx_;
+        std::condition_variable cvFree_;
+        std::condition_variable cvReady_;
+        bool                    stop_ = false;
+        bool                    done_ = false;
+
+        std::thread producer_;
+    };
+
+    // ========================================================================
+    // Software backend (RenderBackend::CPU)
+    // ========================================================================
+    // Mirrors the GL path stage by stage: emitRibbon() and SCENE_FS per
+    // pixel (two triangles per ribbon, clipped to the near / far planes,
+    // perspective-correct attributes, top-left fill rule), then the bright
+    // pass, blur and composite with the post shaders' sampling (bilinear,
+    // repeat wrap like the GL textures). Ribbons are set up once per
+    // segment and binned by their reach over all passes into TILE x TILE
+    // screen tiles; workers own whole tiles, so no pixel is shared.
+    namespace Cpu_ {
+
+        static const int TILE = 64;
+        static const size_t SETUP_CHUNK = 16 * 1024; // segments per binning task
+
+        // One GL draw: 'count' segments seeded from 'seedBase', drawn for
+        // passes 0 .. passes - 1 at uIntensityScale 'intensityScale'.
+        struct Draw {
+            const LineInstanceGPU* segments = nullptr;
+            size_t    count = 0;
+            uint32_t  seedBase = 0;
+            int       passes = 1;
+            float     intensityScale = 1.0f;
+            bool      hasModel = false;
+            glm::mat4 model = glm::mat4(1.0f);
+        };
+
+        // The uniforms of a frame.
+        struct View {
+            glm::mat4 viewProj = glm::mat4(1.0f);
+            glm::vec3 camRight = glm::vec3(1, 0, 0);
+            glm::vec3 camForward = glm::vec3(0, 0, -1);
+            int       width = 0;
+            int       height = 0;
+            float     thicknessScale = 1.0f;
+            float     energyPerHit = 1.0f;
+            float     inner = 0.6f;        // soft edge start, mix(0.60, 0.95, uSoft)
+            uint32_t  frameSeed = 0;       // uFrameIndex and uSeed terms of the seed
+            bool      analytic = false;
+            bool      additive = true;
+            const float* profile = nullptr; // JitterMode::Analytic table
+        };
+
+        // Pass-independent part of emitRibbon() for one segment.
+        struct Ribbon {
+            glm::vec3 start, end;
+            glm::vec3 side, up;
+            glm::vec3 c0, c1;
+            float     halfWidth;
+            float     jitter;   // radius of the per-pass offset (0 if analytic)
+            float     profile;  // vProfile
+            float     scale;    // uEnergyPerHit * max(intensity, 1) * uIntensityScale
+            uint32_t  seedIndex;
+            int       passes;
+        };
+
+        // Accumulation target, planar so a row of pixels is one SIMD load.
+        struct Planes {
+            int w = 0;
+            int h = 0;
+            std::vector<float> r, g, b;
+            std::vector<float> depth; // LineBlendMode::OpaqueWithDepth only
+
+            void resize(int width, int height, bool withDepth) {
+                w = width;
+                h = height;
+                const size_t n = size_t(w) * size_t(h);
+                r.assign(n, 0.0f);
+                g.assign(n, 0.0f);
+                b.assign(n, 0.0f);
+                if (withDepth) depth.assign(n, 1.0f);
+                else depth.clear();
+            }
+        };
+
+        struct ClipVert {
+            glm::vec4 p;
+            float along, side, dist;
+        };
+
+        // Screen-space triangle, counter-clockwise, ready for edge walking.
+        struct Triangle {
+            float ex[3], ey[3], ec[3]; // edge i: ex * x + ey * y + ec (>= 0 inside)
+            bool  topLeft[3];
+            float invArea;
+            float invW[3];
+            float along[3], side[3], dist[3], zw[3];
+            int   x0, y0, x1, y1;      // pixel bounds, exclusive max
+        };
+
+        static uint32_t hashU(uint32_t x) {
+            x ^= x >> 16u;
+            x *= 0x7feb352du;
+            x ^= x >> 15u;
+            x *= 0x846ca68bu;
+            x ^= x >> 16u;
+            return x;
+        }
+
+        static float h1(uint32_t x) {
+            return float(hashU(x)) / float(0xffffffffu);
+        }
+
+        static glm::vec3 startOf(const LineInstanceGPU& s) { return { s.start_x, s.start_y, s.start_z }; }
+        static glm::vec3 endOf(const LineInstanceGPU& s) { return { s.end_x, s.end_y, s.end_z }; }
+
+        static Ribbon setupRibbon(const View& v, const Draw& d, size_t index) {
+            const LineInstanceGPU& s = d.segments[index];
+            Ribbon rb;
+            rb.start = startOf(s);
+            rb.end = endOf(s);
+            if (d.hasModel) {
+                rb.start = glm::vec3(d.model * glm::vec4(rb.start, 1.0f));
+                rb.end = glm::vec3(d.model * glm::vec4(rb.end, 1.0f));
+            }
+
+            const glm::vec3 dir = rb.end - rb.start;
+            const float segLen = std::max(glm::length(dir), 1e-5f);
+            const glm::vec3 lineDir = dir / segLen;
+
+            rb.side = glm::normalize(glm::cross(v.camForward, lineDir));
+            if (glm::length(rb.side) < 1e-4f) {
+                rb.side = v.camRight;
+            }
+            rb.up = glm::normalize(glm::cross(lineDir, rb.side));
+
+            const float thickness = s.thickness * v.thicknessScale;
+            if (v.analytic) {
+                rb.halfWidth = thickness + s.jitter;
+                rb.profile = s.jitter / std::max(rb.halfWidth, 1e-6f);
+                rb.jitter = 0.0f;
+            }
+            else {
+                rb.halfWidth = thickness;
+                rb.profile = 0.0f;
+                rb.jitter = s.jitter;
+            }
+
+            rb.c0 = glm::vec3(s.start_r, s.start_g, s.start_b);
+            rb.c1 = glm::vec3(s.end_r, s.end_g, s.end_b);
+            rb.scale = v.energyPerHit * std::max(s.intensity, 1.0f) * d.intensityScale;
+            rb.seedIndex = d.seedBase + (uint32_t)index;
+            rb.passes = d.passes;
+            return rb;
+        }
+
+        // Pixel rectangle the ribbon can reach in any pass; false if none.
+        static bool ribbonBounds(const View& v, const Ribbon& rb,
+            int& x0, int& y0, int& x1, int& y1)
+        {
+            const float reach = rb.halfWidth + rb.jitter;
+            const glm::vec3 lo = glm::min(rb.start, rb.end) - glm::vec3(reach);
+            const glm::vec3 hi = glm::max(rb.start, rb.end) + glm::vec3(reach);
+            if (!(lo.x <= hi.x && lo.y <= hi.y && lo.z <= hi.z)) return false; // NaN
+
+            float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+            bool behind = false;
+            int outside[6] = { 0, 0, 0, 0, 0, 0 };
+            for (int k = 0; k < 8; ++k) {
+                const glm::vec4 p = v.viewProj * glm::vec4(
+                    (k & 1) ? hi.x : lo.x, (k & 2) ? hi.y : lo.y, (k & 4) ? hi.z : lo.z, 1.0f);
+                outside[0] += p.x < -p.w; outside[1] += p.x > p.w;
+                outside[2] += p.y < -p.w; outside[3] += p.y > p.w;
+                outside[4] += p.z < -p.w; outside[5] += p.z > p.w;
+                if (p.w <= 1e-6f) {
+                    behind = true;
+                    continue;
+                }
+                const float sx = (p.x / p.w * 0.5f + 0.5f) * float(v.width);
+                const float sy = (p.y / p.w * 0.5f + 0.5f) * float(v.height);
+                minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+                minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+            }
+            for (int i = 0; i < 6; ++i) {
+                if (outside[i] == 8) return false;
+            }
+            if (behind) {
+                x0 = 0; y0 = 0; x1 = v.width; y1 = v.height;
+                return true;
+            }
+            x0 = std::max((int)std::floor(minX), 0);
+            y0 = std::max((int)std::floor(minY), 0);
+            x1 = std::min((int)std::ceil(maxX) + 1, v.width);
+            y1 = std::min((int)std::ceil(maxY) + 1, v.height);
+            return x0 < x1 && y0 < y1;
+        }
+
+        // Keep the part of polygon 'in' with s * z + w >= 0 (near: s = 1,
+        // far: s = -1); attributes are linear in clip space.
+        static int clipPolygon(const ClipVert* in, int n, ClipVert* out, float s) {
+            int m = 0;
+            for (int i = 0; i < n; ++i) {
+                const ClipVert& a = in[i];
+                const ClipVert& b = in[(i + 1) % n];
+                const float da = s * a.p.z + a.p.w;
+                const float db = s * b.p.z + b.p.w;
+                if (da >= 0.0f) out[m++] = a;
+                if ((da >= 0.0f) != (db >= 0.0f)) {
+                    const float t = da / (da - db);
+                    ClipVert c;
+                    c.p = a.p + (b.p - a.p) * t;
+                    c.along = a.along + (b.along - a.along) * t;
+                    c.side = a.side + (b.side - a.side) * t;
+                    c.dist = a.dist + (b.dist - a.dist) * t;
+                    out[m++] = c;
+                }
+            }
+            return m;
+        }
+
+        // Edge setup of one clipped triangle inside the tile [x0, x1) x [y0, y1).
+        static bool setupTriangle(const View& v, const ClipVert* c,
+            int tx0, int ty0, int tx1, int ty1, Triangle& t)
+        {
+            float sx[3], sy[3];
+            for (int i = 0; i < 3; ++i) {
+                const float iw = 1.0f / c[i].p.w;
+                sx[i] = (c[i].p.x * iw * 0.5f + 0.5f) * float(v.width);
+                sy[i] = (c[i].p.y * iw * 0.5f + 0.5f) * float(v.height);
+                t.invW[i] = iw;
+                t.zw[i] = c[i].p.z * iw;
+                t.along[i] = c[i].along;
+                t.side[i] = c[i].side;
+                t.dist[i] = c[i].dist;
+            }
+
+            float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+            if (!(std::fabs(area) > 0.0f) || !std::isfinite(area)) return false;
+            if (area < 0.0f) {
+                std::swap(sx[1], sx[2]); std::swap(sy[1], sy[2]);
+                std::swap(t.invW[1], t.invW[2]); std::swap(t.zw[1], t.zw[2]);
+                std::swap(t.along[1], t.along[2]); std::swap(t.side[1], t.side[2]);
+                std::swap(t.dist[1], t.dist[2]);
+                area = -area;
+            }
+            t.invArea = 1.0f / area;
+
+            // Edge i is opposite vertex i: from vertex i + 1 to i + 2.
+            for (int i = 0; i < 3; ++i) {
+                const int a = (i + 1) % 3;
+                const int b = (i + 2) % 3;
+                const float dx = sx[b] - sx[a];
+                const float dy = sy[b] - sy[a];
+                t.ex[i] = -dy;
+                t.ey[i] = dx;
+                t.ec[i] = dy * sx[a] - dx * sy[a];
+                // Counter-clockwise with y up: left edges go down, top
+                // edges go left.
+                t.topLeft[i] = (dy < 0.0f) || (dy == 0.0f && dx < 0.0f);
+            }
+
+            const float minX = std::min(sx[0], std::min(sx[1], sx[2]));
+            const float maxX = std::max(sx[0], std::max(sx[1], sx[2]));
+            const float minY = std::min(sy[0], std::min(sy[1], sy[2]));
+            const float maxY = std::max(sy[0], std::max(sy[1], sy[2]));
+            t.x0 = std::max((int)std::floor(minX - 0.5f), tx0);
+            t.x1 = std::min((int)std::ceil(maxX + 0.5f), tx1);
+            t.y0 = std::max((int)std::floor(minY - 0.5f), ty0);
+            t.y1 = std::min((int)std::ceil(maxY + 0.5f), ty1);
+            return t.x0 < t.x1 && t.y0 < t.y1;
+        }
+
+        static float smoothStrip(float inner, float r) {
+            const float t = std::clamp((r - inner) / (1.0f - inner), 0.0f, 1.0f);
+            return 1.0f - t * t * (3.0f - 2.0f * t);
+        }
+
+        // texture(uJitterProfile, ...) in SCENE_FS: bilinear, clamped.
+        static float profileLookup(const float* table, float r, float profile) {
+            const int n = JITTER_PROFILE_SIZE;
+            const float x = std::clamp(r, 0.0f, 1.0f) * float(n - 1);
+            const float y = std::clamp(profile, 0.0f, 1.0f) * float(n - 1);
+            const int x0 = std::min((int)x, n - 2);
+            const int y0 = std::min((int)y, n - 2);
+            const float fx = x - float(x0);
+            const float fy = y - float(y0);
+            const float* row0 = table + (size_t)y0 * n;
+            const float* row1 = row0 + n;
+            const float a = row0[x0] + (row0[x0 + 1] - row0[x0]) * fx;
+            const float b = row1[x0] + (row1[x0 + 1] - row1[x0]) * fx;
+            return a + (b - a) * fy;
+        }
+
+        // Shade the pixels of 't' (SCENE_FS) into 'dst'.
+        static void rasterScalar(const View& v, const Ribbon& rb, const Triangle& t, Planes& dst) {
+            for (int y = t.y0; y < t.y1; ++y) {
+                const float py = float(y) + 0.5f;
+                const size_t row = size_t(y) * size_t(dst.w);
+                float ey[3]; // same rounding as rasterSSE, so coverage matches
+                for (int i = 0; i < 3; ++i) ey[i] = t.ey[i] * py + t.ec[i];
+                for (int x = t.x0; x < t.x1; ++x) {
+                    const float px = float(x) + 0.5f;
+                    float e[3];
+                    bool inside = true;
+                    for (int i = 0; i < 3; ++i) {
+                        e[i] = t.ex[i] * px + ey[i];
+                        inside = inside && (e[i] > 0.0f || (e[i] == 0.0f && t.topLeft[i]));
+                    }
+                    if (!inside) continue;
+
+                    float q[3];
+                    for (int i = 0; i < 3; ++i) q[i] = e[i] * t.invArea * t.invW[i];
+                    const float inv = 1.0f / (q[0] + q[1] + q[2]);
+                    const float along = (q[0] * t.along[0] + q[1] * t.along[1] + q[2] * t.along[2]) * inv;
+                    const float side = (q[0] * t.side[0] + q[1] * t.side[1] + q[2] * t.side[2]) * inv;
+                    const float dist = (q[0] * t.dist[0] + q[1] * t.dist[1] + q[2] * t.dist[2]) * inv;
+
+                    const float r = std::fabs(side);
+                    const float strip = v.analytic
+                        ? profileLookup(v.profile, r, rb.profile)
+                        : smoothStrip(v.inner, r);
+                    const float atten = 1.0f / (1.0f + 0.0008f * dist * dist);
+                    const glm::vec3 col = (rb.c0 + (rb.c1 - rb.c0) * along) *
+                        (strip * atten * rb.scale);
+
+                    const size_t i = row + size_t(x);
+                    if (v.additive) {
+                        dst.r[i] += col.r;
+                        dst.g[i] += col.g;
+                        dst.b[i] += col.b;
+                    }
+                    else {
+                        const float l0 = e[0] * t.invArea, l1 = e[1] * t.invArea, l2 = e[2] * t.invArea;
+                        const float depth = (l0 * t.zw[0] + l1 * t.zw[1] + l2 * t.zw[2]) * 0.5f + 0.5f;
+                        if (!(depth < dst.depth[i]) || depth < 0.0f) continue;
+                        dst.depth[i] = depth;
+                        dst.r[i] = col.r;
+                        dst.g[i] = col.g;
+                        dst.b[i] = col.b;
+                    }
+                }
+            }
+        }
+
+#if WIRE_SIMD_SSE
+        // rasterScalar for additive stochastic ribbons, 4 pixels at a time
+        // (the remainder of a row goes through rasterScalar's math).
+        static void rasterSSE(const View& v, const Ribbon& rb, const Triangle& t, Planes& dst) {
+            const __m128 lanes = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+            const __m128 inner = _mm_set1_ps(v.inner);
+            const __m128 invEdge = _mm_set1_ps(1.0f / (1.0f - v.inner));
+            const __m128 k = _mm_set1_ps(0.0008f);
+
+            __m128 ex[3], tl[3], qs[3];
+            for (int i = 0; i < 3; ++i) {
+                ex[i] = _mm_set1_ps(t.ex[i]);
+                tl[i] = _mm_castsi128_ps(_mm_set1_epi32(t.topLeft[i] ? -1 : 0));
+                qs[i] = _mm_set1_ps(t.invArea * t.invW[i]);
+            }
+            const glm::vec3 dc = rb.c1 - rb.c0;
+
+            for (int y = t.y0; y < t.y1; ++y) {
+                const float py = float(y) + 0.5f;
+                const size_t row = size_t(y) * size_t(dst.w);
+                __m128 ey[3];
+                for (int i = 0; i < 3; ++i) ey[i] = _mm_set1_ps(t.ey[i] * py + t.ec[i]);
+
+                int x = t.x0;
+                for (; x + 4 <= t.x1; x += 4) {
+                    const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), lanes);
+                    __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                    __m128 q[3];
+                    for (int i = 0; i < 3; ++i) {
+                        const __m128 e = _mm_add_ps(_mm_mul_ps(ex[i], px), ey[i]);
+                        const __m128 in = _mm_or_ps(_mm_cmpgt_ps(e, zero),
+                            _mm_and_ps(_mm_cmpeq_ps(e, zero), tl[i]));
+                        mask = _mm_and_ps(mask, in);
+                        q[i] = _mm_mul_ps(e, qs[i]);
+                    }
+                    if (_mm_movemask_ps(mask) == 0) continue;
+
+                    const __m128 inv = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(q[0], q[1]), q[2]));
+                    auto lerp3 = [&](const float* a) {
+                        return _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+                            _mm_mul_ps(q[0], _mm_set1_ps(a[0])),
+                            _mm_mul_ps(q[1], _mm_set1_ps(a[1]))),
+                            _mm_mul_ps(q[2], _mm_set1_ps(a[2]))), inv);
+                    };
+                    const __m128 along = lerp3(t.along);
+                    const __m128 r = _mm_and_ps(lerp3(t.side), absMask);
+                    const __m128 dist = lerp3(t.dist);
+
+                    __m128 s = _mm_mul_ps(_mm_sub_ps(r, inner), invEdge);
+                    s = _mm_min_ps(_mm_max_ps(s, zero), one);
+                    const __m128 edge = _mm_mul_ps(_mm_mul_ps(s, s),
+                        _mm_sub_ps(_mm_set1_ps(3.0f), _mm_add_ps(s, s)));
+                    const __m128 atten = _mm_div_ps(one,
+                        _mm_add_ps(one, _mm_mul_ps(k, _mm_mul_ps(dist, dist))));
+                    const __m128 w = _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(
+                        _mm_sub_ps(one, edge), atten), _mm_set1_ps(rb.scale)));
+
+                    float* pr = &dst.r[row + size_t(x)];
+                    float* pg = &dst.g[row + size_t(x)];
+                    float* pb = &dst.b[row + size_t(x)];
+                    auto channel = [&](float* p, float c0, float dcc) {
+                        const __m128 c = _mm_add_ps(_mm_set1_ps(c0), _mm_mul_ps(_mm_set1_ps(dcc), along));
+                        _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), _mm_mul_ps(c, w)));
+                    };
+                    channel(pr, rb.c0.r, dc.r);
+                    channel(pg, rb.c0.g, dc.g);
+                    channel(pb, rb.c0.b, dc.b);
+                }
+
+                if (x < t.x1) {
+                    Triangle rest = t;
+                    rest.x0 = x;
+                    rest.y0 = y;
+                    rest.y1 = y + 1;
+                    rasterScalar(v, rb, rest, dst);
+                }
+            }
+        }
+#endif
+
+        // emitRibbon() for one pass: the quad's two triangles, clipped,
+        // into the tile [x0, x1) x [y0, y1).
+        static void drawRibbonPass(const View& v, const Ribbon& rb, int pass,
+            int x0, int y0, int x1, int y1, Planes& dst)
+        {
+            glm::vec3 offset(0.0f);
+            if (rb.jitter != 0.0f) {
+                const uint32_t seed = rb.seedIndex ^ (uint32_t(pass) * 2654435761u) ^ v.frameSeed;
+                const float ang = h1(seed) * 6.2831853f;
+                const float rad01 = h1(seed ^ 0x9e3779b9u);
+                offset = (std::cos(ang) * rb.side + std::sin(ang) * rb.up) * (rb.jitter * rad01);
+            }
+
+            // Corners in SEGMENT_QUAD order: (along, side) = (0,-1) (1,-1) (1,1) (0,1)
+            static const float ALONG[4] = { 0.0f, 1.0f, 1.0f, 0.0f };
+            static const float SIDE[4] = { -1.0f, -1.0f, 1.0f, 1.0f };
+            ClipVert quad[4];
+            for (int k = 0; k < 4; ++k) {
+                const glm::vec3 base = ALONG[k] == 0.0f ? rb.start : rb.end;
+                const glm::vec3 world = base + offset + rb.side * (SIDE[k] * rb.halfWidth);
+                quad[k].p = v.viewProj * glm::vec4(world, 1.0f);
+                quad[k].along = ALONG[k];
+                quad[k].side = SIDE[k];
+                quad[k].dist = glm::length(world);
+            }
+
+            static const int TRIS[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+            for (const int* tri : TRIS) {
+                ClipVert poly[3] = { quad[tri[0]], quad[tri[1]], quad[tri[2]] };
+                ClipVert nearPoly[4], farPoly[5];
+                int n = 3;
+                const ClipVert* src = poly;
+                const bool needNear = poly[0].p.z < -poly[0].p.w ||
+                    poly[1].p.z < -poly[1].p.w || poly[2].p.z < -poly[2].p.w;
+                const bool needFar = poly[0].p.z > poly[0].p.w ||
+                    poly[1].p.z > poly[1].p.w || poly[2].p.z > poly[2].p.w;
+                if (needNear) {
+                    n = clipPolygon(src, n, nearPoly, 1.0f);
+                    src = nearPoly;
+                }
+                if (needFar) {
+                    n = clipPolygon(src, n, farPoly, -1.0f);
+                    src = farPoly;
+                }
+
+                for (int f = 1; f + 1 < n; ++f) {
+                    const ClipVert fan[3] = { src[0], src[f], src[f + 1] };
+                    if (!(fan[0].p.w > 0.0f && fan[1].p.w > 0.0f && fan[2].p.w > 0.0f)) continue;
+                    Triangle t;
+                    if (!setupTriangle(v, fan, x0, y0, x1, y1, t)) continue;
+#if WIRE_SIMD_SSE
+                    if (v.additive && !v.analytic) {
+                        rasterSSE(v, rb, t, dst);
+                        continue;
+                    }
+#endif
+                    rasterScalar(v, rb, t, dst);
+                }
+            }
+        }
+
+        // Sampling of the post shaders: texture() with GL_LINEAR and the
+        // default GL_REPEAT wrap, at normalized (u, v).
+        static int wrap(int i, int n) {
+            i %= n;
+            return i < 0 ? i + n : i;
+        }
+
+        static glm::vec3 texel(const Planes& p, int x, int y) {
+            const size_t i = size_t(wrap(y, p.h)) * size_t(p.w) + size_t(wrap(x, p.w));
+            return glm::vec3(p.r[i], p.g[i], p.b[i]);
+        }
+
+        static glm::vec3 sampleLinear(const Planes& p, float u, float v) {
+            const float x = u * float(p.w) - 0.5f;
+            const float y = v * float(p.h) - 0.5f;
+            const int x0 = (int)std::floor(x);
+            const int y0 = (int)std::floor(y);
+            const float fx = x - float(x0);
+            const float fy = y - float(y0);
+            const glm::vec3 a = glm::mix(texel(p, x0, y0), texel(p, x0 + 1, y0), fx);
+            const glm::vec3 b = glm::mix(texel(p, x0, y0 + 1), texel(p, x0 + 1, y0 + 1), fx);
+            return glm::mix(a, b, fy);
+        }
+
+        static void store(Planes& p, int x, int y, const glm::vec3& c) {
+            const size_t i = size_t(y) * size_t(p.w) + size_t(x);
+            p.r[i] = c.r;
+            p.g[i] = c.g;
+            p.b[i] = c.b;
+        }
+
+        static glm::vec3 tonemap(const glm::vec3& x, float e) {
+            return glm::vec3(1.0f) - glm::exp(-x * e);
+        }
+
+        // Whole renderer state of the software backend.
+        struct Backend {
+            explicit Backend(const RenderSettings& settings) : pool(settings.worker_threads) {}
+
+            WorkerPool pool;
+            Planes hdr, bloomA, bloomB;
+            std::vector<unsigned char> rgba;     // top-down output frame
+
+            std::vector<float> profile;          // JitterMode::Analytic
+
+            // Static layers, filtered like createRetainedLayers.
+            std::vector<std::vector<LineInstanceGPU>> layers;
+            std::vector<uint32_t> layerSeeds;
+
+            // Shape prototype segments, filtered like createShapeBuffers.
+            std::vector<std::vector<LineParams>> prototypes;
+
+            // This frame's shapes and primitives as plain segments.
+            std::vector<LineInstanceGPU> shapeSegments;
+            std::vector<LineInstanceGPU> primitiveSegments;
+
+            std::vector<Draw> draws;
+            std::vector<Ribbon> ribbons;
+            std::vector<size_t> chunkFirst;               // ribbon index per chunk
+            std::vector<std::vector<std::vector<uint32_t>>> bins; // [chunk][tile]
+            int tilesX = 0;
+            int tilesY = 0;
+        };
+
+        static void initBackend(Backend& b, const Renderer& r, const RenderSettings& settings) {
+            b.hdr.resize(r.viewport.width, r.viewport.height,
+                r.blendMode != LineBlendMode::AdditiveLightPainting);
+            b.bloomA.resize(r.viewport.halfWidth, r.viewport.halfHeight, false);
+            b.bloomB.resize(r.viewport.halfWidth, r.viewport.halfHeight, false);
+            b.rgba.resize(size_t(r.viewport.width) * size_t(r.viewport.height) * 4);
+            b.tilesX = (r.viewport.width + TILE - 1) / TILE;
+            b.tilesY = (r.viewport.height + TILE - 1) / TILE;
+
+            if (r.analytic) {
+                buildJitterProfile(settings.soft_edge, b.profile);
+            }
+
+            SegmentStaging filtered;
+            initStaging(filtered, 4096);
+            uint32_t seedBase = 0x40000000;
+            for (const StaticLayer& src : settings.static_layers) {
+                resetStaging(filtered);
+                LineEmitContext ctx;
+                ctx.sink = &filtered.sink;
+                ctx.add_span(src.segments); // drops zero-thickness segments
+                b.layers.emplace_back(filtered.data(), filtered.data() + filtered.size());
+                b.layerSeeds.push_back(seedBase);
+                seedBase += (uint32_t)filtered.size();
+            }
+
+            for (const ShapePrototype& proto : settings.shape_prototypes) {
+                b.prototypes.emplace_back();
+                for (const LineParams& lp : proto.segments) {
+                    if (lp.thickness > 0.0f) b.prototypes.back().push_back(lp);
+                }
+            }
+        }
+
+        // SCENE_VS_SHAPES on the CPU, in its instance order.
+        static void expandShapes(Backend& b, const ShapeSink& shapes) {
+            b.shapeSegments.clear();
+            for (size_t proto = 0; proto < shapes.instances.size() &&
+                proto < b.prototypes.size(); ++proto)
+            {
+                for (const ShapeInstance& s : shapes.instances[proto]) {
+                    const glm::vec3 origin(s.origin[0], s.origin[1], s.origin[2]);
+                    const glm::mat3 basis(
+                        glm::vec3(s.axis_x[0], s.axis_x[1], s.axis_x[2]),
+                        glm::vec3(s.axis_y[0], s.axis_y[1], s.axis_y[2]),
+                        glm::vec3(s.axis_z[0], s.axis_z[1], s.axis_z[2]));
+                    for (const LineParams& p : b.prototypes[proto]) {
+                        const glm::vec3 a = origin + basis * glm::vec3(p.start_x, p.start_y, p.start_z);
+                        const glm::vec3 e = origin + basis * glm::vec3(p.end_x, p.end_y, p.end_z);
+                        LineInstanceGPU o;
+                        o.start_x = a.x; o.start_y = a.y; o.start_z = a.z;
+                        o.end_x = e.x;   o.end_y = e.y;   o.end_z = e.z;
+                        o.start_r = p.start_r * s.color[0];
+                        o.start_g = p.start_g * s.color[1];
+                        o.start_b = p.start_b * s.color[2];
+                        o.end_r = p.end_r * s.color[0];
+                        o.end_g = p.end_g * s.color[1];
+                        o.end_b = p.end_b * s.color[2];
+                        o.thickness = p.thickness * s.thickness;
+                        o.jitter = p.jitter * s.jitter;
+                        o.intensity = p.intensity * s.intensity;
+                        b.shapeSegments.push_back(o);
+                    }
+                }
+            }
+        }
+
+        // SCENE_VS_PRIMITIVES on the CPU ('g' = the uPrim rows).
+        static glm::vec3 primitivePos(const PrimitiveGPU& g, int type, glm::vec2 uv) {
+            const float TAU = 6.2831853f;
+            const float major = g.v[4][0], minor = g.v[4][1];
+            const float wu = g.v[4][2] * std::sin(TAU * g.v[5][0] * uv.x + g.v[5][2]);
+            const float wv = g.v[4][3] * std::sin(TAU * g.v[5][1] * uv.y + g.v[5][2]);
+
+            if (type == 0) { // Torus
+                const float R = major * (1.0f + wu);
+                const float r = minor * (1.0f + wv);
+                const float cu = std::cos(TAU * uv.x), su = std::sin(TAU * uv.x);
+                const float cv = std::cos(TAU * uv.y), sv = std::sin(TAU * uv.y);
+                return glm::vec3((R + r * cv) * cu, r * sv, (R + r * cv) * su);
+            }
+            if (type == 1) { // Ring
+                const float R = (major + uv.y * minor) * (1.0f + wu);
+                return glm::vec3(R * std::cos(TAU * uv.x), 0.0f, R * std::sin(TAU * uv.x));
+            }
+            if (type == 2) { // Grid
+                return glm::vec3((uv.x - 0.5f) * major, wu + wv, (uv.y - 0.5f) * minor);
+            }
+            const float ang = TAU * (uv.x * g.v[3][3] + uv.y); // Helix
+            const float R = major * (1.0f + wu);
+            return glm::vec3(R * std::cos(ang), (uv.x - 0.5f) * minor, R * std::sin(ang));
+        }
+
+        static glm::vec3 primitiveColor(const PrimitiveGPU& g, float u) {
+            const float TAU = 6.2831853f;
+            const float stripe = 1.0f + g.v[5][3] * std::sin(TAU * g.v[6][3] * u + g.v[7][3]);
+            const glm::vec3 c0(g.v[6][0], g.v[6][1], g.v[6][2]);
+            const glm::vec3 c1(g.v[7][0], g.v[7][1], g.v[7][2]);
+            return glm::mix(c0, c1, u) * std::max(stripe, 0.0f);
+        }
+
+        static void expandPrimitive(const PrimitiveGPU& g, std::vector<LineInstanceGPU>& out) {
+            const int type = (int)g.v[0][3];
+            const int U = (int)g.v[1][3];
+            const int V = (int)g.v[2][3];
+            const glm::vec3 center(g.v[0][0], g.v[0][1], g.v[0][2]);
+            const glm::mat3 basis(
+                glm::vec3(g.v[1][0], g.v[1][1], g.v[1][2]),
+                glm::vec3(g.v[2][0], g.v[2][1], g.v[2][2]),
+                glm::vec3(g.v[3][0], g.v[3][1], g.v[3][2]));
+
+            for (int instance = 0; instance < g.segments; ++instance) {
+                int id = instance;
+                glm::vec2 a, b;
+                if (type == 0) {
+                    const int cell = id / 2;
+                    a = glm::vec2(float(cell % U) / float(U), float(cell / U) / float(V));
+                    b = a + ((id % 2) == 0 ? glm::vec2(1.0f / float(U), 0.0f)
+                                           : glm::vec2(0.0f, 1.0f / float(V)));
+                }
+                else if (type == 1) {
+                    a = glm::vec2(float(id % U) / float(U), float(id / U));
+                    b = a + glm::vec2(1.0f / float(U), 0.0f);
+                }
+                else if (type == 2) {
+                    const int rows = (V + 1) * U;
+                    if (id < rows) {
+                        a = glm::vec2(float(id % U) / float(U), float(id / U) / float(V));
+                        b = a + glm::vec2(1.0f / float(U), 0.0f);
+                    }
+                    else {
+                        id -= rows;
+                        a = glm::vec2(float(id / V) / float(U), float(id % V) / float(V));
+                        b = a + glm::vec2(0.0f, 1.0f / float(V));
+                    }
+                }
+                else {
+                    a = glm::vec2(float(id % U) / float(U), float(id / U) / float(V));
+                    b = a + glm::vec2(1.0f / float(U), 0.0f);
+                }
+
+                const glm::vec3 p0 = center + basis * primitivePos(g, type, a);
+                const glm::vec3 p1 = center + basis * primitivePos(g, type, b);
+                const glm::vec3 c0 = primitiveColor(g, a.x);
+                const glm::vec3 c1 = primitiveColor(g, b.x);
+
+                LineInstanceGPU o;
+                o.start_x = p0.x; o.start_y = p0.y; o.start_z = p0.z;
+                o.end_x = p1.x;   o.end_y = p1.y;   o.end_z = p1.z;
+                o.start_r = c0.r; o.start_g = c0.g; o.start_b = c0.b;
+                o.end_r = c1.r;   o.end_g = c1.g;   o.end_b = c1.b;
+                o.thickness = g.v[8][0];
+                o.jitter = g.v[8][1];
+                o.intensity = g.v[8][2];
+                out.push_back(o);
+            }
+        }
+
+        // The frame's draws in GL order: segments, layers, shapes,
+        // primitives (every pass), then the sample groups.
+        static void collectDraws(Backend& b, const Renderer& r,
+            const SegmentStaging& frame)
+        {
+            b.draws.clear();
+            auto add = [&b](const LineInstanceGPU* segs, size_t n, uint32_t seedBase,
+                int passes, float intensityScale)
+                {
+                    if (n == 0 || passes <= 0) return;
+                    Draw d;
+                    d.segments = segs;
+                    d.count = n;
+                    d.seedBase = seedBase;
+                    d.passes = passes;
+                    d.intensityScale = intensityScale;
+                    b.draws.push_back(d);
+                };
+
+            add(frame.data(), frame.size(), 0, r.passCount, r.passWeight);
+
+            for (size_t i = 0; i < b.layers.size() && i < r.layerStates.size(); ++i) {
+                const LayerState& state = r.layerStates[i];
+                if (!state.visible || state.intensity <= 0.0f) continue;
+                const size_t before = b.draws.size();
+                add(b.layers[i].data(), b.layers[i].size(), b.layerSeeds[i],
+                    r.passCount, state.intensity * r.passWeight);
+                if (b.draws.size() > before) {
+                    b.draws.back().hasModel = true;
+                    b.draws.back().model = glm::make_mat4(state.transform);
+                }
+            }
+
+            expandShapes(b, frame.shapes);
+            add(b.shapeSegments.data(), b.shapeSegments.size(), 0x20000000,
+                r.passCount, r.passWeight);
+
+            b.primitiveSegments.clear();
+            for (const ParametricPrimitive& prim : frame.primitives) {
+                const PrimitiveGPU g = toPrimitiveGPU(prim);
+                if (g.segments > 0) expandPrimitive(g, b.primitiveSegments);
+            }
+            add(b.primitiveSegments.data(), b.primitiveSegments.size(), 0x30000000,
+                r.passCount, r.passWeight);
+
+            uint32_t seedBase = (uint32_t)SAMPLE_GROUP_SEED_BASE;
+            for (const SampleGroup& g : r.sampleGroups) {
+                add(g.segments.data(), g.segments.size(), seedBase, g.samples,
+                    r.passWeight * float(r.passCount) / float(g.samples));
+                seedBase += (uint32_t)g.segments.size();
+            }
+        }
+
+        // Ribbon setup and binning, SETUP_CHUNK segments per task; bins
+        // keep the draw order.
+        static void binRibbons(Backend& b, const View& v) {
+            size_t total = 0;
+            for (const Draw& d : b.draws) total += d.count;
+            b.ribbons.resize(total);
+
+            b.chunkFirst.clear();
+            std::vector<std::pair<size_t, size_t>> chunks; // draw, first segment
+            size_t ribbon = 0;
+            for (size_t di = 0; di < b.draws.size(); ++di) {
+                for (size_t i = 0; i < b.draws[di].count; i += SETUP_CHUNK) {
+                    chunks.push_back({ di, i });
+                    b.chunkFirst.push_back(ribbon);
+                    ribbon += std::min(SETUP_CHUNK, b.draws[di].count - i);
+                }
+            }
+
+            const size_t tileCount = size_t(b.tilesX) * size_t(b.tilesY);
+            b.bins.resize(chunks.size());
+            for (auto& bins : b.bins) {
+                bins.resize(tileCount);
+                for (auto& bin : bins) bin.clear();
+            }
+
+            b.pool.run((int)chunks.size(), [&](int c)
+                {
+                    const Draw& d = b.draws[chunks[c].first];
+                    const size_t first = chunks[c].second;
+                    const size_t n = std::min(SETUP_CHUNK, d.count - first);
+                    std::vector<std::vector<uint32_t>>& bins = b.bins[c];
+
+                    for (size_t i = 0; i < n; ++i) {
+                        const size_t index = b.chunkFirst[c] + i;
+                        Ribbon& rb = b.ribbons[index];
+                        rb = setupRibbon(v, d, first + i);
+
+                        int x0, y0, x1, y1;
+                        if (!ribbonBounds(v, rb, x0, y0, x1, y1)) continue;
+                        for (int ty = y0 / TILE; ty <= (y1 - 1) / TILE; ++ty) {
+                            for (int tx = x0 / TILE; tx <= (x1 - 1) / TILE; ++tx) {
+                                bins[size_t(ty) * b.tilesX + tx].push_back((uint32_t)index);
+                            }
+                        }
+                    }
+                });
+        }
+
+        // Every tile's ribbons, all their passes, on the worker pool.
+        static void rasterize(Backend& b, const View& v) {
+            b.pool.run(b.tilesX * b.tilesY, [&](int tile)
+                {
+                    const int tx = tile % b.tilesX;
+                    const int ty = tile / b.tilesX;
+                    const int x0 = tx * TILE, y0 = ty * TILE;
+                    const int x1 = std::min(x0 + TILE, v.width);
+                    const int y1 = std::min(y0 + TILE, v.height);
+
+                    for (const auto& bins : b.bins) {
+                        for (uint32_t index : bins[(size_t)tile]) {
+                            const Ribbon& rb = b.ribbons[index];
+                            for (int pass = 0; pass < rb.passes; ++pass) {
+                                drawRibbonPass(v, rb, pass, x0, y0, x1, y1, b.hdr);
+                            }
+                        }
+                    }
+                });
+        }
+
+        // BRIGHT_FS, BLUR_FS (H, V) and COMPOSITE_FS into b.rgba (top-down,
+        // 8-bit like the GL readback).
+        static void postProcess(Backend& b, const Renderer& r) {
+            const int rowsPerTask = 16;
+            auto rows = [&b](int h, const std::function<void(int)>& fn) {
+                const int tasks = (h + rowsPerTask - 1) / rowsPerTask;
+                b.pool.run(tasks, [&](int t) {
+                    const int end = std::min((t + 1) * rowsPerTask, h);
+                    for (int y = t * rowsPerTask; y < end; ++y) fn(y);
+                });
+            };
+
+            Planes& A = b.bloomA;
+            Planes& B = b.bloomB;
+            const bool bloom = r.bloomEnabled && A.w > 0 && A.h > 0;
+            if (bloom) {
+                rows(A.h, [&](int y) {
+                    for (int x = 0; x < A.w; ++x) {
+                        const glm::vec3 hdr = sampleLinear(b.hdr,
+                            (float(x) + 0.5f) / float(A.w), (float(y) + 0.5f) / float(A.h));
+                        const glm::vec3 mapped = tonemap(hdr, r.exposure);
+                        store(A, x, y, glm::max(mapped - glm::vec3(r.bloomThreshold), glm::vec3(0.0f)));
+                    }
+                });
+
+                // Taps land on texel centers, so the bilinear fetches are exact.
+                auto blur = [&](const Planes& src, Planes& dst, int dx, int dy) {
+                    rows(dst.h, [&](int y) {
+                        for (int x = 0; x < dst.w; ++x) {
+                            glm::vec3 c = texel(src, x, y) * 0.2270270270f;
+                            c += texel(src, x + dx, y + dy) * 0.3162162162f;
+                            c += texel(src, x - dx, y - dy) * 0.3162162162f;
+                            c += texel(src, x + 2 * dx, y + 2 * dy) * 0.0702702703f;
+                            c += texel(src, x - 2 * dx, y - 2 * dy) * 0.0702702703f;
+                            store(dst, x, y, c);
+                        }
+                    });
+                };
+                blur(A, B, 1, 0);
+                blur(B, A, 0, 1);
+            }
+
+            const int w = b.hdr.w;
+            const int h = b.hdr.h;
+            const float strength = bloom ? r.bloomStrength : 0.0f;
+            const float exposure = r.exposure * r.hdrScale;
+            rows(h, [&](int y) {
+                unsigned char* out = &b.rgba[size_t(h - 1 - y) * size_t(w) * 4];
+                for (int x = 0; x < w; ++x) {
+                    const glm::vec3 hdr = texel(b.hdr, x, y);
+                    glm::vec3 color = tonemap(hdr, exposure);
+                    if (bloom) {
+                        color += strength * sampleLinear(A,
+                            (float(x) + 0.5f) / float(w), (float(y) + 0.5f) / float(h));
+                    }
+                    color = glm::pow(glm::max(color, glm::vec3(0.0f)), glm::vec3(1.0f / 2.2f));
+                    for (int c = 0; c < 3; ++c) {
+                        out[x * 4 + c] = (unsigned char)std::lrint(
+                            std::clamp(color[c], 0.0f, 1.0f) * 255.0f);
+                    }
+                    out[x * 4 + 3] = 255;
+                }
+            });
+        }
+
+    } // namespace Cpu_
+
+    // RenderBackend::CPU counterpart of renderFrame.
+    static void renderFrameCPU(Renderer& r, Cpu_::Backend& b,
+        const RenderSettings& settings,
+        FFmpegPipe* ffmpeg,
+        int frameIndex,
+        SegmentStaging& segments)
+    {
+        FrameStats stats;
+        stats.frame = frameIndex;
+        stats.passes = r.passCount;
+
+        cullSegments(r, settings, segments, stats);
+        lodMergeSegments(r, settings, segments, stats);
+        splitSampleGroups(r, settings, segments, stats);
+        stats.segments = segments.size();
+
+        const StatsClock::time_point t0 = StatsClock::now();
+
+        Cpu_::View v;
+        v.viewProj = r.proj * r.view;
+        v.camRight = glm::vec3(r.view[0][0], r.view[1][0], r.view[2][0]);
+        const glm::vec3 camUp(r.view[0][1], r.view[1][1], r.view[2][1]);
+        v.camForward = glm::normalize(glm::cross(v.camRight, camUp));
+        v.width = r.viewport.width;
+        v.height = r.viewport.height;
+        v.thicknessScale = r.thicknessScale;
+        v.energyPerHit = r.energyPerHit;
+        v.inner = 0.60f + (0.95f - 0.60f) * r.softEdge;
+        v.frameSeed = (uint32_t(frameIndex) * 2246822519u) ^ (r.seed32 * 3266489917u);
+        v.analytic = r.analytic;
+        v.additive = r.blendMode == LineBlendMode::AdditiveLightPainting;
+        v.profile = b.profile.empty() ? nullptr : b.profile.data();
+
+        b.hdr.resize(v.width, v.height, !v.additive);
+        Cpu_::collectDraws(b, r, segments);
+        Cpu_::binRibbons(b, v);
+        Cpu_::rasterize(b, v);
+        Cpu_::postProcess(b, r);
+
+        stats.draw_ms = msSince(t0);
+
+        const int w = r.viewport.width;
+        const int h = r.viewport.height;
+        beginFrameOutput(r.output, frameIndex);
+        bool written;
+        if (settings.output_mode == OutputMode::FFmpegVideo && ffmpeg && ffmpeg->enabled) {
+            written = ffmpegWriteFrame(*ffmpeg, b.rgba.data(), w, h);
+        }
+        else {
+            fs::create_directories(settings.output_dir);
+            const std::string path = framePngPath(settings.output_dir, frameIndex);
+            written = stbi_write_png(path.c_str(), w, h, 4, b.rgba.data(), w * 4) != 0;
+        }
+        if (written) endFrameOutput(r.output, frameIndex);
+        else failFrameOutput(r.output, frameIndex);
+
+        if (r.statsCb) {
+            r.statsCb(stats);
+        }
+    }
+
+    // Sequence driver of RenderBackend::CPU: renderSequenceImpl's frame
+    // loop without a window or GL context.
+    static void renderSequenceCPU(const RenderSettings& settings,
+        const CameraCallback& cameraCb,
+        void* camera_user_ptr,
+        const FrameSegmentSource& source,
+        OutputProgress& output,
+        const FrameRange& range)
+    {
+        Renderer renderer;
+        initRendererParams(renderer, settings);
+        renderer.output = &output;
 
-        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.bloomA.fbo);
-        glViewport(0, 0, hw, hh);
-        glDisable(GL_DEPTH_TEST);
-        glClearColor(0, 0, 0, 0);
-        glClear(GL_COLOR_BUFFER_BIT);
+        Cpu_::Backend backend(settings);
+        Cpu_::initBackend(backend, renderer, settings);
 
-        glUseProgram(r.programs.bright);
-        glBindVertexArray(r.geom.vaoFSQ);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, r.fbos.hdr.colorTex);
-        glUniform1i(r.brightU.uHDRTex, 0);
-        glUniform1f(r.brightU.uExposure, r.exposure);
-        glUniform1f(r.brightU.uThreshold, r.bloomThreshold);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        FFmpegPipe ffmpeg{};
+        openOutput(output, ffmpeg);
 
-        // Blur H
-        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.bloomB.fbo);
-        glViewport(0, 0, hw, hh);
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (settings.pipeline_depth > 0) {
+            FramePipeline pipeline(settings, range, cameraCb, camera_user_ptr, source);
 
-        glUseProgram(r.programs.blur);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, r.fbos.bloomA.colorTex);
-        glUniform1i(r.blurU.uTex, 0);
-        glUniform2f(r.blurU.uTexelSize, 1.0f / hw, 1.0f / hh);
-        glUniform2f(r.blurU.uDirection, 1.0f, 0.0f);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+            ProducedFrame pf;
+            while (!output.failed && pipeline.pop(pf)) {
+                applyCamera(renderer, pf.cam);
+                renderer.layerStates.swap(pf.layers);
 
-        // Blur V
-        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.bloomA.fbo);
-        glViewport(0, 0, hw, hh);
-        glClear(GL_COLOR_BUFFER_BIT);
+                renderFrameCPU(renderer, backend, settings,
+                    ffmpeg.enabled ? &ffmpeg : nullptr, pf.frame, *pf.segments);
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, r.fbos.bloomB.colorTex);
-        glUniform1i(r.blurU.uTex, 0);
-        glUniform2f(r.blurU.uDirection, 0.0f, 1.0f);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+                pipeline.recycle(pf.segments);
+            }
+        }
+        else {
+            for (int f = range.begin; f < range.end && !output.failed; f += range.step) {
+                float t = frameTime(settings, f);
 
-        glBindVertexArray(0);
+                CameraParams cam{};
+                cam.user_ptr = camera_user_ptr;
+
+                if (cameraCb) {
+                    cameraCb(f, t, cam);
+                }
+
+                applyCamera(renderer, cam);
+                evalLayerStates(settings, f, t, renderer.layerStates);
+
+                resetStaging(renderer.staging);
+                if (source) {
+                    source(f, t, renderer.staging);
+                }
+
+                renderFrameCPU(renderer, backend, settings,
+                    ffmpeg.enabled ? &ffmpeg : nullptr, f, renderer.staging);
+            }
+        }
+
+        finishOutput(output);
     }
 
-    // 3) Composite HDR + bloom into full-res LDR FBO
-    static void compositeToLDR(Renderer& r) {
-        glBindFramebuffer(GL_FRAMEBUFFER, r.fbos.ldr.fbo);
-        glViewport(0, 0, r.viewport.width, r.viewport.height);
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT);
+    // ========================================================================
+    // GL context providers (RenderSettings::gl_context)
+    // ========================================================================
+#if WIRE_HAVE_EGL
+    namespace Egl_ {
+
+        // Entry points from libEGL.so.1 (extensions via getProcAddress).
+        struct Api {
+            decltype(&::eglGetProcAddress)       getProcAddress = nullptr;
+            decltype(&::eglQueryString)          queryString = nullptr;
+            decltype(&::eglInitialize)           initialize = nullptr;
+            decltype(&::eglTerminate)            terminate = nullptr;
+            decltype(&::eglBindAPI)              bindAPI = nullptr;
+            decltype(&::eglChooseConfig)         chooseConfig = nullptr;
+            decltype(&::eglCreateContext)        createContext = nullptr;
+            decltype(&::eglDestroyContext)       destroyContext = nullptr;
+            decltype(&::eglCreatePbufferSurface) createPbufferSurface = nullptr;
+            decltype(&::eglDestroySurface)       destroySurface = nullptr;
+            decltype(&::eglMakeCurrent)          makeCurrent = nullptr;
+            PFNEGLGETPLATFORMDISPLAYEXTPROC      getPlatformDisplay = nullptr;
+            PFNEGLQUERYDEVICESEXTPROC            queryDevices = nullptr;
+        };
 
-        glUseProgram(r.programs.composite);
-        glBindVertexArray(r.geom.vaoFSQ);
+    } // namespace Egl_
+#endif
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, r.fbos.hdr.colorTex);
-        glUniform1i(r.compU.uHDRTex, 0);
+    // The context RenderBackend::OpenGL renders with. Everything is drawn
+    // into FBOs, so no provider needs a usable default framebuffer.
+    struct GLContext {
+        GLContextProvider provider = GLContextProvider::GLFWHiddenWindow;
+        std::string source;             // for the log line
+        bool        glfw = false;       // glfwInit succeeded
+        GLFWwindow* window = nullptr;
+#if WIRE_HAVE_EGL
+        Egl_::Api  egl;
+        EGLDisplay display = EGL_NO_DISPLAY;
+        EGLContext context = EGL_NO_CONTEXT;
+        EGLSurface surface = EGL_NO_SURFACE; // 1x1 pbuffer if not surfaceless
+#endif
+    };
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, r.fbos.bloomA.colorTex);
-        glUniform1i(r.compU.uBloomTex, 1);
+    // Context versions to try, best first: splat_max_pixels needs compute
+    // shaders (4.3), everything else runs on 3.3 core.
+    struct GLVersion { int major; int minor; };
+    static const GLVersion GL_VERSIONS[2] = { { 4, 3 }, { 3, 3 } };
 
-        glUniform1f(r.compU.uExposure, r.exposure);
-        glUniform1f(r.compU.uBloomStrength,
-            r.bloomEnabled ? r.bloomStrength : 0.0f);
+#if WIRE_HAVE_EGL
+    namespace Egl_ {
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        glBindVertexArray(0);
-    }
+        static bool hasExtension(const char* list, const char* name) {
+            if (!list) return false;
+            const size_t n = std::strlen(name);
+            for (const char* p = std::strstr(list, name); p; p = std::strstr(p + n, name)) {
+                if ((p == list || p[-1] == ' ') && (p[n] == ' ' || p[n] == '\0')) return true;
+            }
+            return false;
+        }
 
-    static void renderFrame(Renderer& r,
-        const RenderSettings& settings,
-        FFmpegPipe* ffmpeg,
-        int frameIndex,
-        float timeSec,
-        const LineCallback& lineCb)
-    {
-        static std::vector<LineInstanceGPU> frameSegments;
-        frameSegments.clear();
+        // libEGL stays loaded after the sequence: not every driver
+        // survives being unloaded.
+        static bool load(Api& api) {
+            static void* lib = dlopen("libEGL.so.1", RTLD_NOW | RTLD_LOCAL);
+            if (!lib) return false;
+
+            auto sym = [](auto& fn, const char* name) {
+                fn = reinterpret_cast<std::remove_reference_t<decltype(fn)>>(dlsym(lib, name));
+                return fn != nullptr;
+            };
+            const bool core = sym(api.getProcAddress, "eglGetProcAddress") &&
+                sym(api.queryString, "eglQueryString") &&
+                sym(api.initialize, "eglInitialize") &&
+                sym(api.terminate, "eglTerminate") &&
+                sym(api.bindAPI, "eglBindAPI") &&
+                sym(api.chooseConfig, "eglChooseConfig") &&
+                sym(api.createContext, "eglCreateContext") &&
+                sym(api.destroyContext, "eglDestroyContext") &&
+                sym(api.createPbufferSurface, "eglCreatePbufferSurface") &&
+                sym(api.destroySurface, "eglDestroySurface") &&
+                sym(api.makeCurrent, "eglMakeCurrent");
+            if (!core) return false;
+
+            api.getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                api.getProcAddress("eglGetPlatformDisplayEXT"));
+            api.queryDevices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(
+                api.getProcAddress("eglQueryDevicesEXT"));
+            return api.getPlatformDisplay != nullptr;
+        }
 
-        buildFrameSegments(settings, frameIndex, timeSec,
-            lineCb, frameSegments);
+        // Core context of one of 'versions' on ctx.display, made current.
+        // Without EGL_KHR_no_config_context / EGL_KHR_surfaceless_context
+        // a pbuffer config and a 1x1 pbuffer stand in.
+        static bool makeContext(GLContext& ctx, const GLVersion* versions, int count) {
+            const Api& egl = ctx.egl;
+            const char* ext = egl.queryString(ctx.display, EGL_EXTENSIONS);
+            const bool noConfig = hasExtension(ext, "EGL_KHR_no_config_context");
+            const bool surfaceless = hasExtension(ext, "EGL_KHR_surfaceless_context");
+            if (!egl.bindAPI(EGL_OPENGL_API)) return false;
+
+            EGLConfig config = EGL_NO_CONFIG_KHR;
+            if (!noConfig || !surfaceless) {
+                const EGLint attribs[] = {
+                    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                    EGL_NONE };
+                EGLint n = 0;
+                if (!egl.chooseConfig(ctx.display, attribs, &config, 1, &n) || n < 1) return false;
+            }
 
-        accumulateScene(r, settings, frameIndex, timeSec, frameSegments);
+            for (int i = 0; i < count && ctx.context == EGL_NO_CONTEXT; ++i) {
+                const EGLint attribs[] = {
+                    EGL_CONTEXT_MAJOR_VERSION, versions[i].major,
+                    EGL_CONTEXT_MINOR_VERSION, versions[i].minor,
+                    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                    EGL_NONE };
+                ctx.context = egl.createContext(ctx.display, config, EGL_NO_CONTEXT, attribs);
+            }
+            if (ctx.context == EGL_NO_CONTEXT) return false;
 
-        if (r.bloomEnabled) {
-            applyBloom(r);
+            if (!surfaceless) {
+                const EGLint attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+                ctx.surface = egl.createPbufferSurface(ctx.display, config, attribs);
+            }
+            if (!egl.makeCurrent(ctx.display, ctx.surface, ctx.surface, ctx.context)) {
+                if (ctx.surface != EGL_NO_SURFACE) egl.destroySurface(ctx.display, ctx.surface);
+                egl.destroyContext(ctx.display, ctx.context);
+                ctx.surface = EGL_NO_SURFACE;
+                ctx.context = EGL_NO_CONTEXT;
+                return false;
+            }
+            return true;
         }
 
-        compositeToLDR(r);
+        static bool tryDisplay(GLContext& ctx, EGLDisplay display,
+            const GLVersion* versions, int count)
+        {
+            if (display == EGL_NO_DISPLAY) return false;
+            EGLint major = 0, minor = 0;
+            if (!ctx.egl.initialize(display, &major, &minor)) return false;
+
+            ctx.display = display;
+            if (makeContext(ctx, versions, count)) return true;
+            ctx.egl.terminate(display);
+            ctx.display = EGL_NO_DISPLAY;
+            return false;
+        }
 
-        // Read back from full-res LDR FBO
-        saveOrStreamBackbuffer(r.readback,
-            frameIndex,
-            r.viewport.width,
-            r.viewport.height,
-            settings.output_dir,
-            settings.output_mode,
-            ffmpeg,
-            r.fbos.ldr.fbo);
+        // RenderSettings::egl_device (or each device in turn), then Mesa's
+        // surfaceless platform.
+        static bool create(GLContext& ctx, const RenderSettings& settings,
+            const GLVersion* versions, int count)
+        {
+            Api& egl = ctx.egl;
+            if (!load(egl)) {
+                std::cerr << "[WireEngine] libEGL.so.1 (with EGL_EXT_platform_base) not found\n";
+                return false;
+            }
+            const char* client = egl.queryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+            if (egl.queryDevices && hasExtension(client, "EGL_EXT_platform_device")) {
+                EGLDeviceEXT devices[16];
+                EGLint n = 0;
+                if (!egl.queryDevices(16, devices, &n)) n = 0;
+                for (EGLint i = 0; i < n; ++i) {
+                    if (settings.egl_device >= 0 && i != settings.egl_device) continue;
+                    const EGLDisplay d = egl.getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT,
+                        devices[i], nullptr);
+                    if (tryDisplay(ctx, d, versions, count)) {
+                        ctx.source = "EGL device " + std::to_string(i);
+                        return true;
+                    }
+                }
+                if (settings.egl_device >= 0) {
+                    std::cerr << "[WireEngine] EGL device " << settings.egl_device
+                        << " of " << n << " gave no context; trying surfaceless.\n";
+                }
+            }
+
+            if (hasExtension(client, "EGL_MESA_platform_surfaceless")) {
+                const EGLDisplay d = egl.getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                    EGL_DEFAULT_DISPLAY, nullptr);
+                if (tryDisplay(ctx, d, versions, count)) {
+                    ctx.source = "EGL surfaceless";
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static void destroy(GLContext& ctx) {
+            const Api& egl = ctx.egl;
+            if (ctx.display == EGL_NO_DISPLAY) return;
+            egl.makeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (ctx.surface != EGL_NO_SURFACE) egl.destroySurface(ctx.display, ctx.surface);
+            if (ctx.context != EGL_NO_CONTEXT) egl.destroyContext(ctx.display, ctx.context);
+            egl.terminate(ctx.display);
+            ctx.display = EGL_NO_DISPLAY;
+            ctx.context = EGL_NO_CONTEXT;
+            ctx.surface = EGL_NO_SURFACE;
+        }
+
+    } // namespace Egl_
+#endif
+
+    static void destroyGLContext(GLContext& ctx) {
+#if WIRE_HAVE_EGL
+        Egl_::destroy(ctx);
+#endif
+        if (ctx.window) glfwDestroyWindow(ctx.window);
+        if (ctx.glfw) glfwTerminate();
+        ctx.window = nullptr;
+        ctx.glfw = false;
     }
 
-    // ========================================================================
-    // Public API: renderSequence
-    // ========================================================================
-    void renderSequence(const RenderSettings& settings,
-        const CameraCallback& cameraCb,
-        const LineCallback& lineCb,
-        void* camera_user_ptr
-    )
+    // Hidden window of winW x winH (tiled frames may exceed any window
+    // size, so the caller passes the tile).
+    static bool createGLFWContext(GLContext& ctx, int winW, int winH,
+        const GLVersion* versions, int count)
     {
         if (!glfwInit()) {
             std::cerr << "[WireEngine] GLFW init failed\n";
-            return;
+            return false;
         }
+        ctx.glfw = true;
 
         glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-        GLFWwindow* win = glfwCreateWindow(settings.width, settings.height,
-            "WireEngine_Offscreen", nullptr, nullptr);
-        if (!win) {
+        for (int i = 0; i < count && !ctx.window; ++i) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, versions[i].major);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, versions[i].minor);
+            ctx.window = glfwCreateWindow(winW, winH,
+                "WireEngine_Offscreen", nullptr, nullptr);
+        }
+        if (!ctx.window) {
             std::cerr << "[WireEngine] Window create failed\n";
-            glfwTerminate();
-            return;
+            return false;
+        }
+        glfwMakeContextCurrent(ctx.window);
+        ctx.source = "GLFW window";
+        return true;
+    }
+
+    // Current context from settings.gl_context (EGL falls back to GLFW),
+    // with GL entry points loaded. On false nothing is left to destroy.
+    static bool createGLContext(GLContext& ctx, const RenderSettings& settings,
+        int winW, int winH)
+    {
+        const bool wantCompute = settings.splat_max_pixels > 0.0f;
+        const GLVersion* versions = wantCompute ? GL_VERSIONS : GL_VERSIONS + 1;
+        const int count = wantCompute ? 2 : 1;
+
+        ctx.provider = settings.gl_context;
+        bool ok = false;
+        if (ctx.provider == GLContextProvider::EGLHeadless) {
+#if WIRE_HAVE_EGL
+            ok = Egl_::create(ctx, settings, versions, count);
+            if (!ok) std::cerr << "[WireEngine] No EGL context; using a hidden GLFW window.\n";
+#else
+            std::cerr << "[WireEngine] Built without EGL; using a hidden GLFW window.\n";
+#endif
+        }
+        if (!ok) {
+            ctx.provider = GLContextProvider::GLFWHiddenWindow;
+            ok = createGLFWContext(ctx, winW, winH, versions, count);
+        }
+        if (!ok) {
+            destroyGLContext(ctx);
+            return false;
         }
 
-        glfwMakeContextCurrent(win);
         glewExperimental = GL_TRUE;
-        if (glewInit() != GLEW_OK) {
+        const GLenum glew = glewInit();
+        ok = glew == GLEW_OK;
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        // A GLX build of GLEW loads the entry points of an EGL context but
+        // then finds no GLX display to query.
+        ok = ok || (glew == GLEW_ERROR_NO_GLX_DISPLAY &&
+            ctx.provider == GLContextProvider::EGLHeadless);
+#endif
+        if (!ok) {
             std::cerr << "[WireEngine] GLEW init failed\n";
-            glfwDestroyWindow(win);
-            glfwTerminate();
+            destroyGLContext(ctx);
+            return false;
+        }
+        return true;
+    }
+
+    // ========================================================================
+    // Sequence driver shared by the pull and push APIs
+    // ========================================================================
+    static void renderSequenceImpl(const RenderSettings& settings,
+        const CameraCallback& cameraCb,
+        void* camera_user_ptr,
+        const FrameSegmentSource& source)
+    {
+        if (frameRange(settings).count() == 0) {
+            std::cerr << "[WireEngine] Empty frame range, nothing to render.\n";
+            return;
+        }
+
+        // Frames still to render: a checkpoint may have some already.
+        OutputProgress output;
+        if (!beginOutput(output, settings)) {
+            return;
+        }
+        FrameRange range = output.range;
+        range.begin = output.next;
+
+        if (settings.backend == RenderBackend::CPU) {
+            renderSequenceCPU(settings, cameraCb, camera_user_ptr, source, output, range);
+            return;
+        }
+        if (range.count() == 0) {
+            // All frames are out, only the segments are left to join.
+            finishOutput(output);
+            return;
+        }
+
+        // Rendering is offscreen; tiled frames may exceed any window size.
+        const int winW = settings.tile_size > 0 ? settings.tile_size : settings.width;
+        const int winH = settings.tile_size > 0 ? settings.tile_size : settings.height;
+
+        const StatsClock::time_point t0 = StatsClock::now();
+        GLContext context;
+        if (!createGLContext(context, settings, winW, winH)) {
             return;
         }
+        const double contextMs = msSince(t0);
+        std::cout << "[WireEngine] GL context: " << context.source << ", "
+            << reinterpret_cast<const char*>(glGetString(GL_VERSION)) << ", "
+            << reinterpret_cast<const char*>(glGetString(GL_RENDERER)) << " ("
+            << std::fixed << std::setprecision(1) << contextMs << " ms)\n"
+            << std::defaultfloat;
 
-        glViewport(0, 0, settings.width, settings.height);
+        glViewport(0, 0, winW, winH);
 
         Renderer renderer;
         initRenderer(renderer, settings);
+        renderer.windowEvents = context.window != nullptr;
+        renderer.contextMs = contextMs;
+        renderer.output = &output;
 
         FFmpegPipe ffmpeg{};
-        if (settings.output_mode == OutputMode::FFmpegVideo) {
-            if (!openFFmpegPipe(ffmpeg, settings)) {
-                std::cerr << "[WireEngine] FFmpeg mode requested but pipe failed; "
-                    << "falling back to PNG frames.\n";
-                ffmpeg.enabled = false;
-            }
-        }
+        openOutput(output, ffmpeg);
 
-        for (int f = 0; f < settings.frames; ++f) {
-            float t = (settings.fps > 0.0f) ? (float(f) / settings.fps) : float(f);
+        if (settings.pipeline_depth > 0) {
+            // Callbacks run on the producer thread, GL work stays here.
+            FramePipeline pipeline(settings, range, cameraCb, camera_user_ptr, source);
 
-            CameraParams cam{};
-            cam.user_ptr = camera_user_ptr;
+            ProducedFrame pf;
+            while (!output.failed && pipeline.pop(pf)) {
+                applyCamera(renderer, pf.cam);
+                renderer.layerStates.swap(pf.layers);
 
-            if (cameraCb) {
-                cameraCb(f, t, cam);
-            }
+                renderFrame(renderer,
+                    settings,
+                    ffmpeg.enabled ? &ffmpeg : nullptr,
+                    pf.frame,
+                    pf.t,
+                    *pf.segments);
 
-            glm::vec3 eye = glm::vec3(cam.eye_x, cam.eye_y, cam.eye_z);
-            glm::vec3 target = glm::vec3(cam.target_x, cam.target_y, cam.target_z);
-            glm::vec3 up = glm::vec3(cam.up_x, cam.up_y, cam.up_z);
+                pipeline.recycle(pf.segments);
 
-            renderer.view = glm::lookAt(eye, target, up);
+                pollWindowEvents(renderer);
+            }
+        }
+        else {
+            for (int f = range.begin; f < range.end && !output.failed; f += range.step) {
+                float t = frameTime(settings, f);
 
-            float fovY = renderer.baseFovYDeg;
-            float nearP = renderer.baseNearPlane;
-            float farP = renderer.baseFarPlane;
+                CameraParams cam{};
+                cam.user_ptr = camera_user_ptr;
 
-            if (cam.has_custom_fov)   fovY = cam.fov_y_deg;
-            if (cam.has_custom_clip) { nearP = cam.near_plane; farP = cam.far_plane; }
+                if (cameraCb) {
+                    cameraCb(f, t, cam);
+                }
 
-            if (fovY <= 0.0f)          fovY = renderer.baseFovYDeg;
-            if (nearP <= 0.0f)         nearP = renderer.baseNearPlane;
-            if (farP <= nearP + 1e-4f) farP = renderer.baseFarPlane;
+                applyCamera(renderer, cam);
+                evalLayerStates(settings, f, t, renderer.layerStates);
 
-            float aspect = float(renderer.viewport.width) /
-                float(renderer.viewport.height);
+                if (settings.stream_flush_batches && !renderer.tiles.enabled) {
+                    renderFrameStreamed(renderer,
+                        settings,
+                        ffmpeg.enabled ? &ffmpeg : nullptr,
+                        f,
+                        t,
+                        source);
 
-            renderer.proj = glm::perspective(glm::radians(fovY),
-                aspect,
-                nearP,
-                farP);
+                    pollWindowEvents(renderer);
+                    continue;
+                }
 
-            renderFrame(renderer,
-                settings,
-                ffmpeg.enabled ? &ffmpeg : nullptr,
-                f,
-                t,
-                lineCb);
+                resetStaging(renderer.staging);
+                if (source) {
+                    source(f, t, renderer.staging);
+                }
 
-            glfwPollEvents();
+                renderFrame(renderer,
+                    settings,
+                    ffmpeg.enabled ? &ffmpeg : nullptr,
+                    f,
+                    t,
+                    renderer.staging);
+
+                pollWindowEvents(renderer);
+            }
         }
 
         if (settings.use_pbo) {
             flushLastPBOFrame(renderer.readback,
-                settings.frames - 1,
                 renderer.viewport.width,
                 renderer.viewport.height,
                 settings.output_dir,
                 settings.output_mode,
-                ffmpeg.enabled ? &ffmpeg : nullptr);
+                ffmpeg.enabled ? &ffmpeg : nullptr,
+                &output);
         }
 
-        if (ffmpeg.enabled) {
-            closeFFmpegPipe(ffmpeg);
-        }
+        finishOutput(output);
 
         destroyRenderer(renderer);
-        glfwDestroyWindow(win);
-        glfwTerminate();
+        destroyGLContext(context);
+    }
+
+    // ========================================================================
+    // Public API: renderSequence (pull-style)
+    // ========================================================================
+    void renderSequence(const RenderSettings& settings,
+        const CameraCallback& cameraCb,
+        const LineCallback& lineCb,
+        void* camera_user_ptr
+    )
+    {
+        FrameSegmentSource source =
+            [&settings, &lineCb](int frame, float t, SegmentStaging& out)
+            {
+                buildFrameSegments(settings, frame, t, lineCb, out);
+            };
+
+        renderSequenceImpl(settings, cameraCb, camera_user_ptr, source);
+    }
+
+    // ========================================================================
+    // Public API: renderSequenceBatched (batched pull-style)
+    // ========================================================================
+    void renderSequenceBatched(const RenderSettings& settings,
+        const CameraCallback& cameraCb,
+        const LineCountCallback& countCb,
+        const LineBatchCallback& batchCb,
+        void* camera_user_ptr)
+    {
+        FrameSegmentSource source =
+            [&countCb, &batchCb](int frame, float t, SegmentStaging& out)
+            {
+                buildFrameSegmentsBatched(frame, t, countCb, batchCb, out);
+            };
+
+        renderSequenceImpl(settings, cameraCb, camera_user_ptr, source);
     }
 
     // ========================================================================
-   // New: push-style wrapper around the existing pull-style API
-   // ========================================================================
+    // Public API: renderSequencePush (push-style)
+    // ========================================================================
     void renderSequencePush(const RenderSettings& settings,
         const CameraCallback& cameraCb,
         const LinePushCallback& pushCb,
         void* user_ptr)
     {
-        // If no push-callback, just render nothing.
-        if (!pushCb) {
-            LineCallback empty;
-            renderSequence(settings, cameraCb, empty, user_ptr);
-            return;
-        }
+        // The push-callback writes straight into the engine staging buffer:
+        // ctx.add() is an inline append, there is no intermediate vector and
+        // no per-index pull loop.
+        EmitPool pool(settings.worker_threads);
+
+        FrameSegmentSource source =
+            [&pushCb, &pool, user_ptr, &settings](int frame, float t, SegmentStaging& out)
+            {
+                if (!pushCb) return; // render nothing
+
+                LineEmitContext ctx;
+                ctx.user_ptr = user_ptr;
+                ctx.seed = settings.seed;
+                ctx.sink = &out.sink;
+                ctx.shapes = &out.shapes;
+                ctx.primitives = &out.primitives;
+                ctx.lod = &out.lodMarks;
+                ctx.sampleMarks = &out.sampleMarks;
+                ctx.pool = &pool;
+
+                // flush_now() marks a batch boundary (incremental upload,
+                // LOD chains never cross it) or streams the batch out.
+                ctx.flush = [&out]() {
+                    if (out.onFlush) {
+                        out.onFlush(out);
+                    }
+                    else if (out.size() > 0 &&
+                        (out.batchEnds.empty() || out.batchEnds.back() < out.size()))
+                    {
+                        out.batchEnds.push_back(out.size());
+                    }
+                };
 
-        // State that lives for the whole duration of renderSequencePush.
-        struct PushState {
-            const RenderSettings* settings = nullptr;  // currently unused
-            LinePushCallback      pushCb;
-            void* user_ptr = nullptr;
+                pushCb(frame, t, ctx);
+            };
 
-            int   cachedFrame = -1;
-            float cachedTime = -1.0f;
+        renderSequenceImpl(settings, cameraCb, user_ptr, source);
+    }
 
-            // Lines generated for the current frame by the push-callback.
-            std::vector<LineParams> cachedLines;
-        };
+    // ========================================================================
+    // Public API: frame-range shards
+    // ========================================================================
+    RenderSettings shardSettings(const RenderSettings& settings,
+        int shard, int shardCount)
+    {
+        if (shardCount <= 0 || shard < 0 || shard >= shardCount) {
+            std::cerr << "[WireEngine] Invalid shard " << shard << " of " << shardCount
+                << " (need 0 <= shard < shardCount).\n";
+            std::exit(EXIT_FAILURE);
+        }
 
-        PushState state;
-        state.settings = &settings;
-        state.pushCb = pushCb;
-        state.user_ptr = user_ptr;
+        const FrameRange range = frameRange(settings);
+        const long long count = range.count();
+        const long long n = shardCount;
+        const long long i = shard;
+
+        // Frames lo .. hi - 1 of the range (by position, not by index).
+        const long long lo = count * i / n;
+        const long long hi = count * (i + 1) / n;
+
+        RenderSettings out = settings;
+        out.frame_begin = int(range.begin + lo * range.step);
+        out.frame_end = int(std::min<long long>(range.begin + hi * range.step, range.end));
+        out.frame_step = range.step;
+        if (hi <= lo) out.frame_end = out.frame_begin;
+        return out;
+    }
 
-        // Adapter: turns the push-style generator into the old pull-style
-        // LineCallback. The engine will keep calling this with segmentIndex
-        // 0,1,2,... until we return false.
-        LineCallback adapter =
-            [&state](int frame, float t, int segmentIndex, LineParams& out) -> bool
-            {
-                // If this is a new frame, (re)build the list of lines by calling
-                // the push-style callback once.
-                if (frame != state.cachedFrame) {
-                    state.cachedFrame = frame;
-                    state.cachedTime = t;
-                    state.cachedLines.clear();
-
-                    LineEmitContext ctx;
-                    ctx.user_ptr = state.user_ptr;
-
-                    // When the user calls ctx.emit(lp), we just append lp
-                    // into cachedLines.
-                    ctx.emit = [&state](const LineParams& lp) {
-                        state.cachedLines.push_back(lp);
-                        };
-
-                    // For now, flush is a no-op; the engine renders once per frame
-                    // after it has all segments anyway. In the future this could
-                    // be used to define "batches" or streaming.
-                    ctx.flush = []() {};
-
-                    // Let the user generate all lines for this frame:
-                    if (state.pushCb) {
-                        state.pushCb(frame, t, ctx);
-                    }
-                }
+    std::string shardVideoPath(const RenderSettings& settings) {
+        return rangeVideoPath(settings, frameRange(settings));
+    }
 
-                // Serve the requested segmentIndex out of the cached list.
-                if (segmentIndex < 0 ||
-                    segmentIndex >= static_cast<int>(state.cachedLines.size())) {
-                    return false; // no more segments
-                }
+    bool mergeShards(const RenderSettings& settings, int shardCount) {
+        if (shardCount <= 0) {
+            std::cerr << "[WireEngine] Invalid shard count " << shardCount << ".\n";
+            return false;
+        }
+        const int n = shardCount;
+
+        if (settings.output_mode == OutputMode::FramesPNG) {
+            const FrameRange range = frameRange(settings);
+            int missing = 0;
+            for (int f = range.begin; f < range.end; f += range.step) {
+                const std::string path = framePngPath(settings.output_dir, f);
+                if (fs::exists(path)) continue;
+                if (missing++ < 8) std::cerr << "[WireEngine] Missing frame " << path << "\n";
+            }
+            if (missing > 0) {
+                std::cerr << "[WireEngine] " << missing << " of " << range.count()
+                    << " frames missing in " << settings.output_dir << "\n";
+            }
+            return missing == 0;
+        }
 
-                out = state.cachedLines[static_cast<std::size_t>(segmentIndex)];
-                return true;
-            };
+        std::vector<std::string> parts;
+        bool complete = true;
+        std::error_code ec;
+        for (int i = 0; i < n; ++i) {
+            const RenderSettings shard = shardSettings(settings, i, n);
+            if (frameRange(shard).count() == 0) continue;
+
+            const std::string path = shardVideoPath(shard);
+            if (!fs::exists(path, ec) || fs::file_size(path, ec) == 0) {
+                std::cerr << "[WireEngine] Missing shard " << i << ": " << path << "\n";
+                complete = false;
+            }
+            parts.push_back(path);
+        }
+        return complete && concatVideos(settings, parts, settings.ffmpeg_output);
+    }
 
-        // Reuse the existing engine implementation.
-        renderSequence(settings, cameraCb, adapter, user_ptr);
+    ShapePrototype makeShapePrototype(const std::string& name,
+        const std::function<void(LineEmitContext& ctx)>& build,
+        void* user_ptr)
+    {
+        ShapePrototype proto;
+        proto.name = name;
+        proto.segments = makeStaticLayer(name, build, user_ptr).segments;
+        return proto;
     }
 
+    StaticLayer makeStaticLayer(const std::string& name,
+        const std::function<void(LineEmitContext& ctx)>& build,
+        void* user_ptr)
+    {
+        StaticLayer layer;
+        layer.name = name;
+        if (!build) return layer;
+
+        SegmentStaging st;
+        initStaging(st, 4096);
+
+        LineEmitContext ctx;
+        ctx.user_ptr = user_ptr;
+        ctx.sink = &st.sink;
+        ctx.flush = []() {};
+        build(ctx);
+
+        layer.segments.assign(st.data(), st.data() + st.size());
+        return layer;
+    }
 
 } // namespace WireEngine
@@ -1,6 +1,13 @@
 #pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <new>
+#include <span>
 #include <string>
+#include <vector>
 
 namespace WireEngine {
 
@@ -31,12 +38,197 @@ namespace WireEngine {
         FFmpegVideo  // stream raw frames into ffmpeg
     };
 
+    // Where frames are rendered
+    enum class RenderBackend {
+        OpenGL, // GL 3.3 core in a hidden GLFW window
+        CPU     // software rasterizer on worker_threads, no window or GPU
+    };
+
+    // Where RenderBackend::OpenGL gets its context
+    enum class GLContextProvider {
+        GLFWHiddenWindow, // hidden GLFW window, needs a display / window system
+        EGLHeadless       // EGL device or Mesa surfaceless platform: no window,
+                          // no display (Linux builds with EGL headers)
+    };
+
     // Blending / depth behaviour for line rendering
     enum class LineBlendMode {
         AdditiveLightPainting, // additive, no depth test (classic light painting)
         OpaqueWithDepth        // opaque lines with depth test/write
     };
 
+    // How per-segment instance data is stored on the GPU
+    enum class InstanceFormat {
+        Float32,        // 60 bytes: LineParams as-is, fixed vertex attributes
+        PackedQuantized // 24 bytes: 16-bit positions per 64-segment chunk,
+                        // RGB9E5 colors (intensity folded in), half thickness
+                        // and jitter; pulled by the vertex shader from a
+                        // buffer texture
+    };
+
+    // How segment jitter is accumulated
+    enum class JitterMode {
+        Stochastic, // random radial offset per pass, converges over accum_passes
+        Analytic    // one pass per segment: ribbon widened by the jitter radius,
+                    // shaded with the expected coverage of the jitter
+                    // (lookup table), weighted by accum_passes;
+                    // additive blend only (else Stochastic is used)
+    };
+
+    // Per-frame engine statistics (see RenderSettings::frame_stats_cb).
+    struct FrameStats {
+        int         frame = 0;
+        std::size_t segments = 0;      // segments drawn per pass
+        std::size_t culled_frustum = 0;      // see RenderSettings::frustum_cull
+        std::size_t culled_contribution = 0; // see contribution_cull_quanta
+        std::size_t lod_merged = 0;  // folded into neighbours (lod_merge_pixels);
+                                     // reduction = lod_merged / (segments + lod_merged)
+        std::size_t sample_reduced = 0; // drawn in fewer passes (sample_budget),
+                                        // not counted in 'segments'
+        std::size_t splatted = 0;       // drawn by the compute splat path
+                                        // (splat_max_pixels), not in 'segments'
+        std::size_t upload_bytes = 0;  // instance bytes sent to the GPU
+        std::size_t upload_skipped_bytes = 0; // unchanged batches (incremental_upload)
+        double      upload_ms = 0.0;   // pack + upload, until the GPU has it
+        double      draw_ms = 0.0;     // GPU time of all accumulation passes
+        int         passes = 0;        // accumulation passes drawn (fewer than
+                                       // accum_passes with adaptive_error)
+        double      context_ms = 0.0;  // GL context + GLEW setup, first frame
+                                       // of the sequence only
+    };
+
+    using FrameStatsCallback = std::function<void(const FrameStats& stats)>;
+
+    // Per-frame state of a static layer (see RenderSettings::layer_cb).
+    struct LayerState {
+        bool  visible = true;
+        float intensity = 1.0f;   // multiplies the layer's segment brightness
+
+        // Model matrix applied to the layer's endpoints (column-major,
+        // glm::value_ptr order). Identity by default.
+        float transform[16] = {
+            1.0f, 0.0f, 0.0f, 0.0f,
+            0.0f, 1.0f, 0.0f, 0.0f,
+            0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, 0.0f, 0.0f, 1.0f
+        };
+    };
+
+    // Named geometry that does not change during the sequence (grids, boxes,
+    // tunnel rings, ...). Uploaded once into its own GPU buffer and drawn
+    // every pass next to the per-frame segments, which it never counts against.
+    struct StaticLayer {
+        std::string             name;
+        std::vector<LineParams> segments;
+        LayerState              state;   // default state, every frame
+    };
+
+    // Shape drawn many times per frame (wire box, billboard frame, glyph...):
+    // its segments in local space, registered once in
+    // RenderSettings::shape_prototypes. The index there is the prototype id.
+    struct ShapePrototype {
+        std::string             name;
+        std::vector<LineParams> segments;
+    };
+
+    // One placement of a prototype (LineEmitContext::add_shape). The vertex
+    // shader expands it into all prototype segments, so the CPU only writes
+    // and uploads these 80 bytes per shape.
+    // Local point p maps to origin + p.x * axis_x + p.y * axis_y + p.z * axis_z,
+    // so the axes carry rotation and (non-uniform) scale.
+    // Layout is the GPU record (5 x vec4), hence the reserved slots.
+    struct ShapeInstance {
+        float origin[3] = { 0.0f, 0.0f, 0.0f };
+        float thickness = 1.0f;                 // multiplies prototype thickness
+        float axis_x[3] = { 1.0f, 0.0f, 0.0f };
+        float jitter = 1.0f;                    // multiplies prototype jitter
+        float axis_y[3] = { 0.0f, 1.0f, 0.0f };
+        float intensity = 1.0f;                 // multiplies prototype intensity
+        float axis_z[3] = { 0.0f, 0.0f, 1.0f };
+        float reserved0 = 0.0f;
+        float color[3] = { 1.0f, 1.0f, 1.0f };  // multiplies prototype colors
+        float reserved1 = 0.0f;
+    };
+
+    // Per-frame shape placements, one list per prototype id.
+    struct ShapeSink {
+        std::vector<std::vector<ShapeInstance>> instances;
+
+        void add(int prototype, const ShapeInstance& inst) {
+            if (prototype < 0) return;
+            if ((std::size_t)prototype >= instances.size()) {
+                instances.resize((std::size_t)prototype + 1);
+            }
+            instances[(std::size_t)prototype].push_back(inst);
+        }
+
+        std::size_t count() const {
+            std::size_t n = 0;
+            for (const auto& list : instances) n += list.size();
+            return n;
+        }
+
+        // Keeps the per-list capacity for the next frame.
+        void clear() {
+            for (auto& list : instances) list.clear();
+        }
+    };
+
+    // Built-in parametric primitives, generated entirely in the vertex shader
+    // from gl_InstanceID (LineEmitContext::add_primitive). u runs along
+    // u_segments, v along v_segments; both are 0..1 over the primitive.
+    enum class PrimitiveType {
+        Torus, // major = ring radius, minor = tube radius;
+               // u around the ring, v around the tube; 2 * u * v segments
+               // (longitudinal + meridional)
+        Ring,  // v_segments concentric circles: radius major + i * minor;
+               // u * v segments
+        Grid,  // major x minor rectangle in the local x/z plane with
+               // u x v cells; (v + 1) * u + (u + 1) * v segments
+        Helix  // radius major, height minor, 'turns' turns, v_segments
+               // evenly phased strands of u_segments segments each
+    };
+
+    struct ParametricPrimitive {
+        PrimitiveType type = PrimitiveType::Ring;
+        int   u_segments = 64;
+        int   v_segments = 1;
+
+        // Placement like ShapeInstance: local x/y/z map onto the axes
+        // around 'center'. The primitive's own axis is local y.
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float axis_x[3] = { 1.0f, 0.0f, 0.0f };
+        float axis_y[3] = { 0.0f, 1.0f, 0.0f };
+        float axis_z[3] = { 0.0f, 0.0f, 1.0f };
+
+        float major = 100.0f;
+        float minor = 20.0f;
+        float turns = 4.0f;       // Helix only
+
+        // Standing waves: relative radius modulation (absolute height for
+        // Grid) of amp * sin(2pi * freq * u|v + phase).
+        float wave_amp_u = 0.0f, wave_freq_u = 3.0f;
+        float wave_amp_v = 0.0f, wave_freq_v = 2.0f;
+        float wave_phase = 0.0f;
+
+        // Color: color0 -> color1 along u, brightness stripes along u.
+        float color0[3] = { 1.0f, 1.0f, 1.0f };
+        float color1[3] = { 1.0f, 1.0f, 1.0f };
+        float stripe_amp = 0.0f, stripe_freq = 0.0f, stripe_phase = 0.0f;
+
+        float thickness = 0.05f;
+        float jitter = 0.0f;
+        float intensity = 1.0f;
+    };
+
+    // Segments a primitive expands to (what it costs on the GPU).
+    std::size_t primitiveSegmentCount(const ParametricPrimitive& prim);
+
+    // Called once per frame and layer, before the frame's segments are
+    // generated; 'state' starts as the layer's default state.
+    using LayerCallback = std::function<void(int frame, float t,
+        int layerIndex, const std::string& name, LayerState& state)>;
+
     struct CameraParams {
         // Camera position
         float eye_x = 0.0f, eye_y = 0.0f, eye_z = 450.0f;
@@ -45,7 +237,7 @@ namespace WireEngine {
         // Up vector
         float up_x = 0.0f, up_y = 1.0f, up_z = 0.0f;
 
-        // If false => engine uses its default FOV (currently 60).
+        // If false => engine uses its default FOV (currently 60°).
         bool  has_custom_fov = false;
         float fov_y_deg = 60.0f;
 
@@ -64,9 +256,55 @@ namespace WireEngine {
         int   frames = 60;
         float fps = 60.0f;
 
+        // Frames this run renders (one shard of a distributed render):
+        // frame_begin, frame_begin + frame_step, ... below frame_end
+        // (-1 = frames). Frame index, t, jitter seeds and PNG names stay
+        // those of the whole sequence, so a shard renders the same images a
+        // single run would, provided the callbacks depend only on the frame
+        // (seeded Random / RngStream). FFmpeg shards write shardVideoPath();
+        // see shardSettings / mergeShards.
+        int   frame_begin = 0;
+        int   frame_end = -1;
+        int   frame_step = 1;
+
         // How many accumulation passes per frame (light painting jitter)
         int   accum_passes = 200;
 
+        // JitterMode::Analytic draws everything once and renders the
+        // converged (noise-free) image of accum_passes stochastic passes.
+        // The coverage table is within 0.7% of the exact expected coverage
+        // across the ribbon; the part of the jitter that moves a ribbon
+        // towards / away from the camera is not modelled, so far ribbons
+        // match best (relative error ~ jitter / camera distance).
+        // Additive blend only: with OpaqueWithDepth the engine warns and
+        // uses Stochastic.
+        JitterMode jitter_mode = JitterMode::Stochastic;
+
+        // Adaptive accumulation (Stochastic, additive blend, frames that fit
+        // the stream buffer): even and odd passes accumulate separately and
+        // every adaptive_check_passes (from adaptive_min_passes on) their
+        // difference gives the per-tile (32x32 px) noise of the image so
+        // far. Passes stop once the adaptive_percentile of the tile noise
+        // is below adaptive_error (standard deviation in tonemapped output
+        // units, e.g. 1/255; 0 = off, always accum_passes); the image is
+        // normalized by the passes drawn. FrameStats::passes reports them.
+        float adaptive_error = 0.0f;
+        float adaptive_percentile = 0.99f; // over lit tiles; 1 = worst tile
+        int   adaptive_min_passes = 16;
+        int   adaptive_check_passes = 16;
+
+        // Passes folded into one instanced draw of the per-frame segments
+        // (instance = segment * N + pass), for scenes where per-draw
+        // overhead dominates. 1 = one draw per pass; 0 = as many as fit in
+        // submit_slice_ms by the measured GPU time (all of them without a
+        // slice or a measurement). Same image, only the draw count changes.
+        int   passes_per_draw = 1;
+
+        // Flush and poll window events after about this much GPU work,
+        // estimated from earlier frames' measured draw time.
+        // 0 = every few passes, as before.
+        float submit_slice_ms = 0.0f;
+
         // Glow / bloom controls
         float exposure = 1.5f;   // overall tonemap exposure
         float bloom_threshold = 0.70f;  // how bright a pixel must be to bloom
@@ -80,9 +318,14 @@ namespace WireEngine {
 
         // Hint for maximum number of segments per frame.
         // This controls the size of the big GPU buffer.
-        // With 4M segments and 60 bytes per segment, that's ~240 MB of VRAM.
+        // With 4M segments and 60 bytes per segment, that's ~240 MB of VRAM
+        // (~100 MB with InstanceFormat::PackedQuantized).
         int   max_line_segments_hint = 4 * 1024 * 1024;
 
+        // GPU instance layout (PackedQuantized trades a little precision
+        // for 2.5x less VRAM and upload bandwidth).
+        InstanceFormat instance_format = InstanceFormat::Float32;
+
         // Readback & IO
         bool        use_pbo = true;                     // async readback
         std::string output_dir = "frames_wire_lines_glow_v3"; // PNG folder
@@ -93,8 +336,142 @@ namespace WireEngine {
         std::string ffmpeg_output = "wire.mp4";
         std::string ffmpeg_extra_args;            // appended before output
 
+        // FFmpeg output in segments of this many frames (0 = one video):
+        // one ffmpeg process per segment, each a complete video named like
+        // a shard ("<stem>.frames_<begin>-<end><ext>"). They are joined
+        // into the run's video without re-encoding when the run completes.
+        int         ffmpeg_segment_frames = 0;
+
+        // Checkpoint manifest ("" = none): after every finished PNG or
+        // video segment the engine records progress here. Restarting with
+        // the same settings and checkpoint_path skips the finished frames
+        // (no callbacks run for them) and continues at the first missing
+        // one, which for video is the start of the unfinished segment. A
+        // manifest written for other settings is ignored.
+        std::string checkpoint_path;
+
+        // Tiled rendering (0 = off): each frame is drawn as tile_size x
+        // tile_size tiles through off-center projections and stitched on
+        // the CPU, so GPU targets stay tile-sized and width / height may
+        // exceed the GL texture limit. Tiles are drawn tile_margin pixels
+        // larger on every side and cropped, so bloom crosses tile edges
+        // (keep both even for a seamless half-res bloom). FFmpeg gets the
+        // frame one tile row at a time; PNG needs it whole in host memory.
+        // Every tile draws all of the frame's segments (culling stays
+        // per frame, so the jitter seeds match across tiles); use_pbo and
+        // stream_flush_batches are ignored and adaptive_error stops each
+        // tile on its own.
+        int   tile_size = 0;
+        int   tile_margin = 16;
+
+        // Hairline splatting (0 = off): per-frame segments whose ribbon is
+        // narrower than splat_max_pixels at both ends skip the ribbon
+        // triangles. A compute shader walks each projected segment pixel
+        // by pixel (all passes, same jitter seeds), adds the pixel's share
+        // of the ribbon's energy into fixed-point accumulators with image
+        // atomics and the sum is resolved into the HDR target; integer
+        // adds do not depend on order, so the result is deterministic.
+        // Same energy per pixel on average as the ribbons, with the soft
+        // edge averaged across the line. Needs a GL 4.3 context (asked
+        // for when this is set; without one, segments stay ribbons).
+        // Additive blend only; with JitterMode::Analytic only segments
+        // without jitter qualify.
+        float splat_max_pixels = 0.0f;
+
         // How to blend / depth-test lines
         LineBlendMode line_blend_mode = LineBlendMode::AdditiveLightPainting;
+
+        // RenderBackend::CPU renders the same frames without a GL context:
+        // same ribbon expansion, jitter seeds, soft edge, attenuation,
+        // bloom and tonemap as the shaders, accumulated in float (GL uses
+        // half floats), so it doubles as the reference for the GL output.
+        // Segments, sample groups, static layers, shapes and primitives
+        // are drawn; the GL-only knobs (instance_format, use_pbo,
+        // passes_per_draw, submit_slice_ms, stream_flush_batches,
+        // adaptive_error, tile_size, splat_max_pixels) are ignored.
+        // draw_ms is CPU time.
+        RenderBackend backend = RenderBackend::OpenGL;
+
+        // GLContextProvider::EGLHeadless renders on render nodes without an
+        // X server: the egl_device-th EGL device (EGL_EXT_platform_device;
+        // -1 = the first one that gives a context), else Mesa's
+        // surfaceless platform (llvmpipe included). libEGL is loaded at run
+        // time; where EGL is missing the hidden GLFW window is used. No
+        // window events are polled on EGL. The context creation time is
+        // printed and reported as FrameStats::context_ms.
+        GLContextProvider gl_context = GLContextProvider::GLFWHiddenWindow;
+        int               egl_device = -1;
+
+        // Worker threads for LineEmitContext::parallel_for
+        // (0 = all hardware threads, 1 = run tasks on the calling thread).
+        int   worker_threads = 0;
+
+        // Pipelined frame production: camera + line callbacks run on a
+        // producer thread up to pipeline_depth frames ahead of the GL thread
+        // (0 = serial, everything on the calling thread). Callbacks still run
+        // one frame at a time in frame order, just not on the GL thread.
+        int         pipeline_depth = 0;
+        std::size_t pipeline_max_bytes = 0; // cap for queued segment data (0 = none)
+
+        // Optional per-frame statistics. When set, the engine adds GPU sync
+        // points to time upload and draw, so leave it empty for final renders.
+        FrameStatsCallback frame_stats_cb;
+
+        // Culling of per-frame segments before upload (layers, shapes and
+        // primitives are not culled). frustum_cull drops segments fully
+        // outside the camera frustum, widened by thickness + jitter.
+        // contribution_cull_quanta > 0 drops segments whose brightest
+        // possible pixel over all passes stays below that many 8-bit output
+        // steps. Thousands of such segments stacked on one pixel can still
+        // add up, so keep it at ~1 or below.
+        bool  frustum_cull = false;
+        float contribution_cull_quanta = 0.0f;
+
+        // Screen-space LOD for per-frame segments: chains of connected,
+        // nearly collinear segments with matching thickness / jitter are
+        // merged while the merged segment projects to at most
+        // lod_merge_pixels (0 = off). Color is rescaled so the energy along
+        // the chain stays the same. LineEmitContext::set_lod_pixels
+        // overrides the threshold for parts of a frame (per layer).
+        float lod_merge_pixels = 0.0f;
+        float lod_merge_max_angle_deg = 20.0f; // max bend inside a chain
+
+        // Incremental upload: the frame is split into batches at
+        // LineEmitContext::flush_now() boundaries, each batch gets a slot in
+        // the GPU buffer (rounded up to 256 segments, padded with invisible
+        // segments) and is only re-sent when its bytes or slot changed.
+        // The slot layout depends only on the frame's batch sizes, but the
+        // shader jitter is then seeded by slot, so images differ slightly
+        // from incremental_upload = false.
+        bool incremental_upload = false;
+
+        // Push API with pipeline_depth == 0: every flush_now() culls,
+        // LOD-merges, uploads and draws (all passes) the batch so far while
+        // the callback goes on generating. Host memory is then bounded by
+        // the batch instead of the frame and generation overlaps the GPU.
+        // Culling and LOD chains do not cross batches; incremental_upload
+        // is ignored. Jitter seeds are the same as without streaming.
+        bool stream_flush_batches = false;
+
+        // Per-segment sample budget: segments with jitter == 0 are identical
+        // in every pass, so they are drawn once with accum_passes times the
+        // energy; LineEmitContext::set_samples lowers the pass count of other
+        // segments too. Additive blend only. Off by default: the segments
+        // that keep every pass are renumbered, so their jitter seeds (the
+        // noise pattern) change, and zero-jitter batches leave the
+        // incremental_upload slots and are re-sent every frame.
+        bool sample_budget = false;
+
+        // Seed for the shader jitter and for callbacks (LineEmitContext::seed,
+        // RngStream). Same seed => same frames, however they are produced.
+        std::uint64_t seed = 0;
+
+        // Retained geometry, uploaded once per sequence (see StaticLayer).
+        std::vector<StaticLayer> static_layers;
+        LayerCallback            layer_cb;   // optional per-frame animation
+
+        // Instanced shapes (see ShapePrototype / LineEmitContext::add_shape).
+        std::vector<ShapePrototype> shape_prototypes;
     };
 
     // -------------------------------------------------------------------------
@@ -111,29 +488,366 @@ namespace WireEngine {
     using LineCallback =
         std::function<bool(int frame, float t, int segmentIndex, LineParams& out)>;
 
+    // Batched pull-style: called once per frame before any segment is
+    // requested. Return the exact segment count or an upper bound, so the
+    // engine can reserve once. Return a negative value if it is unknown.
+    using LineCountCallback =
+        std::function<int(int frame, float t)>;
+
+    // Batched pull-style: fill out[0 .. out.size()) with segments
+    // firstIndex, firstIndex + 1, ... straight in the engine staging buffer.
+    // Return how many were written; fewer than out.size() ends the frame.
+    using LineBatchCallback =
+        std::function<int(int frame, float t, int firstIndex,
+            std::span<LineParams> out)>;
+
     // -------------------------------------------------------------------------
     // Push-style line generation
     // -------------------------------------------------------------------------
 
+    // Engine-owned staging buffer that LineEmitContext writes into.
+    // LineParams has exactly the per-instance GPU layout, so whatever lands
+    // here is uploaded as-is: no intermediate vector, no per-index copy.
+    struct LineSink {
+        LineParams* data = nullptr;
+        std::size_t size = 0;
+        std::size_t capacity = 0;
+
+        // Called (rarely) when 'capacity' is too small; must make room for
+        // at least minCapacity segments and update data/capacity.
+        void* owner = nullptr;
+        void (*grow)(LineSink& sink, std::size_t minCapacity) = nullptr;
+
+        void reserve(std::size_t minCapacity) {
+            if (capacity < minCapacity) grow(*this, minCapacity);
+        }
+
+        // Accept n segments already written at data + size.
+        // Zero-thickness segments are compacted away in place.
+        void commit(std::size_t n) {
+            LineParams* dst = data + size;
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < n; ++i) {
+                if (dst[i].thickness > 0.0f) {
+                    if (kept != i) dst[kept] = dst[i];
+                    ++kept;
+                }
+            }
+            size += kept;
+        }
+    };
+
+    // -------------------------------------------------------------------------
+    // Structure-of-arrays segment batch
+    // -------------------------------------------------------------------------
+
+    // Growable float array with 32-byte aligned storage (AVX friendly).
+    class AlignedFloats {
+    public:
+        static constexpr std::size_t kAlignment = 32;
+
+        AlignedFloats() = default;
+        ~AlignedFloats() { release(); }
+
+        AlignedFloats(const AlignedFloats&) = delete;
+        AlignedFloats& operator=(const AlignedFloats&) = delete;
+
+        AlignedFloats(AlignedFloats&& o) noexcept
+            : data_(o.data_), size_(o.size_), capacity_(o.capacity_) {
+            o.data_ = nullptr; o.size_ = 0; o.capacity_ = 0;
+        }
+        AlignedFloats& operator=(AlignedFloats&& o) noexcept {
+            if (this != &o) {
+                release();
+                data_ = o.data_; size_ = o.size_; capacity_ = o.capacity_;
+                o.data_ = nullptr; o.size_ = 0; o.capacity_ = 0;
+            }
+            return *this;
+        }
+
+        float*       data()       { return data_; }
+        const float* data() const { return data_; }
+        std::size_t  size() const { return size_; }
+
+        float&       operator[](std::size_t i)       { return data_[i]; }
+        const float& operator[](std::size_t i) const { return data_[i]; }
+
+        // New elements are left uninitialized (generators overwrite them).
+        void resize(std::size_t n) {
+            reserve(n);
+            size_ = n;
+        }
+
+        void reserve(std::size_t n) {
+            if (n <= capacity_) return;
+            std::size_t cap = capacity_ ? capacity_ * 2 : 256;
+            if (cap < n) cap = n;
+            float* p = static_cast<float*>(::operator new(cap * sizeof(float),
+                std::align_val_t{ kAlignment }));
+            if (size_) std::memcpy(p, data_, size_ * sizeof(float));
+            release();
+            data_ = p;
+            capacity_ = cap;
+        }
+
+    private:
+        void release() {
+            if (data_) ::operator delete(data_, std::align_val_t{ kAlignment });
+            data_ = nullptr;
+            capacity_ = 0;
+        }
+
+        float*      data_ = nullptr;
+        std::size_t size_ = 0;
+        std::size_t capacity_ = 0;
+    };
+
+    // Same fields as LineParams, one aligned array per field, so generators
+    // can fill endpoints / colors with vectorized loops. The engine
+    // interleaves it into the GPU layout with SIMD (see add_batch).
+    struct SegmentBatch {
+        AlignedFloats start_x, start_y, start_z;
+        AlignedFloats end_x, end_y, end_z;
+        AlignedFloats start_r, start_g, start_b;
+        AlignedFloats end_r, end_g, end_b;
+        AlignedFloats thickness;
+        AlignedFloats jitter;
+        AlignedFloats intensity;
+
+        std::size_t size() const { return count; }
+
+        // Resizes every field array; new entries are uninitialized.
+        void resize(std::size_t n) {
+            for (AlignedFloats* a : fields()) a->resize(n);
+            count = n;
+        }
+        void clear() { resize(0); }
+
+        void set(std::size_t i, const LineParams& lp) {
+            start_x[i] = lp.start_x; start_y[i] = lp.start_y; start_z[i] = lp.start_z;
+            end_x[i] = lp.end_x;     end_y[i] = lp.end_y;     end_z[i] = lp.end_z;
+            start_r[i] = lp.start_r; start_g[i] = lp.start_g; start_b[i] = lp.start_b;
+            end_r[i] = lp.end_r;     end_g[i] = lp.end_g;     end_b[i] = lp.end_b;
+            thickness[i] = lp.thickness;
+            jitter[i] = lp.jitter;
+            intensity[i] = lp.intensity;
+        }
+        void push_back(const LineParams& lp) {
+            resize(count + 1);
+            set(count - 1, lp);
+        }
+
+        // Field arrays in LineParams order.
+        std::array<AlignedFloats*, 15> fields() {
+            return { &start_x, &start_y, &start_z, &end_x, &end_y, &end_z,
+                     &start_r, &start_g, &start_b, &end_r, &end_g, &end_b,
+                     &thickness, &jitter, &intensity };
+        }
+        std::array<const AlignedFloats*, 15> fields() const {
+            return { &start_x, &start_y, &start_z, &end_x, &end_y, &end_z,
+                     &start_r, &start_g, &start_b, &end_r, &end_g, &end_b,
+                     &thickness, &jitter, &intensity };
+        }
+
+    private:
+        std::size_t count = 0;
+    };
+
+    // Interleave batch[first .. first + n) into 'out' (LineParams layout).
+    // Uses AVX2 or SSE when the build targets them, scalar otherwise.
+    void interleaveSegmentBatch(const SegmentBatch& batch,
+        std::size_t first, std::size_t n, LineParams* out);
+
+    // -------------------------------------------------------------------------
+    // Counter-based random numbers
+    // -------------------------------------------------------------------------
+    // Every value is a pure function of (seed, frame, stream, index): no
+    // shared state, so generation can run on any thread in any order and a
+    // frame re-renders bit-exactly. Use RenderSettings::seed (also in
+    // LineEmitContext::seed) as the seed and e.g. a parallel_for task index
+    // or an object id as the stream.
+    struct RngKey {
+        std::uint32_t lo = 0;
+        std::uint32_t hi = 0;
+    };
+
+    inline std::uint64_t splitmix64(std::uint64_t z) {
+        z += 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    inline RngKey rngKey(std::uint64_t seed, int frame, std::uint32_t stream) {
+        const std::uint64_t fs = (std::uint64_t(std::uint32_t(frame)) << 32) | stream;
+        const std::uint64_t z = splitmix64(seed ^ splitmix64(fs));
+        return { std::uint32_t(z), std::uint32_t(z >> 32) };
+    }
+
+    // 32-bit mixer (same as hash_u in the scene shader).
+    inline std::uint32_t rngHash32(std::uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    inline std::uint32_t rngU32(RngKey key, std::uint32_t index) {
+        return rngHash32(rngHash32(index ^ key.lo) + key.hi);
+    }
+
+    // [0, 1) with 24 bits, exactly what rngFill produces.
+    inline float rngFloat01(RngKey key, std::uint32_t index) {
+        return float(rngU32(key, index) >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Sequential view of one key: value i of the stream is rngU32(key, i),
+    // so a stream can also be split or skipped ahead freely.
+    struct RngStream {
+        RngKey        key;
+        std::uint32_t counter = 0;
+
+        RngStream() = default;
+        explicit RngStream(RngKey k, std::uint32_t first = 0) : key(k), counter(first) {}
+        RngStream(std::uint64_t seed, int frame, std::uint32_t stream)
+            : key(rngKey(seed, frame, stream)) {}
+
+        std::uint32_t next_u32() { return rngU32(key, counter++); }
+        float next01() { return rngFloat01(key, counter++); }
+        float next_signed() { return next01() * 2.0f - 1.0f; }
+        float next_range(float lo, float hi) { return lo + (hi - lo) * next01(); }
+    };
+
+    // out[i] = lo + (hi - lo) * rngFloat01(key, firstIndex + i), vectorized
+    // (AVX2 / SSE2 when the build targets them). With the default range the
+    // values are exactly rngFloat01's.
+    void rngFill(RngKey key, std::uint32_t firstIndex,
+        float* out, std::size_t n, float lo = 0.0f, float hi = 1.0f);
+
+    // LineEmitContext::set_lod_pixels: from segment 'first' of the frame on,
+    // merge with threshold 'pixels' (< 0 => back to lod_merge_pixels).
+    struct LodMark {
+        std::size_t first = 0;
+        float       pixels = -1.0f;
+    };
+
+    // LineEmitContext::set_samples: from segment 'first' of the frame on,
+    // draw in 'samples' accumulation passes (<= 0 => all of them).
+    struct SampleMark {
+        std::size_t first = 0;
+        int         samples = 0;
+    };
+
+    struct LineEmitContext;
+
+    // One independent generation job for LineEmitContext::parallel_for.
+    using EmitTask = std::function<void(int task, LineEmitContext& ctx)>;
+
+    struct EmitPool; // engine worker pool + per-task buffers (opaque)
+
     struct LineEmitContext {
         // User data you pass to renderSequencePush (optional).
         void* user_ptr = nullptr;
 
-        // Functions provided by the engine for this frame.
-        std::function<void(const LineParams&)> emit;
-        std::function<void()>                  flush;
+        // Where add()/add_span() write, provided by the engine for this frame.
+        LineSink* sink = nullptr;
+
+        // Where add_shape() writes (push API only, null => shapes dropped).
+        ShapeSink* shapes = nullptr;
+
+        // Where add_primitive() writes (push API only, null => dropped).
+        std::vector<ParametricPrimitive>* primitives = nullptr;
+
+        // Where set_lod_pixels() records its marks (push API only).
+        std::vector<LodMark>* lod = nullptr;
+
+        // Where set_samples() records its marks (push API only).
+        std::vector<SampleMark>* sampleMarks = nullptr;
+
+        // RenderSettings::seed, for RngStream / rngKey in callbacks.
+        std::uint64_t seed = 0;
+
+        // Engine worker pool for parallel_for (null => run sequentially).
+        EmitPool* pool = nullptr;
+
+        // Provided by the engine for this frame (semantic batch boundary;
+        // see RenderSettings::incremental_upload / stream_flush_batches).
+        std::function<void()> flush;
 
-        // Convenience helpers so user code looks nice.
+        // Append one segment straight into the engine staging buffer.
+        // Zero-thickness segments are dropped here, like the engine always did.
         void add(const LineParams& lp) const {
-            if (emit) emit(lp);
+            if (!sink || !(lp.thickness > 0.0f)) return;
+            if (sink->size == sink->capacity) {
+                sink->grow(*sink, sink->size + 1);
+            }
+            sink->data[sink->size++] = lp;
         }
+
+        // Append many segments at once (one capacity check, one bulk copy).
+        void add_span(std::span<const LineParams> lps) const {
+            if (!sink || lps.empty()) return;
+            sink->reserve(sink->size + lps.size());
+            std::memcpy(sink->data + sink->size, lps.data(),
+                lps.size() * sizeof(LineParams));
+            sink->commit(lps.size());
+        }
+
+        // Append a whole structure-of-arrays batch (SIMD interleave).
+        void add_batch(const SegmentBatch& batch) const {
+            if (!sink || batch.size() == 0) return;
+            sink->reserve(sink->size + batch.size());
+            interleaveSegmentBatch(batch, 0, batch.size(), sink->data + sink->size);
+            sink->commit(batch.size());
+        }
+
+        // Place one instance of RenderSettings::shape_prototypes[prototype].
+        // Unknown prototype ids are ignored at draw time.
+        void add_shape(int prototype, const ShapeInstance& inst) const {
+            if (shapes) shapes->add(prototype, inst);
+        }
+
+        // Draw a parametric primitive this frame; costs a few uniforms
+        // instead of primitiveSegmentCount(prim) uploaded segments.
+        void add_primitive(const ParametricPrimitive& prim) const {
+            if (primitives && prim.u_segments > 0 && prim.v_segments > 0) {
+                primitives->push_back(prim);
+            }
+        }
+
+        // Screen-space LOD threshold for the segments added after this call,
+        // e.g. 2 px for far rings, 0 for hero geometry that must stay exact,
+        // negative to return to RenderSettings::lod_merge_pixels.
+        void set_lod_pixels(float pixels) const {
+            if (lod && sink) lod->push_back({ sink->size, pixels });
+        }
+
+        // Accumulation passes for the segments added after this call, e.g. 1
+        // for static geometry whose jitter does not matter. They are drawn
+        // that many times with their energy scaled to match all passes;
+        // <= 0 returns to every pass. Needs RenderSettings::sample_budget.
+        void set_samples(int samples) const {
+            if (sampleMarks && sink) sampleMarks->push_back({ sink->size, samples });
+        }
+
         void flush_now() const {
             if (flush) flush();
         }
+
+        // Run task(0 .. taskCount-1) on the engine worker pool. Each task gets
+        // its own context backed by its own buffer; the buffers are appended
+        // to this context in task order, so the result is bit-identical to a
+        // sequential run. Tasks must be independent (no shared mutable state,
+        // e.g. no Random:: calls). Contexts handed to tasks run nested
+        // parallel_for calls sequentially and their flush is a no-op.
+        void parallel_for(int taskCount, const EmitTask& task);
     };
 
-    // You get (frame, t, ctx) and you just call ctx.emit(lp) as many times
-    // as you like. ctx.user_ptr is whatever you passed into renderSequencePush.
+    // You get (frame, t, ctx) and you just call ctx.add(lp) / ctx.add_span(...)
+    // as many times as you like.
+    // ctx.user_ptr is whatever you passed into renderSequencePush.
     using LinePushCallback =
         std::function<void(int frame, float t, LineEmitContext& ctx)>;
 
@@ -147,6 +861,14 @@ namespace WireEngine {
         const LineCallback& lineCb,
         void* camera_user_ptr = nullptr);
 
+    // Batched pull-style variant: countCb is asked once per frame, then
+    // batchCb fills contiguous chunks directly in the engine staging buffer.
+    void renderSequenceBatched(const RenderSettings& settings,
+        const CameraCallback& cameraCb,
+        const LineCountCallback& countCb,
+        const LineBatchCallback& batchCb,
+        void* camera_user_ptr = nullptr);
+
     // Push-style variant: user pushes lines via LineEmitContext.
     // user_ptr is forwarded into LineEmitContext::user_ptr every frame.
     void renderSequencePush(const RenderSettings& settings,
@@ -154,4 +876,34 @@ namespace WireEngine {
         const LinePushCallback& lineCb,
         void* user_ptr = nullptr);
 
+    // Distributed renders: settings for shard 'shard' of 'shardCount'
+    // contiguous, near-equal parts of settings' frame range. Exits with an
+    // error unless 0 <= shard < shardCount.
+    RenderSettings shardSettings(const RenderSettings& settings,
+        int shard, int shardCount);
+
+    // Video an OutputMode::FFmpegVideo run writes: ffmpeg_output, or
+    // "<stem>.frames_<begin>-<end><ext>" when the frame range is not the
+    // whole sequence.
+    std::string shardVideoPath(const RenderSettings& settings);
+
+    // Joins the outputs of shardSettings(settings, 0 .. shardCount - 1)
+    // without re-encoding: FFmpegVideo concatenates the shard videos into
+    // ffmpeg_output (concat demuxer, stream copy); FramesPNG shards already
+    // share output_dir and frame names, so it checks that every frame is
+    // there. Returns false, naming what is missing, if a shard is incomplete.
+    bool mergeShards(const RenderSettings& settings, int shardCount);
+
+    // Build a ShapePrototype with the push API (segments in local space).
+    ShapePrototype makeShapePrototype(const std::string& name,
+        const std::function<void(LineEmitContext& ctx)>& build,
+        void* user_ptr = nullptr);
+
+    // Build a StaticLayer with the push API, e.g. from existing draw
+    // helpers: makeStaticLayer("grid", [](LineEmitContext& ctx) { ... }).
+    // Zero-thickness segments are dropped like in a frame callback.
+    StaticLayer makeStaticLayer(const std::string& name,
+        const std::function<void(LineEmitContext& ctx)>& build,
+        void* user_ptr = nullptr);
+
 } // namespace WireEngine
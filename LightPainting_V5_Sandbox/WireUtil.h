@@ -6,11 +6,14 @@
 // Standard library
 // -----------------------------------------------------------------------------
 #include <array>
+#include <atomic>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <random>
 #include <sstream>
 #include <string>
@@ -54,24 +57,90 @@ inline const std::string g_base_output_filepath =
 // -----------------------------------------------------------------------------
 // Random helpers
 // -----------------------------------------------------------------------------
+// Counter-based (WireEngine::RngStream), one stream per thread, so these are
+// cheap and thread-safe. Unseeded they differ every run like before; call
+// set_seed(settings.seed) for reproducible renders. set_seed gives the
+// calling thread stream 0 and starts a new generation: every other thread
+// re-keys on its next draw and gets the next stream id (1, 2, ...) in the
+// order threads first draw after set_seed, however many threads the
+// process started before (engine workers, earlier sequences). So one
+// other drawing thread, e.g. the pipeline producer (pipeline_depth > 0),
+// is reproducible too; several threads drawing at once are not, and a
+// frame's values still depend on the frames drawn before it. For
+// frame-exact (sharded) or parallel generation use
+// Random::stream(seed, frame, id) instead: its values do not depend on
+// how many numbers were drawn elsewhere.
 namespace Random
 {
-    inline std::mt19937& get_engine()
+    struct SeedState
     {
-        static std::mt19937 engine{ std::random_device{}() };
-        return engine;
+        std::mutex mutex;
+        std::uint64_t seed =
+            (std::uint64_t(std::random_device{}()) << 32) | std::random_device{}();
+        std::atomic<std::uint32_t> generation{ 1 }; // bumped by set_seed
+        std::uint32_t nextId = 0;                   // stream ids handed out
+    };
+
+    inline SeedState& seed_state()
+    {
+        static SeedState state;
+        return state;
+    }
+
+    struct ThreadStream
+    {
+        std::uint32_t generation = 0; // of seed_state() when keyed
+        WireEngine::RngStream stream;
+    };
+
+    inline ThreadStream& thread_stream()
+    {
+        thread_local ThreadStream local;
+        return local;
+    }
+
+    inline WireEngine::RngStream& get_stream()
+    {
+        SeedState& state = seed_state();
+        ThreadStream& local = thread_stream();
+        if (local.generation != state.generation.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            local.generation = state.generation.load(std::memory_order_relaxed);
+            local.stream = WireEngine::RngStream(state.seed, 0, state.nextId++);
+        }
+        return local.stream;
+    }
+
+    // Restarts the calling thread's stream as stream 0; other threads
+    // re-key on their next draw (see above).
+    inline void set_seed(std::uint64_t seed)
+    {
+        SeedState& state = seed_state();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.seed = seed;
+        state.nextId = 1;
+        const std::uint32_t generation =
+            state.generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+        ThreadStream& local = thread_stream();
+        local.generation = generation;
+        local.stream = WireEngine::RngStream(seed, 0, 0);
     }
 
     inline float random_01()
     {
-        static std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-        return dist(get_engine());
+        return get_stream().next01();
     }
 
     inline float random_signed()
     {
-        static std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
-        return dist(get_engine());
+        return get_stream().next_signed();
+    }
+
+    inline WireEngine::RngStream stream(std::uint64_t seed, int frame, std::uint32_t id)
+    {
+        return WireEngine::RngStream(seed, frame, id);
     }
 }
 
@@ -105,6 +174,24 @@ inline Vec3 normalize3(const Vec3& v)
     return v / len;
 }
 
+// Place a shape prototype: local x/y/z map to the (scaled) right/up/forward
+// axes around 'origin' (see WireEngine::ShapeInstance).
+inline WireEngine::ShapeInstance make_shape_instance(const Vec3& origin,
+    const Vec3& right, const Vec3& up, const Vec3& forward,
+    const Vec3& color = Vec3(1.0f))
+{
+    WireEngine::ShapeInstance inst{};
+    for (int i = 0; i < 3; ++i)
+    {
+        inst.origin[i] = origin[i];
+        inst.axis_x[i] = right[i];
+        inst.axis_y[i] = up[i];
+        inst.axis_z[i] = forward[i];
+        inst.color[i] = color[i];
+    }
+    return inst;
+}
+
 // -----------------------------------------------------------------------------
 // Unique-name helper + macro (what WIRE_UNIQUE_NAME uses)
 // -----------------------------------------------------------------------------
@@ -15,6 +15,7 @@ IGNORED_HEADERS = {
     "WireEngine_v4.h",
     "WireEngine_v5.h",
     "make_new_version.h",
+    "benchmark_instance_format.h",
     # Add more names here if needed
 }
 